@@ -19,6 +19,7 @@ typedef struct Options {
     bool compileOnly;
     bool recursive;
     bool list;
+    int optLevel;
 } Options;
 
 static Options opts;
@@ -39,6 +40,7 @@ static void errorCallback(JStarVM* vm, JStarResult res, const char* file, int ln
 static void initVM(void) {
     JStarConf conf = jsrGetConf();
     conf.errorCallback = &errorCallback;
+    conf.optimize = opts.optLevel > 0;
     vm = jsrNewVM(&conf);
 }
 
@@ -260,9 +262,15 @@ static void parseArguments(int argc, char** argv) {
         OPT_BOOLEAN('c', "compile-only", &opts.compileOnly,
                     "Compile files but do not generate output files. Used for syntax checking", 0,
                     0, 0),
+        OPT_INTEGER('O', "optimize", &opts.optLevel,
+                    "Optimization level of the generated bytecode, 0 disables all optimizations "
+                    "(default 1)",
+                    0, 0, 0),
         OPT_END(),
     };
 
+    opts.optLevel = 1;
+
     struct argparse argparse;
     argparse_init(&argparse, options, usage, 0);
     argparse_describe(&argparse, "jstarc compiles J* source files to bytecode", NULL);
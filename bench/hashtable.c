@@ -0,0 +1,207 @@
+// Lookup microbenchmark of the internal HashTable.
+// Compares the grouped probe of hashtable.c with the linear probe it replaced, that tested one
+// slot at a time. The linear probe is embedded below, as it was before the change.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hashtable.h"
+#include "jstar.h"
+#include "object.h"
+#include "value.h"
+
+#define NUM_KEYS    50000
+#define LOOKUPS     20000000
+#define RUNS        5
+#define LINEAR_GROW 2
+#define LINEAR_LOAD 0.75
+#define LINEAR_INIT 8
+
+static const int tableSizes[] = {8, 32, 128, 1024, 5000, NUM_KEYS};
+
+// The lookups of hashtable.c are calls into the library, keep the linear probe out of line too
+#if defined(__GNUC__)
+    #define NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+    #define NOINLINE __declspec(noinline)
+#else
+    #define NOINLINE
+#endif
+
+// -----------------------------------------------------------------------------
+// PREVIOUS LINEAR PROBE
+// -----------------------------------------------------------------------------
+
+typedef struct LinearTable {
+    size_t sizeMask;
+    size_t numEntries;
+    Entry* entries;
+} LinearTable;
+
+static Entry* linearFindEntry(Entry* entries, size_t sizeMask, ObjString* key) {
+    size_t i = stringGetHash(key) & sizeMask;
+    Entry* tomb = NULL;
+
+    for(;;) {
+        Entry* e = &entries[i];
+        if(!e->key) {
+            if(IS_NULL(e->value)) {
+                return tomb ? tomb : e;
+            } else if(!tomb) {
+                tomb = e;
+            }
+        } else if(stringEquals(e->key, key)) {
+            return e;
+        }
+        i = (i + 1) & sizeMask;
+    }
+}
+
+static void linearGrow(LinearTable* t) {
+    size_t oldSize = t->entries ? t->sizeMask + 1 : 0;
+    size_t newSize = oldSize ? oldSize * LINEAR_GROW : LINEAR_INIT;
+    Entry* newEntries = malloc(sizeof(Entry) * newSize);
+
+    for(size_t i = 0; i < newSize; i++) {
+        newEntries[i] = (Entry){NULL, NULL_VAL};
+    }
+
+    t->numEntries = 0;
+    for(size_t i = 0; i < oldSize; i++) {
+        Entry* e = &t->entries[i];
+        if(!e->key) continue;
+
+        Entry* dest = linearFindEntry(newEntries, newSize - 1, e->key);
+        *dest = (Entry){e->key, e->value};
+        t->numEntries++;
+    }
+
+    free(t->entries);
+    t->entries = newEntries;
+    t->sizeMask = newSize - 1;
+}
+
+static void linearPut(LinearTable* t, ObjString* key, Value val) {
+    if(t->numEntries + 1 > (t->sizeMask + 1) * LINEAR_LOAD) {
+        linearGrow(t);
+    }
+
+    Entry* e = linearFindEntry(t->entries, t->sizeMask, key);
+    if(!e->key && IS_NULL(e->value)) {
+        t->numEntries++;
+    }
+
+    *e = (Entry){key, val};
+}
+
+NOINLINE static bool linearGet(LinearTable* t, ObjString* key, Value* res) {
+    if(t->entries == NULL) return false;
+    Entry* e = linearFindEntry(t->entries, t->sizeMask, key);
+    if(!e->key) return false;
+    *res = e->value;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// BENCHMARK
+// -----------------------------------------------------------------------------
+
+static ObjString* hitKeys[NUM_KEYS];
+static ObjString* missKeys[NUM_KEYS];
+
+// Returns the time of LOOKUPS lookups in ns per lookup
+static double timeGrouped(HashTable* t, ObjString** keys, int size, double* sum) {
+    clock_t start = clock();
+    for(long i = 0; i < LOOKUPS; i++) {
+        Value v;
+        if(hashTableGet(t, keys[i % size], &v)) *sum += AS_NUM(v);
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / LOOKUPS;
+}
+
+static double timeLinear(LinearTable* t, ObjString** keys, int size, double* sum) {
+    clock_t start = clock();
+    for(long i = 0; i < LOOKUPS; i++) {
+        Value v;
+        if(linearGet(t, keys[i % size], &v)) *sum += AS_NUM(v);
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / LOOKUPS;
+}
+
+static double minTime(double best, double time) {
+    return best < 0 || time < best ? time : best;
+}
+
+// Both tables must agree on every key before their timings are compared
+static bool checkTables(HashTable* grouped, LinearTable* linear, int size) {
+    for(int i = 0; i < size; i++) {
+        for(int hit = 0; hit <= 1; hit++) {
+            ObjString* key = hit ? hitKeys[i] : missKeys[i];
+            Value v1 = NULL_VAL, v2 = NULL_VAL;
+            bool found1 = hashTableGet(grouped, key, &v1);
+            bool found2 = linearGet(linear, key, &v2);
+            if(found1 != hit || found2 != hit || !valueEquals(v1, v2)) return false;
+        }
+    }
+    return true;
+}
+
+int main(void) {
+    // Keys aren't reachable by the garbage collector, make sure it never runs
+    JStarConf conf = jsrGetConf();
+    conf.initGC = (size_t)1 << 40;
+    conf.nurserySize = (size_t)1 << 40;
+    JStarVM* vm = jsrNewVM(&conf);
+
+    char buf[32];
+    for(int i = 0; i < NUM_KEYS; i++) {
+        int len = snprintf(buf, sizeof(buf), "key_%d", i);
+        hitKeys[i] = copyString(vm, buf, len);
+        len = snprintf(buf, sizeof(buf), "missing_%d", i);
+        missKeys[i] = copyString(vm, buf, len);
+    }
+
+    printf("HashTable lookups, ns per lookup (best of %d runs of %d lookups)\n", RUNS, LOOKUPS);
+    printf("%8s %12s %12s %12s %12s\n", "keys", "hit linear", "hit grouped", "miss linear",
+           "miss grouped");
+
+    double sum = 0;
+    for(size_t s = 0; s < sizeof(tableSizes) / sizeof(tableSizes[0]); s++) {
+        int size = tableSizes[s];
+
+        HashTable grouped;
+        LinearTable linear = {0};
+        initHashTable(&grouped);
+        for(int i = 0; i < size; i++) {
+            hashTablePut(vm, &grouped, hitKeys[i], NUM_VAL(i));
+            linearPut(&linear, hitKeys[i], NUM_VAL(i));
+        }
+
+        if(!checkTables(&grouped, &linear, size)) {
+            fprintf(stderr, "Lookup mismatch with %d keys\n", size);
+            return EXIT_FAILURE;
+        }
+
+        // The runs of the two tables are interleaved, so that they see the same machine noise
+        double hitLinear = -1, hitGrouped = -1, missLinear = -1, missGrouped = -1;
+        for(int r = 0; r < RUNS; r++) {
+            hitLinear = minTime(hitLinear, timeLinear(&linear, hitKeys, size, &sum));
+            hitGrouped = minTime(hitGrouped, timeGrouped(&grouped, hitKeys, size, &sum));
+            missLinear = minTime(missLinear, timeLinear(&linear, missKeys, size, &sum));
+            missGrouped = minTime(missGrouped, timeGrouped(&grouped, missKeys, size, &sum));
+        }
+        printf("%8d %12.2f %12.2f %12.2f %12.2f\n", size, hitLinear, hitGrouped, missLinear,
+               missGrouped);
+
+        freeHashTable(vm, &grouped);
+        free(linear.entries);
+    }
+
+    // Keep the lookups from being optimized away
+    if(sum < 0) printf("%g\n", sum);
+
+    jsrFreeVM(vm);
+    return EXIT_SUCCESS;
+}
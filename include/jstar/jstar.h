@@ -60,18 +60,39 @@ typedef void (*JStarErrorCB)(JStarVM* vm, JStarResult err, const char* file, int
 JSTAR_API void jsrPrintErrorCB(JStarVM* vm, JStarResult err, const char* file, int line,
                                const char* error);
 
+// Memory allocation callback, used by the VM for all of its memory.
+// It must behave like `realloc`: it allocates a new block if `ptr` is NULL, resizes `ptr`
+// otherwise, and frees it returning NULL if `newSize` is 0. `oldSize` is the size `ptr` has been
+// allocated with (0 if `ptr` is NULL). Returns NULL if the memory cannot be allocated, in which
+// case the VM gives back a small reserve of memory to keep running and raises an
+// OutOfMemoryException
+typedef void* (*JStarReallocCB)(void* ptr, size_t oldSize, size_t newSize, void* userData);
+
+// Default implementation of the allocation callback, based on the libc `realloc` and `free`
+JSTAR_API void* jsrDefaultReallocCB(void* ptr, size_t oldSize, size_t newSize, void* userData);
+
 typedef struct JstarConf {
     size_t stackSize;            // Initial stack size in bytes
     size_t initGC;               // first GC threshold point
     int heapGrowRate;            // The rate at which the heap will grow after a succesful GC
+    size_t nurserySize;          // Bytes allocated between two minor GCs
+    size_t gcStepSize;           // Bytes allocated between two incremental major GC steps
+    size_t gcStepBudget;         // Objects visited or swept by an incremental major GC step
+                                 // (SIZE_MAX makes major GCs non-incremental)
+    int gcThreads;               // Threads marking the heap during non-incremental major GCs
+    size_t heapLimit;            // Bytes after which OutOfMemoryException is raised (0 = no limit)
+    JStarReallocCB allocator;    // Allocation callback
+    void* allocatorData;         // Custom data passed to the allocation callback
     JStarErrorCB errorCallback;  // Error callback
     void* customData;            // Custom data associated with the VM
+    bool optimize;               // Whether the compiler should optimize the generated bytecode
 } JStarConf;
 
 // Retuns a JStarConf struct initialized with default values
 JSTAR_API JStarConf jsrGetConf(void);
 
-// Allocate a new VM with all the state needed for code execution
+// Allocate a new VM with all the state needed for code execution.
+// Returns NULL if the allocation callback fails to allocate it
 JSTAR_API JStarVM* jsrNewVM(const JStarConf* conf);
 
 // Free a previously obtained VM along with all of its state
@@ -80,6 +101,43 @@ JSTAR_API void jsrFreeVM(JStarVM* vm);
 // Get the custom data associated with the VM at configuration time (if any)
 JSTAR_API void* jsrGetCustomData(JStarVM* vm);
 
+// Breakdown of the memory currently allocated by the VM, in bytes
+typedef struct JStarMemStats {
+    size_t total;    // All the memory allocated by the VM
+    size_t objects;  // Objects and the memory directly owned by them
+    size_t tables;   // Internal hash tables (module globals, class methods, instance fields...)
+    size_t code;     // Bytecode, constants and symbols of functions
+    size_t vm;       // VM stacks and GC bookkeeping
+} JStarMemStats;
+
+// Get the amount of memory currently allocated by the VM
+JSTAR_API JStarMemStats jsrGetMemStats(JStarVM* vm);
+
+// Statistics of the garbage collector
+typedef struct JStarGCStats {
+    size_t minorCollections;  // Minor collections performed
+    size_t majorCollections;  // Major collections completed
+    double totalPause;        // Time spent in GC pauses, in milliseconds
+    double maxPause;          // Longest GC pause, in milliseconds
+    size_t bytesAllocated;    // Bytes allocated since the creation of the VM
+    size_t bytesFreed;        // Bytes freed since the creation of the VM
+    size_t liveBytes;         // Bytes allocated at the end of the last collection
+    size_t heapSize;          // Bytes currently allocated
+    size_t nextGC;            // Heap size at which the next major collection will start
+    int heapGrowRate;         // Rate at which the heap grows after a major collection
+    int objectTypes;          // Number of object types
+    const char** typeNames;   // Names of the object types
+    const size_t* objects;    // Objects currently allocated, by type
+} JStarGCStats;
+
+// Get the statistics of the garbage collector
+JSTAR_API JStarGCStats jsrGetGCStats(JStarVM* vm);
+
+// Tune the garbage collector at runtime. `nextGC` is overwritten by the heap growth computed at
+// the end of every major collection
+JSTAR_API void jsrSetHeapGrowRate(JStarVM* vm, int heapGrowRate);
+JSTAR_API void jsrSetNextGC(JStarVM* vm, size_t nextGC);
+
 // Evaluate J* code read with `jsrReadFile` in the context of module (or __main__ in jsrEval).
 // JSR_SUCCESS will be returned if the execution completed normally.
 // In case of errors, either JSR_SYNTAX_ERR, JSR_COMPILE_ERR, _JSR_DESERIALIZE_ERR or JSR_VER_ERR
@@ -198,6 +256,13 @@ JSTAR_API void jsrEnsureStack(JStarVM* vm, size_t needed);
 // A C function callable from J*
 typedef bool (*JStarNative)(JStarVM* vm);
 
+// Element types of the J* typed arrays (Float64Array, Int32Array and ByteArray)
+typedef enum JStarArrayType {
+    JSR_FLOAT64_ARRAY,  // double
+    JSR_INT32_ARRAY,    // int32_t
+    JSR_BYTE_ARRAY,     // uint8_t
+} JStarArrayType;
+
 // -----------------------------------------------------------------------------
 // NATIVE REGISTRY
 // -----------------------------------------------------------------------------
@@ -255,6 +320,10 @@ JSTAR_API void jsrPushTuple(JStarVM* vm, size_t size);
 JSTAR_API void jsrPushTable(JStarVM* vm);
 JSTAR_API void jsrPushValue(JStarVM* vm, int slot);
 JSTAR_API void* jsrPushUserdata(JStarVM* vm, size_t size, void (*finalize)(void*));
+// Pushes a typed array of `length` elements initialized to 0, and returns its data.
+// If the size in bytes of the array overflows a size_t, raises an InvalidArgException and returns
+// NULL
+JSTAR_API void* jsrPushTypedArray(JStarVM* vm, JStarArrayType type, size_t length);
 JSTAR_API void jsrPushNative(JStarVM* vm, const char* module, const char* name, JStarNative nat,
                              uint8_t argc);
 
@@ -409,6 +478,18 @@ JSTAR_API void jsrBindNative(JStarVM* vm, int clsSlot, int natSlot);
 // Does not perform type checking, the user must ensure `slot` is a Userdatum
 JSTAR_API void* jsrGetUserdata(JStarVM* vm, int slot);
 
+// -----------------------------------------------------------------------------
+// TYPED ARRAY MANIPULATION FUNCTIONS
+// -----------------------------------------------------------------------------
+
+// Get the elements of the typed array at `slot`, placing their number in `length`.
+// The elements can be read and written in place, as long as the array is reachable.
+// Does not perform type checking, the user must ensure `slot` is a typed array
+JSTAR_API void* jsrGetTypedArrayData(JStarVM* vm, int slot, size_t* length);
+// Get the element type of the typed array at `slot`
+// Does not perform type checking, the user must ensure `slot` is a typed array
+JSTAR_API JStarArrayType jsrGetTypedArrayType(JStarVM* vm, int slot);
+
 // -----------------------------------------------------------------------------
 // TYPE CHECKING FUNCTIONS
 // -----------------------------------------------------------------------------
@@ -426,6 +507,7 @@ JSTAR_API bool jsrIsInstance(JStarVM* vm, int slot);
 JSTAR_API bool jsrIsTable(JStarVM* vm, int slot);
 JSTAR_API bool jsrIsFunction(JStarVM* vm, int slot);
 JSTAR_API bool jsrIsUserdata(JStarVM* vm, int slot);
+JSTAR_API bool jsrIsTypedArray(JStarVM* vm, int slot);
 
 // These functions return true if the slot is of the given type, false otherwise
 // leaving a TypeException on top of the stack with a message customized with `name`
@@ -440,6 +522,7 @@ JSTAR_API bool jsrCheckHandle(JStarVM* vm, int slot, const char* name);
 JSTAR_API bool jsrCheckTable(JStarVM* vm, int slot, const char* name);
 JSTAR_API bool jsrCheckFunction(JStarVM* vm, int slot, const char* name);
 JSTAR_API bool jsrCheckUserdata(JStarVM* vm, int slot, const char* name);
+JSTAR_API bool jsrCheckTypedArray(JStarVM* vm, int slot, const char* name);
 
 // Utility macro for checking a value type in the stack.
 // In case of error it exits signaling the error
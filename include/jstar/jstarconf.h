@@ -21,6 +21,7 @@
 /* #undef JSTAR_DBG_PRINT_EXEC */
 /* #undef JSTAR_DBG_PRINT_GC */
 /* #undef JSTAR_DBG_STRESS_GC */
+/* #undef JSTAR_DBG_GC_PAUSES */
 
 #define JSTAR_SYS
 #define JSTAR_IO
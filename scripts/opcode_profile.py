@@ -0,0 +1,56 @@
+#!/usr/bin/env python
+
+# Counts the most frequent sequences of executed opcodes in execution traces.
+# A trace is the output of a J* build configured with JSTAR_DBG_PRINT_EXEC, for example:
+#   jstar bench/nbody.jsr > nbody.trace
+#   python scripts/opcode_profile.py -n 3 nbody.trace sieve.trace
+# When more than one trace is given each one weights the same in the result, so that the
+# programs executing the most instructions don't hide the sequences frequent in the others.
+
+import re
+import sys
+from argparse import ArgumentParser
+from collections import Counter, deque
+
+argparser = ArgumentParser()
+argparser.add_argument("traces", nargs="*", help="Trace files to read, defaults to stdin")
+argparser.add_argument("-n", type=int, default=2, help="Length of the opcode sequences to count")
+argparser.add_argument("-t", "--top", type=int, default=20, help="Number of sequences to print")
+
+args = argparser.parse_args()
+
+# Disassembled instructions look like `0012 OP_GET_LOCAL 1`
+instr = re.compile(r"^\s*\d{4} (OP_\w+)")
+
+
+def profile(f):
+    total = 0
+    window = deque(maxlen=args.n)
+    counts = Counter()
+    for line in f:
+        m = instr.match(line)
+        if not m:
+            continue
+        total += 1
+        window.append(m.group(1))
+        if len(window) == args.n:
+            counts[tuple(window)] += 1
+    return total, counts
+
+
+profiles = []
+if args.traces:
+    for trace in args.traces:
+        with open(trace) as f:
+            profiles.append(profile(f))
+else:
+    profiles.append(profile(sys.stdin))
+
+frequencies = Counter()
+for total, counts in profiles:
+    for seq, count in counts.items():
+        frequencies[seq] += 100.0 * count / max(total, 1) / len(profiles)
+
+print("{} instructions executed".format(sum(total for total, _ in profiles)))
+for seq, freq in frequencies.most_common(args.top):
+    print("{:6.2f}%  {}".format(freq, " ".join(seq)))
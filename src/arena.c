@@ -0,0 +1,233 @@
+#include "arena.h"
+
+#include <string.h>
+
+#include "util.h"
+
+// Let AddressSanitizer catch accesses to the cells that are not allocated
+#if defined(__SANITIZE_ADDRESS__)
+    #define ARENA_ASAN
+#elif defined(__has_feature)
+    #if __has_feature(address_sanitizer)
+        #define ARENA_ASAN
+    #endif
+#endif
+
+#ifdef ARENA_ASAN
+    #include <sanitizer/asan_interface.h>
+    #define POISON(ptr, size)   ASAN_POISON_MEMORY_REGION(ptr, size)
+    #define UNPOISON(ptr, size) ASAN_UNPOISON_MEMORY_REGION(ptr, size)
+#else
+    #define POISON(ptr, size)   ((void)0)
+    #define UNPOISON(ptr, size) ((void)0)
+#endif
+
+#define CHUNKS_DEFAULT_SZ 8
+#define CHUNKS_GROW_RATE  2
+
+// One more page is allocated in order to align the pages to their size
+#define CHUNK_SZ ((ARENA_CHUNK_PAGES + 1) * ARENA_PAGE_SIZE)
+
+// The header is rounded up to keep the cells aligned to the granule
+#define PAGE_HEADER_SZ (((sizeof(ArenaPage) + ARENA_GRANULE - 1) / ARENA_GRANULE) * ARENA_GRANULE)
+
+static uint32_t sizeClass(size_t size) {
+    return (size - 1) / ARENA_GRANULE;
+}
+
+static size_t cellSize(uint32_t sizeClass) {
+    return (sizeClass + 1) * ARENA_GRANULE;
+}
+
+void initArena(Arena* a, JStarReallocCB allocator, void* allocatorData) {
+    *a = (Arena){0};
+    a->allocator = allocator;
+    a->allocatorData = allocatorData;
+}
+
+static void* allocate(Arena* a, void* ptr, size_t oldSize, size_t size) {
+    return a->allocator(ptr, oldSize, size, a->allocatorData);
+}
+
+void freeArena(Arena* a) {
+    for(size_t i = 0; i < a->chunkCount; i++) {
+        UNPOISON(a->chunks[i], CHUNK_SZ);
+        allocate(a, a->chunks[i], CHUNK_SZ, 0);
+    }
+    if(a->chunks != NULL) allocate(a, a->chunks, sizeof(void*) * a->chunkCapacity, 0);
+    initArena(a, a->allocator, a->allocatorData);
+}
+
+// Returns the first page of a chunk
+static char* chunkPages(void* chunk) {
+    uintptr_t start = ((uintptr_t)chunk + ARENA_PAGE_SIZE - 1) & ~(uintptr_t)(ARENA_PAGE_SIZE - 1);
+    return (char*)start;
+}
+
+static bool allocateChunk(Arena* a) {
+    if(a->chunkCount + 1 > a->chunkCapacity) {
+        size_t newCap = a->chunkCapacity ? a->chunkCapacity * CHUNKS_GROW_RATE : CHUNKS_DEFAULT_SZ;
+        void** chunks = allocate(a, a->chunks, sizeof(void*) * a->chunkCapacity,
+                                 sizeof(void*) * newCap);
+        if(chunks == NULL) return false;
+        a->chunks = chunks;
+        a->chunkCapacity = newCap;
+    }
+
+    char* chunk = allocate(a, NULL, 0, CHUNK_SZ);
+    if(chunk == NULL) return false;
+    a->chunks[a->chunkCount++] = chunk;
+
+    char* pages = chunkPages(chunk);
+    for(int i = ARENA_CHUNK_PAGES - 1; i >= 0; i--) {
+        ArenaPage* page = (ArenaPage*)(pages + (size_t)i * ARENA_PAGE_SIZE);
+        memset(page, 0, PAGE_HEADER_SZ);
+        POISON((char*)page + PAGE_HEADER_SZ, ARENA_PAGE_SIZE - PAGE_HEADER_SZ);
+        page->next = a->freePages;
+        a->freePages = page;
+    }
+
+    return true;
+}
+
+static ArenaPage* newPage(Arena* a, uint32_t sizeClass) {
+    if(a->freePages == NULL && !allocateChunk(a)) {
+        return NULL;
+    }
+
+    ArenaPage* page = a->freePages;
+    a->freePages = page->next;
+    page->prev = page->next = NULL;
+    page->freeList = NULL;
+    page->top = (char*)page + PAGE_HEADER_SZ;
+    page->sizeClass = sizeClass;
+    page->used = 0;
+    return page;
+}
+
+static void pushPage(ArenaPage** list, ArenaPage* page) {
+    page->prev = NULL;
+    page->next = *list;
+    if(*list != NULL) (*list)->prev = page;
+    *list = page;
+}
+
+static void unlinkPage(ArenaPage** list, ArenaPage* page) {
+    if(page->prev != NULL) {
+        page->prev->next = page->next;
+    } else {
+        *list = page->next;
+    }
+    if(page->next != NULL) page->next->prev = page->prev;
+}
+
+static bool isPageFull(ArenaPage* page) {
+    return page->freeList == NULL &&
+           page->top + cellSize(page->sizeClass) > (char*)page + ARENA_PAGE_SIZE;
+}
+
+void* arenaAlloc(Arena* a, size_t size) {
+    ASSERT(size > 0, "Cannot allocate an empty block");
+    if(size > ARENA_MAX_SIZE) {
+        return allocate(a, NULL, 0, size);
+    }
+
+    uint32_t cls = sizeClass(size);
+    SizeClass* sc = &a->classes[cls];
+
+    ArenaPage* page = sc->available;
+    if(page == NULL) {
+        page = newPage(a, cls);
+        if(page == NULL) return NULL;
+        pushPage(&sc->available, page);
+    }
+
+    size_t cellSz = cellSize(cls);
+    ArenaCell* cell;
+    if(page->freeList != NULL) {
+        cell = page->freeList;
+        UNPOISON(cell, cellSz);
+        page->freeList = cell->next;
+    } else {
+        cell = (ArenaCell*)page->top;
+        UNPOISON(cell, cellSz);
+        page->top += cellSz;
+    }
+    page->used++;
+
+    if(isPageFull(page)) {
+        unlinkPage(&sc->available, page);
+        pushPage(&sc->full, page);
+    }
+
+    return cell;
+}
+
+void arenaFree(Arena* a, void* ptr, size_t size) {
+    if(ptr == NULL) return;
+    if(size > ARENA_MAX_SIZE) {
+        allocate(a, ptr, size, 0);
+        return;
+    }
+
+    ArenaPage* page = ARENA_PAGE_OF(ptr);
+    uint32_t cls = sizeClass(size);
+    SizeClass* sc = &a->classes[cls];
+    ASSERT(page->sizeClass == cls, "Block freed with the wrong size");
+
+    if(isPageFull(page)) {
+        unlinkPage(&sc->full, page);
+        pushPage(&sc->available, page);
+    }
+
+    ArenaCell* cell = ptr;
+    cell->next = page->freeList;
+    page->freeList = cell;
+    POISON(cell, cellSize(cls));
+
+    // Give empty pages back, so that they can be reused by other size classes. The last page
+    // of the size class is kept to avoid repeatedly taking and releasing it
+    if(--page->used == 0 && (page->prev != NULL || page->next != NULL)) {
+        unlinkPage(&sc->available, page);
+        page->next = a->freePages;
+        a->freePages = page;
+    }
+}
+
+void* arenaRealloc(Arena* a, void* ptr, size_t oldSize, size_t size) {
+    if(size == 0) {
+        arenaFree(a, ptr, oldSize);
+        return NULL;
+    }
+
+    if(ptr == NULL) {
+        return arenaAlloc(a, size);
+    }
+
+    if(oldSize > ARENA_MAX_SIZE && size > ARENA_MAX_SIZE) {
+        return allocate(a, ptr, oldSize, size);
+    }
+
+    bool small = oldSize <= ARENA_MAX_SIZE && size <= ARENA_MAX_SIZE;
+    if(small && sizeClass(oldSize) == sizeClass(size)) {
+        return ptr;
+    }
+
+    void* mem = arenaAlloc(a, size);
+    if(mem == NULL) return NULL;
+    memcpy(mem, ptr, oldSize < size ? oldSize : size);
+    arenaFree(a, ptr, oldSize);
+    return mem;
+}
+
+size_t arenaPageCount(Arena* a) {
+    return a->chunkCount * ARENA_CHUNK_PAGES;
+}
+
+ArenaPage* arenaGetPage(Arena* a, size_t i) {
+    char* pages = chunkPages(a->chunks[i / ARENA_CHUNK_PAGES]);
+    return (ArenaPage*)(pages + (i % ARENA_CHUNK_PAGES) * ARENA_PAGE_SIZE);
+}
+
+extern inline bool arenaTestBit(const uint64_t* bitmap, size_t bit);
+extern inline void arenaSetBit(uint64_t* bitmap, size_t bit);
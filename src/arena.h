@@ -0,0 +1,86 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "jstar.h"
+
+// Size-segregated allocator for the small blocks of memory of the VM (objects, strings, small
+// arrays). Blocks up to ARENA_MAX_SIZE bytes are rounded up to a size class and carved out of
+// pages dedicated to that size class, larger ones are allocated directly with the allocation
+// callback of the VM, that also provides the memory of the pages.
+// Pages are aligned to their size, so that the page of a block can be found from its address.
+// Every page also has bitmaps with a bit per granule, used by the garbage collector to keep track
+// of the objects allocated in the page, and of their state, without touching their memory.
+
+#define ARENA_GRANULE     16                                      // Granularity of the size classes
+#define ARENA_MAX_SIZE    256                                     // Max size of a block in a page
+#define ARENA_CLASSES     (ARENA_MAX_SIZE / ARENA_GRANULE)        // Number of size classes
+#define ARENA_PAGE_SIZE   (1024 * 16)                             // 16KiB - Size of a page
+#define ARENA_CHUNK_PAGES 32                                      // Pages allocated at once
+#define ARENA_BITMAP_SZ   (ARENA_PAGE_SIZE / ARENA_GRANULE / 64)  // Words of a page bitmap
+
+// Returns the page of a block allocated in the arena
+#define ARENA_PAGE_OF(ptr) ((ArenaPage*)((uintptr_t)(ptr) & ~(uintptr_t)(ARENA_PAGE_SIZE - 1)))
+// Returns the index of the bit of a block in the bitmaps of its page
+#define ARENA_BIT_OF(ptr)  (((uintptr_t)(ptr) & (ARENA_PAGE_SIZE - 1)) / ARENA_GRANULE)
+
+typedef struct ArenaCell {
+    struct ArenaCell* next;
+} ArenaCell;
+
+// A page of cells of the same size class
+typedef struct ArenaPage {
+    struct ArenaPage *prev, *next;      // Links in the list of pages of the size class
+    ArenaCell* freeList;                // Freed cells of the page
+    char* top;                          // First cell of the page that has never been allocated
+    uint32_t sizeClass;                 // The size class of the cells
+    uint32_t used;                      // Number of allocated cells
+    bool inNursery;                     // Whether the page holds objects of the nursery
+    uint64_t old[ARENA_BITMAP_SZ];      // Objects of the old generation
+    uint64_t young[ARENA_BITMAP_SZ];    // Objects allocated since the last collection
+    uint64_t marks[ARENA_BITMAP_SZ];    // Objects marked by the garbage collector
+} ArenaPage;
+
+typedef struct SizeClass {
+    ArenaPage* available;  // Pages with free cells
+    ArenaPage* full;       // Pages without free cells
+} SizeClass;
+
+typedef struct Arena {
+    JStarReallocCB allocator;  // Callback used to allocate the memory of the arena
+    void* allocatorData;       // Custom data passed to the callback
+    SizeClass classes[ARENA_CLASSES];
+    ArenaPage* freePages;  // Pages not in use by any size class
+    void** chunks;         // Blocks of memory pages are carved from
+    size_t chunkCount, chunkCapacity;
+} Arena;
+
+// Initialize the arena, that will get its memory from `allocator`
+void initArena(Arena* a, JStarReallocCB allocator, void* allocatorData);
+// Free all the memory of the arena, including the blocks still allocated
+void freeArena(Arena* a);
+// Allocates a block of `size` bytes. Returns NULL if out of memory
+void* arenaAlloc(Arena* a, size_t size);
+// Frees a block of `size` bytes. `size` must be the one the block has been allocated with
+void arenaFree(Arena* a, void* ptr, size_t size);
+// Resizes a block with realloc semantics. Returns NULL if out of memory or if `size` is 0
+void* arenaRealloc(Arena* a, void* ptr, size_t oldSize, size_t size);
+
+// Returns the number of pages of the arena, including the ones not in use
+size_t arenaPageCount(Arena* a);
+// Returns the page at index `i`. Pages keep their index until the arena is freed
+ArenaPage* arenaGetPage(Arena* a, size_t i);
+
+// Test and set the bits of a page bitmap
+inline bool arenaTestBit(const uint64_t* bitmap, size_t bit) {
+    return (bitmap[bit / 64] >> (bit % 64)) & 1;
+}
+
+inline void arenaSetBit(uint64_t* bitmap, size_t bit) {
+    bitmap[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
+
+#endif
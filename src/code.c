@@ -2,6 +2,7 @@
 
 #include <stdbool.h>
 
+#include "gc.h"
 #include "util.h"
 
 #define CODE_DEF_SIZE  8
@@ -12,35 +13,46 @@ void initCode(Code* c) {
     initValueArray(&c->consts);
 }
 
-void freeCode(Code* c) {
-    free(c->bytecode);
-    free(c->lines);
-    freeValueArray(&c->consts);
+void freeCode(JStarVM* vm, Code* c) {
+    gcAllocInternal(vm, MEM_CODE, c->bytecode, c->capacity * sizeof(uint8_t), 0);
+    gcAllocInternal(vm, MEM_CODE, c->lines, c->lineCapacity * sizeof(int), 0);
+    for(size_t i = 0; i < c->symbolCount; i++) {
+        if(c->symbols[i].polyCache != NULL) {
+            gcAllocInternal(vm, MEM_CODE, c->symbols[i].polyCache,
+                            (POLY_CACHE_SIZE - 1) * sizeof(SymbolCache), 0);
+        }
+    }
+    gcAllocInternal(vm, MEM_CODE, c->symbols, c->symbolCapacity * sizeof(Symbol), 0);
+    freeValueArray(vm, &c->consts);
 }
 
-static void growCode(Code* c) {
-    c->capacity = c->capacity ? c->capacity * CODE_GROW_FACT : CODE_DEF_SIZE;
-    c->bytecode = realloc(c->bytecode, c->capacity * sizeof(uint8_t));
+static void growCode(JStarVM* vm, Code* c) {
+    size_t oldCap = c->capacity;
+    c->capacity = oldCap ? oldCap * CODE_GROW_FACT : CODE_DEF_SIZE;
+    c->bytecode = gcAllocInternal(vm, MEM_CODE, c->bytecode, oldCap * sizeof(uint8_t),
+                                  c->capacity * sizeof(uint8_t));
 }
 
-static void growLines(Code* c) {
-    c->lineCapacity = c->lineCapacity ? c->lineCapacity * CODE_GROW_FACT : CODE_DEF_SIZE;
-    c->lines = realloc(c->lines, c->lineCapacity * sizeof(int));
+static void growLines(JStarVM* vm, Code* c) {
+    size_t oldCap = c->lineCapacity;
+    c->lineCapacity = oldCap ? oldCap * CODE_GROW_FACT : CODE_DEF_SIZE;
+    c->lines = gcAllocInternal(vm, MEM_CODE, c->lines, oldCap * sizeof(int),
+                               c->lineCapacity * sizeof(int));
 }
 
 static bool shouldGrow(const Code* c) {
     return c->size + 1 > c->capacity;
 }
 
-static void ensureCapacity(Code* c) {
+static void ensureCapacity(JStarVM* vm, Code* c) {
     if(shouldGrow(c)) {
-        growCode(c);
-        growLines(c);
+        growCode(vm, c);
+        growLines(vm, c);
     }
 }
 
-size_t writeByte(Code* c, uint8_t b, int line) {
-    ensureCapacity(c);
+size_t writeByte(JStarVM* vm, Code* c, uint8_t b, int line) {
+    ensureCapacity(vm, c);
     c->bytecode[c->size] = b;
     c->lines[c->lineSize++] = line;
     return c->size++;
@@ -52,7 +64,7 @@ int getBytecodeSrcLine(Code* c, size_t index) {
     return c->lines[index];
 }
 
-int addConstant(Code* c, Value constant) {
+int addConstant(JStarVM* vm, Code* c, Value constant) {
     ValueArray* consts = &c->consts;
     if(consts->size == UINT16_MAX) return -1;
 
@@ -62,5 +74,19 @@ int addConstant(Code* c, Value constant) {
         }
     }
 
-    return valueArrayAppend(&c->consts, constant);
+    return valueArrayAppend(vm, &c->consts, constant);
+}
+
+int addSymbol(JStarVM* vm, Code* c, uint16_t constant) {
+    if(c->symbolCount == UINT16_MAX) return -1;
+
+    if(c->symbolCount + 1 > c->symbolCapacity) {
+        size_t oldCap = c->symbolCapacity;
+        c->symbolCapacity = oldCap ? oldCap * CODE_GROW_FACT : CODE_DEF_SIZE;
+        c->symbols = gcAllocInternal(vm, MEM_CODE, c->symbols, oldCap * sizeof(Symbol),
+                                     c->symbolCapacity * sizeof(Symbol));
+    }
+
+    c->symbols[c->symbolCount] = (Symbol){constant, false, {NULL, 0, {NULL}}, NULL};
+    return c->symbolCount++;
 }
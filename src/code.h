@@ -1,24 +1,56 @@
 #ifndef CHUNK_H
 #define CHUNK_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 
 #include "value.h"
 
+// Inline cache attached to a Symbol. It memoizes the result of the last name resolution
+// performed by the instruction, so that subsequent executions can skip the lookup as long
+// as `key` and `version` still match
+typedef struct SymbolCache {
+    Obj* key;        // The object on which the name was resolved (NULL if the cache is empty)
+    size_t version;  // The version of `key` at the time the cache was filled
+    union {
+        Value* value;   // Pointer to the resolved value (module globals)
+        size_t offset;  // Index of the resolved field (instance fields, `key` is the shape)
+        Obj* method;    // The resolved method (method invocations, `key` is the class)
+    } as;
+} SymbolCache;
+
+// Max number of different keys a polymorphic inline cache can hold
+#define POLY_CACHE_SIZE 4
+
+// A reference to a name in the constant pool made by an instruction.
+// Every instruction referencing a Symbol gets its own, so that it also gets its own cache.
+// Instructions that can see different keys (e.g. method invocations on different classes)
+// can make the cache polymorphic by allocating the additional `polyCache` entries, and
+// mark it as megamorphic once all of them are in use
+typedef struct Symbol {
+    uint16_t constant;       // Index of the name in the constant pool
+    bool megamorphic;        // Whether the instruction has seen too many keys to be cached
+    SymbolCache cache;       // Inline cache for the name resolution
+    SymbolCache* polyCache;  // POLY_CACHE_SIZE - 1 additional cache entries (or NULL)
+} Symbol;
+
 typedef struct Code {
     size_t capacity, size;
     uint8_t* bytecode;
     size_t lineCapacity, lineSize;
     int* lines;
     ValueArray consts;
+    size_t symbolCapacity, symbolCount;
+    Symbol* symbols;
 } Code;
 
 void initCode(Code* c);
-void freeCode(Code* c);
+void freeCode(JStarVM* vm, Code* c);
 
-size_t writeByte(Code* c, uint8_t b, int line);
-int addConstant(Code* c, Value constant);
+size_t writeByte(JStarVM* vm, Code* c, uint8_t b, int line);
+int addConstant(JStarVM* vm, Code* c, Value constant);
+int addSymbol(JStarVM* vm, Code* c, uint16_t constant);
 int getBytecodeSrcLine(Code* c, size_t index);
 
 #endif
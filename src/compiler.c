@@ -1,9 +1,11 @@
 #include "compiler.h"
 
+#include <math.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "code.h"
@@ -30,6 +32,15 @@
 #define CONTINUE_MARK 1
 #define BREAK_MARK    2
 
+// Marks the absence of an instruction that can be fused with the next one (see `emitOpcode`)
+#define NO_INSTR SIZE_MAX
+
+// Marks the end of a list of jumps to be patched (see `emitJumpList`)
+#define NO_JUMP SIZE_MAX
+
+// Max number of jumps followed when threading a jump to its final destination
+#define MAX_JUMP_HOPS 8
+
 typedef struct Variable {
     enum { VAR_LOCAL, VAR_GLOBAL, VAR_ERR } scope;
     union {
@@ -81,6 +92,7 @@ struct Compiler {
     Compiler* prev;
 
     Loop* loops;
+    size_t lastInstr;
 
     FuncType type;
     ObjFunction* func;
@@ -90,7 +102,7 @@ struct Compiler {
     Local locals[MAX_LOCALS];
     Upvalue upvalues[MAX_LOCALS];
 
-    int tryDepth;
+    int tryDepth, maxTryDepth;
     TryExcept* tryBlocks;
 
     bool hadError;
@@ -107,7 +119,9 @@ static void initCompiler(Compiler* c, JStarVM* vm, const char* file, Compiler* p
     c->depth = 0;
     c->localsCount = 0;
     c->loops = NULL;
+    c->lastInstr = NO_INSTR;
     c->tryDepth = 0;
+    c->maxTryDepth = 0;
     c->tryBlocks = NULL;
     c->hadError = false;
     jsrBufferInit(vm, &c->stringBuf);
@@ -147,7 +161,7 @@ static size_t emitBytecode(Compiler* c, uint8_t b, int line) {
     if(line == 0 && c->func->code.lineSize > 0) {
         line = c->func->code.lines[c->func->code.lineSize - 1];
     }
-    return writeByte(&c->func->code, b, line);
+    return writeByte(c->vm, &c->func->code, b, line);
 }
 
 static size_t emitShort(Compiler* c, uint16_t s, int line) {
@@ -156,10 +170,53 @@ static size_t emitShort(Compiler* c, uint16_t s, int line) {
     return addr;
 }
 
+// The returned address could be used as a jump target, so the next instruction emitted will
+// never be fused with the previous one. This way jumps never land inside a superinstruction
 static size_t getCurrentAddr(Compiler* c) {
+    c->lastInstr = NO_INSTR;
     return c->func->code.size;
 }
 
+// Returns the superinstruction that executes `prev` followed by `op`, or OP_END if there is
+// none. The fused pairs are the most frequent ones in a profile of the programs in bench/
+// (see scripts/opcode_profile.py)
+static Opcode superinstruction(Opcode prev, Opcode op) {
+    switch(prev) {
+    case OP_GET_LOCAL:
+        switch(op) {
+        case OP_GET_LOCAL:
+            return OP_GET_LOCALS;
+        case OP_GET_CONST:
+            return OP_GET_LOCAL_CONST;
+        case OP_GET_FIELD:
+            return OP_GET_LOCAL_FIELD;
+        default:
+            return OP_END;
+        }
+    case OP_SET_LOCAL:
+        return op == OP_POP ? OP_SET_LOCAL_POP : OP_END;
+    default:
+        return OP_END;
+    }
+}
+
+// Emits the opcode `op`, whose arguments are then emitted as usual. If the last instruction
+// emitted with this function immediately precedes `op` and forms a superinstruction with it,
+// that instruction is turned into the superinstruction and the arguments of `op` follow its own
+static void emitOpcode(Compiler* c, Opcode op, int line) {
+    Code* code = &c->func->code;
+    size_t last = c->lastInstr;
+    if(last != NO_INSTR && last + opcodeArgsNumber(code->bytecode[last]) + 1 == code->size) {
+        Opcode fused = superinstruction(code->bytecode[last], op);
+        if(fused != OP_END) {
+            code->bytecode[last] = fused;
+            c->lastInstr = NO_INSTR;
+            return;
+        }
+    }
+    c->lastInstr = emitBytecode(c, op, line);
+}
+
 static bool inGlobalScope(Compiler* c) {
     return c->depth == 0;
 }
@@ -217,9 +274,9 @@ static void exitFunctionScope(Compiler* c) {
 }
 
 static uint16_t createConst(Compiler* c, Value constant, int line) {
-    int index = addConstant(&c->func->code, constant);
+    int index = addConstant(c->vm, &c->func->code, constant);
     if(index == -1) {
-        error(c, line, "Too many constants in function %s", c->func->c.name->data);
+        error(c, line, "Too many constants in function %s", stringData(c->func->c.name));
         return 0;
     }
     return (uint16_t)index;
@@ -238,9 +295,22 @@ static uint16_t identifierConst(Compiler* c, JStarIdentifier* id, int line) {
     return stringConst(c, id->name, id->length, line);
 }
 
+static uint16_t createSymbol(Compiler* c, uint16_t constant, int line) {
+    int index = addSymbol(c->vm, &c->func->code, constant);
+    if(index == -1) {
+        error(c, line, "Too many symbols in function %s", stringData(c->func->c.name));
+        return 0;
+    }
+    return (uint16_t)index;
+}
+
+static uint16_t identifierSymbol(Compiler* c, JStarIdentifier* id, int line) {
+    return createSymbol(c, identifierConst(c, id, line), line);
+}
+
 static int addLocal(Compiler* c, JStarIdentifier* id, int line) {
     if(c->localsCount == MAX_LOCALS) {
-        error(c, line, "Too many local variables in function %s", c->func->c.name->data);
+        error(c, line, "Too many local variables in function %s", stringData(c->func->c.name));
         return -1;
     }
 
@@ -276,7 +346,7 @@ static int addUpvalue(Compiler* c, uint8_t index, bool local, int line) {
     }
 
     if(c->func->upvalueCount == MAX_LOCALS) {
-        error(c, line, "Too many upvalues in function %s", c->func->c.name->data);
+        error(c, line, "Too many upvalues in function %s", stringData(c->func->c.name));
         return -1;
     }
 
@@ -388,6 +458,30 @@ static void setJumpTo(Compiler* c, size_t jumpAddr, size_t target, int line) {
     code->bytecode[jumpAddr + 2] = ((uint16_t)offset) & 0xff;
 }
 
+// Emits a jump whose destination is not yet known, appending it to the list `jumps`.
+// The jumps of a list are chained through their offset operand, which holds the distance
+// from the previous jump of the list (or 0 for the first one) until they are patched
+static size_t emitJumpList(Compiler* c, Opcode jmpOp, size_t jumps, int line) {
+    size_t jmpAddr = getCurrentAddr(c);
+    size_t dist = jumps == NO_JUMP ? 0 : jmpAddr - jumps;
+    if(dist > UINT16_MAX) {
+        error(c, line, "Too much code to jump over");
+    }
+
+    emitBytecode(c, jmpOp, line);
+    emitShort(c, (uint16_t)dist, line);
+    return jmpAddr;
+}
+
+static void patchJumpList(Compiler* c, size_t jumps, size_t target, int line) {
+    Code* code = &c->func->code;
+    while(jumps != NO_JUMP) {
+        uint16_t dist = ((uint16_t)code->bytecode[jumps + 1] << 8) | code->bytecode[jumps + 2];
+        setJumpTo(c, jumps, target, line);
+        jumps = dist == 0 ? NO_JUMP : jumps - dist;
+    }
+}
+
 static void startLoop(Compiler* c, Loop* loop) {
     loop->depth = c->depth;
     loop->start = getCurrentAddr(c);
@@ -422,7 +516,7 @@ static void emitMethodCall(Compiler* c, const char* name, int args) {
     ASSERT(args <= MAX_INLINE_ARGS, "Too many arguments for inline call");
     JStarIdentifier meth = createIdentifier(name);
     emitBytecode(c, OP_INVOKE_0 + args, 0);
-    emitShort(c, identifierConst(c, &meth, 0), 0);
+    emitShort(c, identifierSymbol(c, &meth, 0), 0);
 }
 
 static void enterTryBlock(Compiler* c, TryExcept* exc, int numHandlers, int line) {
@@ -432,6 +526,10 @@ static void enterTryBlock(Compiler* c, TryExcept* exc, int numHandlers, int line
     c->tryBlocks = exc;
     c->tryDepth += numHandlers;
 
+    if(c->tryDepth > c->maxTryDepth) {
+        c->maxTryDepth = c->tryDepth;
+    }
+
     if(c->tryDepth > MAX_TRY_DEPTH) {
         error(c, line, "Exceeded max number of nested exception handlers: max %d, got %d",
               MAX_TRY_DEPTH, c->tryDepth);
@@ -497,15 +595,431 @@ static void addFunctionDefaults(Compiler* c, FnCommon* fn, Vector* defaultArgs)
     }
 }
 
+// -----------------------------------------------------------------------------
+// STACK USAGE ANALYSIS
+// -----------------------------------------------------------------------------
+
+static size_t instructionSize(Code* code, size_t addr) {
+    Opcode op = code->bytecode[addr];
+    size_t size = opcodeArgsNumber(op) + 1;
+    if(op == OP_CLOSURE) {
+        uint16_t fnConst = ((uint16_t)code->bytecode[addr + 1] << 8) | code->bytecode[addr + 2];
+        size += AS_FUNC(code->consts.arr[fnConst])->upvalueCount * 2;
+    }
+    return size;
+}
+
+static int16_t jumpTarget(Code* code, size_t addr) {
+    return (int16_t)(((uint16_t)code->bytecode[addr + 1] << 8) | code->bytecode[addr + 2]);
+}
+
+// Net effect on the stack of the instructions that don't alter the control flow
+static int stackEffect(Code* code, size_t addr) {
+    Opcode op = code->bytecode[addr];
+    uint8_t arg = code->bytecode[addr + 1];
+
+    switch(op) {
+    case OP_CALL_0:
+    case OP_CALL_1:
+    case OP_CALL_2:
+    case OP_CALL_3:
+    case OP_CALL_4:
+    case OP_CALL_5:
+    case OP_CALL_6:
+    case OP_CALL_7:
+    case OP_CALL_8:
+    case OP_CALL_9:
+    case OP_CALL_10:
+        return -(op - OP_CALL_0);
+    case OP_INVOKE_0:
+    case OP_INVOKE_1:
+    case OP_INVOKE_2:
+    case OP_INVOKE_3:
+    case OP_INVOKE_4:
+    case OP_INVOKE_5:
+    case OP_INVOKE_6:
+    case OP_INVOKE_7:
+    case OP_INVOKE_8:
+    case OP_INVOKE_9:
+    case OP_INVOKE_10:
+        return -(op - OP_INVOKE_0);
+    case OP_SUPER_0:
+    case OP_SUPER_1:
+    case OP_SUPER_2:
+    case OP_SUPER_3:
+    case OP_SUPER_4:
+    case OP_SUPER_5:
+    case OP_SUPER_6:
+    case OP_SUPER_7:
+    case OP_SUPER_8:
+    case OP_SUPER_9:
+    case OP_SUPER_10:
+        return -(op - OP_SUPER_0);
+    // Unpacked arguments are pushed by `unpackCall`, that reserves the needed stack by itself
+    case OP_CALL:
+    case OP_CALL_UNPACK:
+    case OP_INVOKE:
+    case OP_INVOKE_UNPACK:
+    case OP_SUPER:
+    case OP_SUPER_UNPACK:
+    case OP_POPN:
+        return -arg;
+    case OP_NEW_TUPLE:
+        return 1 - arg;
+    case OP_UNPACK:
+        return arg - 1;
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+    case OP_MOD:
+    case OP_BAND:
+    case OP_BOR:
+    case OP_XOR:
+    case OP_LSHIFT:
+    case OP_RSHIFT:
+    case OP_EQ:
+    case OP_GT:
+    case OP_GE:
+    case OP_LT:
+    case OP_LE:
+    case OP_IS:
+    case OP_POW:
+    case OP_ADD_NUM:
+    case OP_ADD_STR:
+    case OP_SUB_NUM:
+    case OP_MUL_NUM:
+    case OP_DIV_NUM:
+    case OP_LT_NUM:
+    case OP_LE_NUM:
+    case OP_GT_NUM:
+    case OP_GE_NUM:
+    case OP_SET_FIELD:
+    case OP_SUBSCR_GET:
+    case OP_SUBSCR_GET_LIST:
+    case OP_APPEND_LIST:
+    case OP_DEF_METHOD:
+    case OP_DEFINE_GLOBAL:
+    case OP_POP:
+    case OP_SET_LOCAL_POP:
+    case OP_CLOSE_UPVALUE:
+        return -1;
+    case OP_SUBSCR_SET:
+        return -2;
+    case OP_NEG:
+    case OP_INVERT:
+    case OP_NOT:
+    case OP_GET_FIELD:
+    case OP_SUPER_BIND:
+    case OP_NEW_SUBCLASS:
+    case OP_NAT_METHOD:
+    case OP_NATIVE:
+    case OP_SET_LOCAL:
+    case OP_SET_UPVALUE:
+    case OP_SET_GLOBAL:
+    case OP_END_HANDLER:
+    case OP_POP_HANDLER:
+        return 0;
+    case OP_IMPORT_FROM:
+    case OP_IMPORT_NAME:
+    case OP_NEW_LIST:
+    case OP_NEW_TABLE:
+    case OP_CLOSURE:
+    case OP_NEW_CLASS:
+    case OP_GET_CONST:
+    case OP_GET_LOCAL:
+    case OP_GET_UPVALUE:
+    case OP_GET_GLOBAL:
+    case OP_GET_LOCAL_FIELD:
+    case OP_NULL:
+    case OP_DUP:
+        return 1;
+    case OP_IMPORT:
+    case OP_FOR_PREP:
+    case OP_GET_LOCALS:
+    case OP_GET_LOCAL_CONST:
+        return 2;
+    default:
+        UNREACHABLE();
+        return 0;
+    }
+}
+
+static void addSuccessor(int* depths, size_t* worklist, size_t* count, size_t addr, int depth) {
+    if(depths[addr] != -1) {
+        ASSERT(depths[addr] == depth, "Inconsistent stack depth");
+        return;
+    }
+    depths[addr] = depth;
+    worklist[(*count)++] = addr;
+}
+
+// Computes the maximum number of stack slots used by the function on top of its arguments, by
+// walking all the paths of the bytecode and tracking the stack depth at every instruction.
+// It also accounts for the values pushed by the VM when entering exception handlers
+static int computeStackUsage(Code* code) {
+    if(code->size == 0) return 0;
+
+    int* depths = malloc(sizeof(int) * code->size);
+    size_t* worklist = malloc(sizeof(size_t) * code->size);
+    for(size_t i = 0; i < code->size; i++) {
+        depths[i] = -1;
+    }
+
+    size_t count = 0;
+    int maxDepth = 0;
+    addSuccessor(depths, worklist, &count, 0, 0);
+
+    while(count > 0) {
+        size_t addr = worklist[--count];
+        size_t next = addr + instructionSize(code, addr);
+        int depth = depths[addr];
+        int peak = depth;
+
+        switch(code->bytecode[addr]) {
+        case OP_RETURN:
+        case OP_RAISE:
+            break;
+        case OP_JUMP:
+            addSuccessor(depths, worklist, &count, next + jumpTarget(code, addr), depth);
+            break;
+        case OP_JUMPT:
+        case OP_JUMPF:
+            addSuccessor(depths, worklist, &count, next + jumpTarget(code, addr), depth - 1);
+            addSuccessor(depths, worklist, &count, next, depth - 1);
+            break;
+        case OP_SETUP_EXCEPT:
+        case OP_SETUP_ENSURE:
+            // On entering the handler the exception and the unwind cause are pushed
+            peak = depth + 2;
+            addSuccessor(depths, worklist, &count, next + jumpTarget(code, addr), depth + 2);
+            addSuccessor(depths, worklist, &count, next, depth);
+            break;
+        case OP_FOR_ITER:
+            // Pushes the iterable and iterator state before calling __iter__
+            peak = depth + 2;
+            addSuccessor(depths, worklist, &count, next, depth + 1);
+            break;
+        case OP_FOR_NEXT:
+            // Pops the result of __iter__ and pushes the arguments of __next__
+            peak = depth + 1;
+            addSuccessor(depths, worklist, &count, next + jumpTarget(code, addr), depth - 1);
+            addSuccessor(depths, worklist, &count, next, depth);
+            break;
+        default:
+            depth += stackEffect(code, addr);
+            peak = depth;
+            addSuccessor(depths, worklist, &count, next, depth);
+            break;
+        }
+
+        if(peak > maxDepth) maxDepth = peak;
+    }
+
+    free(depths);
+    free(worklist);
+    return maxDepth;
+}
+
+static void computeFrameSize(Compiler* c, int line) {
+    int stackSize = computeStackUsage(&c->func->code);
+    if(stackSize > UINT16_MAX) {
+        error(c, line, "Function requires too much stack space: max %d, got %d", UINT16_MAX,
+              stackSize);
+    }
+    c->func->stackSize = stackSize;
+    c->func->handlerCount = c->maxTryDepth;
+}
+
+// -----------------------------------------------------------------------------
+// OPTIMIZATIONS
+// -----------------------------------------------------------------------------
+
+static bool literalValue(JStarExpr* e, Value* val) {
+    switch(e->type) {
+    case JSR_NUMBER:
+        *val = NUM_VAL(e->as.num);
+        return true;
+    case JSR_BOOL:
+        *val = BOOL_VAL(e->as.boolean);
+        return true;
+    case JSR_NULL:
+        *val = NULL_VAL;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Evaluates a binary operation on literal operands, following the same semantics of the VM.
+// Returns false if the operation cannot be safely evaluated at compile time
+static bool foldBinary(JStarTokType op, Value a, Value b, Value* res) {
+    switch(op) {
+    case TOK_EQUAL_EQUAL:
+        *res = BOOL_VAL(valueEquals(a, b));
+        return true;
+    case TOK_BANG_EQ:
+        *res = BOOL_VAL(!valueEquals(a, b));
+        return true;
+    default:
+        break;
+    }
+
+    if(!IS_NUM(a) || !IS_NUM(b)) return false;
+    double x = AS_NUM(a), y = AS_NUM(b);
+
+    switch(op) {
+    case TOK_PLUS:
+        *res = NUM_VAL(x + y);
+        return true;
+    case TOK_MINUS:
+        *res = NUM_VAL(x - y);
+        return true;
+    case TOK_MULT:
+        *res = NUM_VAL(x * y);
+        return true;
+    case TOK_DIV:
+        *res = NUM_VAL(x / y);
+        return true;
+    case TOK_MOD:
+        *res = NUM_VAL(fmod(x, y));
+        return true;
+    case TOK_LT:
+        *res = BOOL_VAL(x < y);
+        return true;
+    case TOK_LE:
+        *res = BOOL_VAL(x <= y);
+        return true;
+    case TOK_GT:
+        *res = BOOL_VAL(x > y);
+        return true;
+    case TOK_GE:
+        *res = BOOL_VAL(x >= y);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool foldUnary(JStarTokType op, Value a, Value* res) {
+    switch(op) {
+    case TOK_MINUS:
+        if(!IS_NUM(a)) return false;
+        *res = NUM_VAL(-AS_NUM(a));
+        return true;
+    case TOK_BANG:
+        *res = BOOL_VAL(!valueToBool(a));
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Replaces the expression `e` in place with the literal `val`, freeing its operands
+static void replaceWithLiteral(JStarExpr* e, Value val) {
+    switch(e->type) {
+    case JSR_BINARY:
+        jsrExprFree(e->as.binary.left);
+        jsrExprFree(e->as.binary.right);
+        break;
+    case JSR_UNARY:
+        jsrExprFree(e->as.unary.operand);
+        break;
+    case JSR_POWER:
+        jsrExprFree(e->as.pow.base);
+        jsrExprFree(e->as.pow.exp);
+        break;
+    default:
+        UNREACHABLE();
+        break;
+    }
+
+    if(IS_NUM(val)) {
+        e->type = JSR_NUMBER;
+        e->as.num = AS_NUM(val);
+    } else {
+        ASSERT(IS_BOOL(val), "Folded expression must be a number or a boolean");
+        e->type = JSR_BOOL;
+        e->as.boolean = AS_BOOL(val);
+    }
+}
+
+// Recursively folds the arithmetic, comparison and unary operations whose operands are all
+// literals. Operations that could raise an exception or call an overload are left untouched
+static void foldConstExpr(JStarExpr* e) {
+    Value a, b, res;
+    switch(e->type) {
+    case JSR_BINARY:
+        foldConstExpr(e->as.binary.left);
+        foldConstExpr(e->as.binary.right);
+        if(literalValue(e->as.binary.left, &a) && literalValue(e->as.binary.right, &b) &&
+           foldBinary(e->as.binary.op, a, b, &res)) {
+            replaceWithLiteral(e, res);
+        }
+        break;
+    case JSR_UNARY:
+        foldConstExpr(e->as.unary.operand);
+        if(literalValue(e->as.unary.operand, &a) && foldUnary(e->as.unary.op, a, &res)) {
+            replaceWithLiteral(e, res);
+        }
+        break;
+    case JSR_POWER:
+        foldConstExpr(e->as.pow.base);
+        foldConstExpr(e->as.pow.exp);
+        if(literalValue(e->as.pow.base, &a) && literalValue(e->as.pow.exp, &b) && IS_NUM(a) &&
+           IS_NUM(b)) {
+            replaceWithLiteral(e, NUM_VAL(pow(AS_NUM(a), AS_NUM(b))));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Returns the address of the first instruction that is not an unconditional jump reached by
+// following the jump chain starting at `addr`
+static size_t jumpDestination(Code* code, size_t addr) {
+    for(int hops = 0; hops < MAX_JUMP_HOPS && code->bytecode[addr] == OP_JUMP; hops++) {
+        size_t dest = addr + instructionSize(code, addr) + jumpTarget(code, addr);
+        if(dest == addr) break;
+        addr = dest;
+    }
+    return addr;
+}
+
+// Retargets jumps to unconditional jumps so that they go straight to the final destination.
+// Conditional jumps are only retargeted forward, since backward jumps must always go through
+// an OP_JUMP, the only jump that checks for `evalBreak`
+static void threadJumps(Compiler* c) {
+    Code* code = &c->func->code;
+    for(size_t addr = 0; addr < code->size; addr += instructionSize(code, addr)) {
+        Opcode op = code->bytecode[addr];
+        if(op != OP_JUMP && op != OP_JUMPT && op != OP_JUMPF) continue;
+
+        size_t next = addr + instructionSize(code, addr);
+        size_t target = next + jumpTarget(code, addr);
+        size_t dest = jumpDestination(code, target);
+        if(dest == target) continue;
+
+        int32_t offset = (int32_t)dest - (int32_t)next;
+        if(offset > INT16_MAX || offset < INT16_MIN) continue;
+        if(op != OP_JUMP && offset < 0) continue;
+
+        code->bytecode[addr + 1] = ((uint16_t)offset >> 8) & 0xff;
+        code->bytecode[addr + 2] = ((uint16_t)offset) & 0xff;
+    }
+}
+
 // -----------------------------------------------------------------------------
 // EXPRESSION COMPILE
 // -----------------------------------------------------------------------------
 
 static void compileExpr(Compiler* c, JStarExpr* e);
+static void compileFoldedExpr(Compiler* c, JStarExpr* e);
 
 static void compileBinaryExpr(Compiler* c, JStarExpr* e) {
-    compileExpr(c, e->as.binary.left);
-    compileExpr(c, e->as.binary.right);
+    compileFoldedExpr(c, e->as.binary.left);
+    compileFoldedExpr(c, e->as.binary.right);
     switch(e->as.binary.op) {
     case TOK_PLUS:
         emitBytecode(c, OP_ADD, e->line);
@@ -566,7 +1080,7 @@ static void compileBinaryExpr(Compiler* c, JStarExpr* e) {
 }
 
 static void compileLogicExpr(Compiler* c, JStarExpr* e) {
-    compileExpr(c, e->as.binary.left);
+    compileFoldedExpr(c, e->as.binary.left);
     emitBytecode(c, OP_DUP, e->line);
 
     Opcode jmpOp = e->as.binary.op == TOK_AND ? OP_JUMPF : OP_JUMPT;
@@ -574,13 +1088,13 @@ static void compileLogicExpr(Compiler* c, JStarExpr* e) {
     emitShort(c, 0, 0);
 
     emitBytecode(c, OP_POP, e->line);
-    compileExpr(c, e->as.binary.right);
+    compileFoldedExpr(c, e->as.binary.right);
 
     setJumpTo(c, shortCircuit, getCurrentAddr(c), e->line);
 }
 
 static void compileUnaryExpr(Compiler* c, JStarExpr* e) {
-    compileExpr(c, e->as.unary.operand);
+    compileFoldedExpr(c, e->as.unary.operand);
     switch(e->as.unary.op) {
     case TOK_MINUS:
         emitBytecode(c, OP_NEG, e->line);
@@ -603,17 +1117,65 @@ static void compileUnaryExpr(Compiler* c, JStarExpr* e) {
     }
 }
 
-static void compileTernaryExpr(Compiler* c, JStarExpr* e) {
-    compileExpr(c, e->as.ternary.cond);
+// Like `compileCondJump`, but `e` must have already been folded
+static size_t compileFoldedCondJump(Compiler* c, JStarExpr* e, bool jumpIf, size_t jumps) {
+    if(c->vm->optimize) {
+        Value val;
+        if(literalValue(e, &val)) {
+            if(valueToBool(val) != jumpIf) return jumps;
+            return emitJumpList(c, OP_JUMP, jumps, e->line);
+        }
 
-    size_t falseJmp = emitBytecode(c, OP_JUMPF, e->line);
-    emitShort(c, 0, 0);
+        if(e->type == JSR_UNARY && e->as.unary.op == TOK_BANG) {
+            return compileFoldedCondJump(c, e->as.unary.operand, !jumpIf, jumps);
+        }
+
+        if(e->type == JSR_BINARY) {
+            JStarTokType op = e->as.binary.op;
+            if(op == TOK_AND || op == TOK_OR) {
+                // Short circuit: if `left` alone decides the condition jump straight to the
+                // destination, otherwise skip to `right` that always decides it
+                if((op == TOK_AND) == jumpIf) {
+                    size_t skip = compileFoldedCondJump(c, e->as.binary.left, !jumpIf, NO_JUMP);
+                    jumps = compileFoldedCondJump(c, e->as.binary.right, jumpIf, jumps);
+                    patchJumpList(c, skip, getCurrentAddr(c), e->line);
+                    return jumps;
+                }
+                jumps = compileFoldedCondJump(c, e->as.binary.left, jumpIf, jumps);
+                return compileFoldedCondJump(c, e->as.binary.right, jumpIf, jumps);
+            }
+            if(op == TOK_BANG_EQ) {
+                compileFoldedExpr(c, e->as.binary.left);
+                compileFoldedExpr(c, e->as.binary.right);
+                emitBytecode(c, OP_EQ, e->line);
+                return emitJumpList(c, jumpIf ? OP_JUMPF : OP_JUMPT, jumps, e->line);
+            }
+        }
+    }
+
+    compileFoldedExpr(c, e);
+    return emitJumpList(c, jumpIf ? OP_JUMPT : OP_JUMPF, jumps, e->line);
+}
+
+// Compiles `e` as the condition of a branch, emitting jumps that are taken when its truth
+// value equals `jumpIf`. The jumps are appended to the list `jumps` and the new list is
+// returned. When optimizing, negations, `!=` and logical operators are compiled directly
+// as control flow and constant conditions are resolved at compile time
+static size_t compileCondJump(Compiler* c, JStarExpr* e, bool jumpIf, size_t jumps) {
+    if(c->vm->optimize) {
+        foldConstExpr(e);
+    }
+    return compileFoldedCondJump(c, e, jumpIf, jumps);
+}
+
+static void compileTernaryExpr(Compiler* c, JStarExpr* e) {
+    size_t falseJmps = compileCondJump(c, e->as.ternary.cond, false, NO_JUMP);
 
     compileExpr(c, e->as.ternary.thenExpr);
     size_t exitJmp = emitBytecode(c, OP_JUMP, e->line);
     emitShort(c, 0, 0);
 
-    setJumpTo(c, falseJmp, getCurrentAddr(c), e->line);
+    patchJumpList(c, falseJmps, getCurrentAddr(c), e->line);
     compileExpr(c, e->as.ternary.elseExpr);
 
     setJumpTo(c, exitJmp, getCurrentAddr(c), e->line);
@@ -623,9 +1185,9 @@ static void compileVariable(Compiler* c, JStarIdentifier* id, bool set, int line
     int idx = resolveVariable(c, id, line);
     if(idx != -1) {
         if(set) {
-            emitBytecode(c, OP_SET_LOCAL, line);
+            emitOpcode(c, OP_SET_LOCAL, line);
         } else {
-            emitBytecode(c, OP_GET_LOCAL, line);
+            emitOpcode(c, OP_GET_LOCAL, line);
         }
         emitBytecode(c, idx, line);
     } else if((idx = resolveUpvalue(c, id, line)) != -1) {
@@ -641,7 +1203,7 @@ static void compileVariable(Compiler* c, JStarIdentifier* id, bool set, int line
         } else {
             emitBytecode(c, OP_GET_GLOBAL, line);
         }
-        emitShort(c, identifierConst(c, id, line), line);
+        emitShort(c, identifierSymbol(c, id, line), line);
     }
 }
 
@@ -669,7 +1231,7 @@ static void compileLval(Compiler* c, JStarExpr* e) {
     case JSR_ACCESS: {
         compileExpr(c, e->as.access.left);
         emitBytecode(c, OP_SET_FIELD, e->line);
-        emitShort(c, identifierConst(c, &e->as.access.id, e->line), e->line);
+        emitShort(c, identifierSymbol(c, &e->as.access.id, e->line), e->line);
         break;
     }
     case JSR_ARR_ACCESS: {
@@ -802,7 +1364,7 @@ static void finishCall(Compiler* c, Opcode callCode, Opcode callInline, Opcode c
     size_t argsCount = vecSize(&args->as.list);
     if(argsCount >= UINT8_MAX) {
         error(c, args->line, "Exceeded maximum number of arguments (%d) for function %s",
-              (int)UINT8_MAX, c->func->c.name->data);
+              (int)UINT8_MAX, stringData(c->func->c.name));
     }
 
     if(isUnpack) {
@@ -836,7 +1398,7 @@ static void compileCallExpr(Compiler* c, JStarExpr* e) {
     finishCall(c, callCode, callInline, callUnpack, e->as.call.args, e->as.call.unpackArg);
 
     if(isMethod) {
-        emitShort(c, identifierConst(c, &callee->as.access.id, e->line), e->line);
+        emitShort(c, identifierSymbol(c, &callee->as.access.id, e->line), e->line);
     }
 }
 
@@ -846,7 +1408,7 @@ static void compileSuper(Compiler* c, JStarExpr* e) {
         return;
     }
 
-    emitBytecode(c, OP_GET_LOCAL, e->line);
+    emitOpcode(c, OP_GET_LOCAL, e->line);
     emitBytecode(c, 0, e->line);
 
     uint16_t nameConst;
@@ -858,7 +1420,7 @@ static void compileSuper(Compiler* c, JStarExpr* e) {
 
     if(e->as.sup.args != NULL) {
         finishCall(c, OP_SUPER, OP_SUPER_0, OP_SUPER_UNPACK, e->as.sup.args, e->as.sup.unpackArg);
-        emitShort(c, nameConst, e->line);
+        emitShort(c, createSymbol(c, nameConst, e->line), e->line);
     } else {
         emitBytecode(c, OP_SUPER_BIND, e->line);
         emitShort(c, nameConst, e->line);
@@ -867,8 +1429,8 @@ static void compileSuper(Compiler* c, JStarExpr* e) {
 
 static void compileAccessExpression(Compiler* c, JStarExpr* e) {
     compileExpr(c, e->as.access.left);
-    emitBytecode(c, OP_GET_FIELD, e->line);
-    emitShort(c, identifierConst(c, &e->as.access.id, e->line), e->line);
+    emitOpcode(c, OP_GET_FIELD, e->line);
+    emitShort(c, identifierSymbol(c, &e->as.access.id, e->line), e->line);
 }
 
 static void compileArraryAccExpression(Compiler* c, JStarExpr* e) {
@@ -878,8 +1440,8 @@ static void compileArraryAccExpression(Compiler* c, JStarExpr* e) {
 }
 
 static void compilePowExpr(Compiler* c, JStarExpr* e) {
-    compileExpr(c, e->as.pow.base);
-    compileExpr(c, e->as.pow.exp);
+    compileFoldedExpr(c, e->as.pow.base);
+    compileFoldedExpr(c, e->as.pow.exp);
     emitBytecode(c, OP_POW, e->line);
 }
 
@@ -920,11 +1482,14 @@ static void compileTableLit(Compiler* c, JStarExpr* e) {
 }
 
 static void emitValueConst(Compiler* c, Value val, int line) {
-    emitBytecode(c, OP_GET_CONST, line);
+    emitOpcode(c, OP_GET_CONST, line);
     emitShort(c, createConst(c, val, line), line);
 }
 
-static void compileExpr(Compiler* c, JStarExpr* e) {
+// Compiles an expression whose constant operations have already been folded. `foldConstExpr`
+// folds the operands of an operator together with it, so they are compiled with this function
+// too. This way every operator tree is folded once, from its root
+static void compileFoldedExpr(Compiler* c, JStarExpr* e) {
     switch(e->type) {
     case JSR_BINARY:
         if(e->as.binary.op == TOK_AND || e->as.binary.op == TOK_OR) {
@@ -995,15 +1560,48 @@ static void compileExpr(Compiler* c, JStarExpr* e) {
     }
 }
 
+static void compileExpr(Compiler* c, JStarExpr* e) {
+    if(c->vm->optimize) {
+        foldConstExpr(e);
+    }
+    compileFoldedExpr(c, e);
+}
+
 // -----------------------------------------------------------------------------
 // STATEMENT COMPILE
 // -----------------------------------------------------------------------------
 
 static void compileStatement(Compiler* c, JStarStmt* s);
 
+static bool isTerminator(JStarStmt* s) {
+    switch(s->type) {
+    case JSR_RETURN:
+    case JSR_RAISE:
+    case JSR_BREAK:
+    case JSR_CONTINUE:
+        return true;
+    default:
+        return false;
+    }
+}
+
 static void compileStatements(Compiler* c, Vector* stmts) {
+    bool unreachable = false;
+    size_t deadCodeStart = 0;
+
     vecForeach(JStarStmt** it, *stmts) {
         compileStatement(c, *it);
+        if(!unreachable && isTerminator(*it)) {
+            unreachable = true;
+            deadCodeStart = getCurrentAddr(c);
+        }
+    }
+
+    // Statements following a return, raise, break or continue are unreachable. They are still
+    // compiled to report errors, but their code is discarded
+    if(c->vm->optimize && unreachable) {
+        c->func->code.size = deadCodeStart;
+        c->func->code.lineSize = deadCodeStart;
     }
 }
 
@@ -1025,10 +1623,7 @@ static void compileReturnStatement(Compiler* c, JStarStmt* s) {
 }
 
 static void compileIfStatement(Compiler* c, JStarStmt* s) {
-    compileExpr(c, s->as.ifStmt.cond);
-
-    size_t falseJmp = emitBytecode(c, OP_JUMPF, 0);
-    emitShort(c, 0, 0);
+    size_t falseJmps = compileCondJump(c, s->as.ifStmt.cond, false, NO_JUMP);
 
     compileStatement(c, s->as.ifStmt.thenStmt);
 
@@ -1038,7 +1633,7 @@ static void compileIfStatement(Compiler* c, JStarStmt* s) {
         emitShort(c, 0, 0);
     }
 
-    setJumpTo(c, falseJmp, getCurrentAddr(c), s->line);
+    patchJumpList(c, falseJmps, getCurrentAddr(c), s->line);
 
     if(s->as.ifStmt.elseStmt != NULL) {
         compileStatement(c, s->as.ifStmt.elseStmt);
@@ -1064,23 +1659,19 @@ static void compileForStatement(Compiler* c, JStarStmt* s) {
 
     if(s->as.forStmt.act != NULL) {
         compileExpr(c, s->as.forStmt.act);
-        emitBytecode(c, OP_POP, 0);
+        emitOpcode(c, OP_POP, 0);
         setJumpTo(c, firstJmp, getCurrentAddr(c), 0);
     }
 
-    size_t exitJmp = 0;
+    size_t exitJmps = NO_JUMP;
     if(s->as.forStmt.cond != NULL) {
-        compileExpr(c, s->as.forStmt.cond);
-        exitJmp = emitBytecode(c, OP_JUMPF, 0);
-        emitShort(c, 0, 0);
+        exitJmps = compileCondJump(c, s->as.forStmt.cond, false, NO_JUMP);
     }
 
     compileStatement(c, s->as.forStmt.body);
     emitJumpTo(c, OP_JUMP, l.start, s->line);
 
-    if(s->as.forStmt.cond != NULL) {
-        setJumpTo(c, exitJmp, getCurrentAddr(c), 0);
-    }
+    patchJumpList(c, exitJmps, getCurrentAddr(c), 0);
 
     endLoop(c);
     exitScope(c);
@@ -1164,14 +1755,12 @@ static void compileWhileStatement(Compiler* c, JStarStmt* s) {
     Loop l;
     startLoop(c, &l);
 
-    compileExpr(c, s->as.whileStmt.cond);
-    size_t exitJmp = emitBytecode(c, OP_JUMPF, 0);
-    emitShort(c, 0, 0);
+    size_t exitJmps = compileCondJump(c, s->as.whileStmt.cond, false, NO_JUMP);
 
     compileStatement(c, s->as.whileStmt.body);
 
     emitJumpTo(c, OP_JUMP, l.start, s->line);
-    setJumpTo(c, exitJmp, getCurrentAddr(c), s->line);
+    patchJumpList(c, exitJmps, getCurrentAddr(c), s->line);
 
     endLoop(c);
 }
@@ -1478,15 +2067,17 @@ static ObjFunction* function(Compiler* c, ObjModule* module, JStarStmt* s) {
     emitBytecode(c, OP_NULL, 0);
     emitBytecode(c, OP_RETURN, 0);
 
+    if(c->vm->optimize) threadJumps(c);
+    computeFrameSize(c, s->line);
     return c->func;
 }
 
 static ObjString* createMethodName(Compiler* c, JStarIdentifier* clsId, JStarIdentifier* methId) {
     size_t length = clsId->length + methId->length + 1;
     ObjString* name = allocateString(c->vm, length);
-    memcpy(name->data, clsId->name, clsId->length);
-    name->data[clsId->length] = '.';
-    memcpy(name->data + clsId->length + 1, methId->name, methId->length);
+    memcpy(name->chars, clsId->name, clsId->length);
+    name->chars[clsId->length] = '.';
+    memcpy(name->chars + clsId->length + 1, methId->name, methId->length);
     return name;
 }
 
@@ -1497,7 +2088,7 @@ static ObjFunction* method(Compiler* c, ObjModule* mod, JStarIdentifier* clsName
     bool vararg = s->as.funcDecl.isVararg;
 
     c->func = newFunction(c->vm, mod, arity, defCount, vararg);
-    addConstant(&c->func->code, NULL_VAL);  // This const will hold the superclass at runtime
+    addConstant(c->vm, &c->func->code, NULL_VAL);  // This const will hold the superclass at runtime
     addFunctionDefaults(c, &c->func->c, &s->as.funcDecl.defArgs);
 
     c->func->c.name = createMethodName(c, clsName, name);
@@ -1537,6 +2128,8 @@ static ObjFunction* method(Compiler* c, ObjModule* mod, JStarIdentifier* clsName
     }
 
     emitBytecode(c, OP_RETURN, 0);
+    if(c->vm->optimize) threadJumps(c);
+    computeFrameSize(c, s->line);
     return c->func;
 }
 
@@ -1745,7 +2338,7 @@ static void compileStatement(Compiler* c, JStarStmt* s) {
         break;
     case JSR_EXPR_STMT:
         compileExpr(c, s->as.exprStmt);
-        emitBytecode(c, OP_POP, 0);
+        emitOpcode(c, OP_POP, 0);
         break;
     case JSR_VARDECL:
         compileVarDecl(c, s);
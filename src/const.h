@@ -12,8 +12,15 @@
 #define STACK_SZ        (FRAME_SZ) * (MAX_LOCALS + 1)  // Deafult starting stack size
 #define INIT_GC         (1024 * 1024 * 20)             // 20MiB - First GC collection point
 #define HEAP_GROW_RATE  2                              // The heap growing rate
+#define NURSERY_SZ      (1024 * 1024 * 2)              // 2MiB - Bytes allocated between minor GCs
+#define GC_STEP_SZ      (1024 * 64)                    // 64KiB - Bytes allocated between GC steps
+#define GC_STEP_BUDGET  (1024 * 32)                    // Objects visited or swept in a GC step
+#define GC_THREADS      1                              // Threads marking the heap in parallel
 #define HANDLER_MAX     10                             // Max number of try-excepts for a frame
+#define HANDLER_SZ      32                             // Default starting handler stack size
+#define TEMP_STACK_SZ   16                             // Stack reserved for runtime temporaries
 #define SUPER_SLOT      0                              // Constant holding the method's super-class
+#define MEM_RESERVE_SZ  (1024 * 1024)                  // 1MiB - Released when allocations fail
 
 // -----------------------------------------------------------------------------
 // COMPILER CONSTANTS
@@ -52,9 +52,9 @@ void disassembleFunction(ObjFunction* fn) {
 
     printf("function ");
     if(mod->length != 0) {
-        printf("%s.%s", mod->data, name->data);
+        printf("%s.%s", stringData(mod), stringData(name));
     } else {
-        printf("%s", name->data);
+        printf("%s", stringData(name));
     }
     printf(" (%zu instructions at %p)\n", instr, (void*)fn);
     
@@ -78,9 +78,9 @@ void disassembleNative(ObjNative* nat) {
     ObjString* name = nat->c.name;
     printf("native ");
     if(mod->length != 0) {
-        printf("%s.%s", mod->data, name->data);
+        printf("%s.%s", stringData(mod), stringData(name));
     } else {
-        printf("%s", name->data);
+        printf("%s", stringData(name));
     }
     printf(" (%p)\n", (void*)nat);
     disassembleCommon(&nat->c, 0);
@@ -98,6 +98,13 @@ static void constInstruction(Code* c, size_t i) {
     printf(")");
 }
 
+static void symbolInstruction(Code* c, size_t i) {
+    int sym = readShortAt(c->bytecode, i + 1);
+    printf("%d (", sym);
+    printValue(c->consts.arr[c->symbols[sym].constant]);
+    printf(")");
+}
+
 static void const2Instruction(Code* c, size_t i) {
     int arg1 = readShortAt(c->bytecode, i + 1);
     int arg2 = readShortAt(c->bytecode, i + 3);
@@ -110,9 +117,9 @@ static void const2Instruction(Code* c, size_t i) {
 
 static void invokeInstruction(Code* c, size_t i) {
     int argc = c->bytecode[i + 1];
-    int name = readShortAt(c->bytecode, i + 2);
-    printf("%d %d (", argc, name);
-    printValue(c->consts.arr[name]);
+    int sym = readShortAt(c->bytecode, i + 2);
+    printf("%d %d (", argc, sym);
+    printValue(c->consts.arr[c->symbols[sym].constant]);
     printf(")");
 }
 
@@ -120,6 +127,26 @@ static void unsignedByteInstruction(Code* c, size_t i) {
     printf("%d", c->bytecode[i + 1]);
 }
 
+static void unsignedByte2Instruction(Code* c, size_t i) {
+    printf("%d %d", c->bytecode[i + 1], c->bytecode[i + 2]);
+}
+
+static void localConstInstruction(Code* c, size_t i) {
+    int local = c->bytecode[i + 1];
+    int op = readShortAt(c->bytecode, i + 2);
+    printf("%d %d (", local, op);
+    printValue(c->consts.arr[op]);
+    printf(")");
+}
+
+static void localSymbolInstruction(Code* c, size_t i) {
+    int local = c->bytecode[i + 1];
+    int sym = readShortAt(c->bytecode, i + 2);
+    printf("%d %d (", local, sym);
+    printValue(c->consts.arr[c->symbols[sym].constant]);
+    printf(")");
+}
+
 static void closureInstruction(Code* c, int indent, size_t i) {
     int op = readShortAt(c->bytecode, i + 1);
 
@@ -152,11 +179,18 @@ void disassembleInstr(Code* c, int indent, size_t instr) {
     case OP_NATIVE:
     case OP_IMPORT:
     case OP_IMPORT_FROM:
-    case OP_GET_FIELD:
-    case OP_SET_FIELD:
     case OP_NEW_CLASS:
     case OP_NEW_SUBCLASS:
     case OP_DEF_METHOD:
+    case OP_SUPER_BIND:
+    case OP_GET_CONST:
+    case OP_DEFINE_GLOBAL:
+        constInstruction(c, instr);
+        break;
+    case OP_GET_FIELD:
+    case OP_SET_FIELD:
+    case OP_GET_GLOBAL:
+    case OP_SET_GLOBAL:
     case OP_INVOKE_0:
     case OP_INVOKE_1:
     case OP_INVOKE_2:
@@ -168,7 +202,6 @@ void disassembleInstr(Code* c, int indent, size_t instr) {
     case OP_INVOKE_8:
     case OP_INVOKE_9:
     case OP_INVOKE_10:
-    case OP_INVOKE_UNPACK:
     case OP_SUPER_0:
     case OP_SUPER_1:
     case OP_SUPER_2:
@@ -180,13 +213,7 @@ void disassembleInstr(Code* c, int indent, size_t instr) {
     case OP_SUPER_8:
     case OP_SUPER_9:
     case OP_SUPER_10:
-    case OP_SUPER_BIND:
-    case OP_SUPER_UNPACK:
-    case OP_GET_CONST:
-    case OP_GET_GLOBAL:
-    case OP_SET_GLOBAL:
-    case OP_DEFINE_GLOBAL:
-        constInstruction(c, instr);
+        symbolInstruction(c, instr);
         break;
     case OP_JUMP:
     case OP_JUMPT:
@@ -201,7 +228,9 @@ void disassembleInstr(Code* c, int indent, size_t instr) {
         const2Instruction(c, instr);
         break;
     case OP_INVOKE:
+    case OP_INVOKE_UNPACK:
     case OP_SUPER:
+    case OP_SUPER_UNPACK:
         invokeInstruction(c, instr);
         break;
     case OP_POPN:
@@ -213,8 +242,18 @@ void disassembleInstr(Code* c, int indent, size_t instr) {
     case OP_SET_LOCAL:
     case OP_GET_UPVALUE:
     case OP_SET_UPVALUE:
+    case OP_SET_LOCAL_POP:
         unsignedByteInstruction(c, instr);
         break;
+    case OP_GET_LOCALS:
+        unsignedByte2Instruction(c, instr);
+        break;
+    case OP_GET_LOCAL_CONST:
+        localConstInstruction(c, instr);
+        break;
+    case OP_GET_LOCAL_FIELD:
+        localSymbolInstruction(c, instr);
+        break;
     case OP_CLOSURE:
         closureInstruction(c, indent, instr);
         break;
@@ -3,156 +3,442 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
+#include "arena.h"
 #include "code.h"
 #include "compiler.h"
 #include "dynload.h"
 #include "hashtable.h"
 #include "object.h"
+#include "thread.h"
+#include "util.h"
 #include "vm.h"
 
+#if defined(JSTAR_WINDOWS)
+    #include <Windows.h>
+#endif
+
 #define REACHED_DEFAULT_SZ 16
 #define REACHED_GROW_RATE  2
 
-void* gcAlloc(JStarVM* vm, void* ptr, size_t oldsize, size_t size) {
+#define REMEMBERED_DEFAULT_SZ 16
+#define REMEMBERED_GROW_RATE  2
+
+#define NURSERY_DEFAULT_SZ 16
+#define NURSERY_GROW_RATE  2
+
+#define MARK_DEQUE_DEFAULT_SZ 1024
+#define MARK_DEQUE_GROW_RATE  2
+
+// Heap size under which the marking is never parallel, as starting the threads would cost more
+// than what they save
+#define PARALLEL_MARK_MIN_HEAP (1024 * 1024 * 4)
+
+// Free the memory of an object. Used in place of GC_FREE and GC_FREE_VAR for the objects
+#define FREE_OBJ(vm, t, obj) freeObjMemory(vm, (Obj*)(obj), sizeof(t))
+#define FREE_VAR_OBJ(vm, t, var, count, obj) \
+    freeObjMemory(vm, (Obj*)(obj), sizeof(t) + sizeof(var) * (count))
+
+static void collectGarbage(JStarVM* vm);
+
+// Accounts the resizing of a block of memory from `oldsize` to `size` bytes under `category`
+static void trackAlloc(JStarVM* vm, MemCategory category, size_t oldsize, size_t size) {
     vm->allocated += size - oldsize;
+    vm->allocatedByCategory[category] += size - oldsize;
     if(size > oldsize) {
-#ifdef JSTAR_DBG_STRESS_GC
+        vm->nurseryAllocated += size - oldsize;
+        vm->stepAllocated += size - oldsize;
+        vm->gcStats.bytesAllocated += size - oldsize;
+    } else {
+        vm->gcStats.bytesFreed += oldsize - size;
+    }
+}
+
+// Retries an allocation that the allocation callback failed to carry out, first after a full
+// collection (if `collect` is set) and then after releasing the memory reserve of the VM. In the
+// latter case the VM is flagged as out of memory, so that an OutOfMemoryException is raised once
+// the allocating code gets back to a safe point. Aborts only if the allocation still fails
+static void* retryAlloc(JStarVM* vm, void* ptr, size_t oldsize, size_t size, bool collect) {
+    void* mem;
+    if(collect) {
         garbageCollect(vm);
-#else
-        if(vm->allocated > vm->nextGC) {
-            garbageCollect(vm);
-        }
-#endif
+        if((mem = arenaRealloc(&vm->arena, ptr, oldsize, size))) return mem;
     }
 
-    if(size == 0) {
-        free(ptr);
-        return NULL;
+    if(vm->memReserve != NULL) {
+        vm->arena.allocator(vm->memReserve, MEM_RESERVE_SZ, 0, vm->arena.allocatorData);
+        vm->memReserve = NULL;
+        vm->outOfMemory = true;
+        vm->evalBreak = 1;
+        if((mem = arenaRealloc(&vm->arena, ptr, oldsize, size))) return mem;
     }
 
-    void* mem = realloc(ptr, size);
-    if(!mem) {
-        perror("Error");
-        abort();
+    fprintf(stderr, "Error: out of memory\n");
+    abort();
+}
+
+// Enforces the heap limit. If it is still exceeded after a full collection, the allocation is
+// carried out anyway and an OutOfMemoryException is raised at the next safe point of the eval loop
+static void checkHeapLimit(JStarVM* vm) {
+    if(vm->heapLimit == 0 || vm->allocated <= vm->heapLimit || vm->outOfMemory) return;
+
+    garbageCollect(vm);
+    if(vm->allocated > vm->heapLimit) {
+        vm->outOfMemory = true;
+        vm->evalBreak = 1;
     }
+}
 
+void* gcAlloc(JStarVM* vm, void* ptr, size_t oldsize, size_t size) {
+    trackAlloc(vm, MEM_OBJECTS, oldsize, size);
+    if(size > oldsize) {
+        collectGarbage(vm);
+        checkHeapLimit(vm);
+    }
+
+    void* mem = arenaRealloc(&vm->arena, ptr, oldsize, size);
+    if(!mem && size != 0) mem = retryAlloc(vm, ptr, oldsize, size, true);
+    return mem;
+}
+
+void* gcAllocInternal(JStarVM* vm, MemCategory category, void* ptr, size_t oldsize, size_t size) {
+    trackAlloc(vm, category, oldsize, size);
+    void* mem = arenaRealloc(&vm->arena, ptr, oldsize, size);
+    if(!mem && size != 0) mem = retryAlloc(vm, ptr, oldsize, size, false);
     return mem;
 }
 
+void gcResetOutOfMemory(JStarVM* vm) {
+    vm->outOfMemory = false;
+    vm->evalBreak = 0;
+    if(vm->memReserve == NULL) {
+        vm->memReserve = vm->arena.allocator(NULL, 0, MEM_RESERVE_SZ, vm->arena.allocatorData);
+    }
+}
+
+static void addNurseryPage(JStarVM* vm, ArenaPage* page) {
+    if(vm->nurseryCount + 1 > vm->nurseryCapacity) {
+        size_t oldCap = vm->nurseryCapacity;
+        vm->nurseryCapacity = vm->nurseryCapacity ? vm->nurseryCapacity * NURSERY_GROW_RATE
+                                                  : NURSERY_DEFAULT_SZ;
+        vm->nurseryPages = gcAllocInternal(vm, MEM_VM, vm->nurseryPages,
+                                           sizeof(ArenaPage*) * oldCap,
+                                           sizeof(ArenaPage*) * vm->nurseryCapacity);
+    }
+    page->inNursery = true;
+    vm->nurseryPages[vm->nurseryCount++] = page;
+}
+
+Obj* gcAllocObj(JStarVM* vm, size_t size) {
+    Obj* o;
+    if(size > ARENA_MAX_SIZE) {
+        LargeObj* l = gcAlloc(vm, NULL, 0, sizeof(LargeObj) + size);
+        l->prev = NULL;
+        l->next = vm->largeObjects;
+        if(vm->largeObjects != NULL) vm->largeObjects->prev = l;
+        vm->largeObjects = l;
+        l->marked = false;
+        l->young = true;
+        o = (Obj*)(l + 1);
+        o->large = true;
+    } else {
+        o = gcAlloc(vm, NULL, 0, size);
+        ArenaPage* page = ARENA_PAGE_OF(o);
+        arenaSetBit(page->young, ARENA_BIT_OF(o));
+        if(!page->inNursery) addNurseryPage(vm, page);
+        o->large = false;
+    }
+    o->remembered = false;
+    return o;
+}
+
+// Frees the memory of an object, that has `size` bytes. The bits of the objects allocated in an
+// arena page are cleared by the sweeping, a word at a time
+static void freeObjMemory(JStarVM* vm, Obj* o, size_t size) {
+    if(o->large) {
+        LargeObj* l = LARGE_OBJ_HEADER(o);
+        if(l->prev != NULL) {
+            l->prev->next = l->next;
+        } else {
+            vm->largeObjects = l->next;
+        }
+        if(l->next != NULL) l->next->prev = l->prev;
+        gcAlloc(vm, l, sizeof(LargeObj) + size, 0);
+    } else {
+        gcAlloc(vm, o, size, 0);
+    }
+}
+
 static void freeObject(JStarVM* vm, Obj* o) {
+    vm->gcStats.objects[o->type]--;
     switch(o->type) {
     case OBJ_STRING: {
         ObjString* s = (ObjString*)o;
-        GC_FREE_ARRAY(vm, char, s->data, s->length + 1);
-        GC_FREE(vm, ObjString, s);
+        if(IS_BUFFERED_STRING(s)) {
+            StringBuffer* buf = STRING_BUFFER(s);
+            if(--buf->refCount == 0) gcAlloc(vm, buf, STRING_BUFFER_SIZE(buf->capacity), 0);
+            FREE_VAR_OBJ(vm, ObjString, StringBuffer*, 1, s);
+        } else {
+            FREE_VAR_OBJ(vm, ObjString, char, s->length + 1, s);
+        }
         break;
     }
     case OBJ_NATIVE: {
         ObjNative* n = (ObjNative*)o;
         GC_FREE_ARRAY(vm, Value, n->c.defaults, n->c.defCount);
-        GC_FREE(vm, ObjNative, n);
+        FREE_OBJ(vm, ObjNative, n);
         break;
     }
     case OBJ_FUNCTION: {
         ObjFunction* f = (ObjFunction*)o;
-        freeCode(&f->code);
+        freeCode(vm, &f->code);
         GC_FREE_ARRAY(vm, Value, f->c.defaults, f->c.defCount);
-        GC_FREE(vm, ObjFunction, f);
+        FREE_OBJ(vm, ObjFunction, f);
         break;
     }
     case OBJ_CLASS: {
         ObjClass* cls = (ObjClass*)o;
-        freeHashTable(&cls->methods);
-        GC_FREE(vm, ObjClass, cls);
+        freeHashTable(vm, &cls->methods);
+        freeHashTable(vm, &cls->methodCache);
+        FREE_OBJ(vm, ObjClass, cls);
         break;
     }
     case OBJ_INST: {
         ObjInstance* i = (ObjInstance*)o;
-        freeHashTable(&i->fields);
-        GC_FREE(vm, ObjInstance, i);
+        if(i->dict != NULL) {
+            freeHashTable(vm, i->dict);
+            gcAllocInternal(vm, MEM_TABLES, i->dict, sizeof(HashTable), 0);
+        }
+        if(i->fields != i->inlineFields) {
+            GC_FREE_ARRAY(vm, Value, i->fields, i->capacity);
+        }
+        FREE_VAR_OBJ(vm, ObjInstance, Value, i->inlineCapacity, i);
+        break;
+    }
+    case OBJ_SHAPE: {
+        ObjShape* s = (ObjShape*)o;
+        freeHashTable(vm, &s->transitions);
+        FREE_OBJ(vm, ObjShape, s);
         break;
     }
     case OBJ_MODULE: {
         ObjModule* m = (ObjModule*)o;
-        freeHashTable(&m->globals);
+        freeHashTable(vm, &m->globals);
         if(m->natives.dynlib) dynfree(m->natives.dynlib);
-        GC_FREE(vm, ObjModule, m);
+        FREE_OBJ(vm, ObjModule, m);
         break;
     }
     case OBJ_BOUND_METHOD: {
         ObjBoundMethod* b = (ObjBoundMethod*)o;
-        GC_FREE(vm, ObjBoundMethod, b);
+        FREE_OBJ(vm, ObjBoundMethod, b);
         break;
     }
     case OBJ_LIST: {
         ObjList* l = (ObjList*)o;
         GC_FREE_ARRAY(vm, Value, l->arr, l->capacity);
-        GC_FREE(vm, ObjList, l);
+        FREE_OBJ(vm, ObjList, l);
         break;
     }
     case OBJ_TUPLE: {
         ObjTuple* t = (ObjTuple*)o;
-        GC_FREE_VAR(vm, ObjTuple, Value, t->size, t);
+        FREE_VAR_OBJ(vm, ObjTuple, Value, t->size, t);
         break;
     }
     case OBJ_TABLE: {
         ObjTable* t = (ObjTable*)o;
         if(t->entries != NULL) {
-            GC_FREE_ARRAY(vm, TableEntry, t->entries, t->capacityMask + 1);
+            GC_FREE_ARRAY(vm, char, t->entries, TABLE_BLOCK_SIZE(t->capacityMask + 1));
         }
-        GC_FREE(vm, ObjTable, t);
+        FREE_OBJ(vm, ObjTable, t);
         break;
     }
     case OBJ_STACK_TRACE: {
         ObjStackTrace* st = (ObjStackTrace*)o;
         if(st->records != NULL) {
-            GC_FREE_ARRAY(vm, FrameRecord, st->records, st->recordSize);
+            GC_FREE_ARRAY(vm, FrameRecord, st->records, st->recordCapacity);
         }
-        GC_FREE(vm, ObjStackTrace, st);
+        FREE_OBJ(vm, ObjStackTrace, st);
         break;
     }
     case OBJ_CLOSURE: {
         ObjClosure* closure = (ObjClosure*)o;
-        GC_FREE_VAR(vm, ObjClosure, ObjUpvalue*, closure->upvalueCount, o);
+        FREE_VAR_OBJ(vm, ObjClosure, ObjUpvalue*, closure->upvalueCount, o);
         break;
     }
     case OBJ_UPVALUE: {
         ObjUpvalue* upvalue = (ObjUpvalue*)o;
-        GC_FREE(vm, ObjUpvalue, upvalue);
+        FREE_OBJ(vm, ObjUpvalue, upvalue);
         break;
     }
     case OBJ_USERDATA: {
         ObjUserdata* udata = (ObjUserdata*)o;
         if(udata->finalize) udata->finalize((void*)udata->data);
-        GC_FREE_VAR(vm, ObjUserdata, uint8_t, udata->size, udata);
+        FREE_VAR_OBJ(vm, ObjUserdata, uint8_t, udata->size, udata);
+        break;
+    }
+    case OBJ_TYPED_ARRAY: {
+        ObjTypedArray* arr = (ObjTypedArray*)o;
+        FREE_VAR_OBJ(vm, ObjTypedArray, uint8_t, arr->size * typedArrayElemSize(arr->type), arr);
         break;
     }
     }
 }
 
-void sweepObjects(JStarVM* vm) {
-    Obj** head = &vm->objects;
-    while(*head != NULL) {
-        if(!(*head)->reached) {
-            Obj* u = *head;
-            *head = u->next;
-
+static void freeUnreached(JStarVM* vm, Obj* o) {
 #ifdef JSTAR_DBG_PRINT_GC
-            printf("GC_FREE: unreached object %p type: %s\n", (void*)u, ObjTypeNames[u->type]);
+    printf("GC_FREE: unreached object %p type: %s\n", (void*)o, ObjTypeNames[o->type]);
 #endif
+    freeObject(vm, o);
+}
+
+// Frees the objects of `page` whose bits are set in `dead`, the word `i` of the page bitmaps
+static void freePageObjects(JStarVM* vm, ArenaPage* page, int i, uint64_t dead) {
+    while(dead != 0) {
+        size_t bit = (size_t)i * 64 + ctz64(dead);
+        dead &= dead - 1;
+        freeUnreached(vm, (Obj*)((char*)page + bit * ARENA_GRANULE));
+    }
+}
+
+// Frees the unreached objects of the old generation allocated in `page`.
+// Returns the number of old objects in the page
+static size_t sweepPage(JStarVM* vm, ArenaPage* page) {
+    size_t count = 0;
+    for(int i = 0; i < ARENA_BITMAP_SZ; i++) {
+        uint64_t old = page->old[i];
+        if(old == 0) continue;
+
+        count += popcount64(old);
+        page->old[i] = old & page->marks[i];
+        freePageObjects(vm, page, i, old & ~page->marks[i]);
+    }
+    return count;
+}
+
+// Frees up to `budget` unreached objects of the old generation still to be swept.
+// Returns true if the sweeping is complete
+static bool sweepOldGeneration(JStarVM* vm, size_t budget) {
+    size_t work = 0;
+
+    // The large objects allocated during the sweeping are pushed in front of the unswept ones,
+    // so these are all old
+    while(vm->unsweptLarge != NULL && work < budget) {
+        LargeObj* l = vm->unsweptLarge;
+        vm->unsweptLarge = l->next;
+        if(!l->marked) freeUnreached(vm, (Obj*)(l + 1));
+        work++;
+    }
 
-            freeObject(vm, u);
+    size_t pageCount = arenaPageCount(&vm->arena);
+    while(vm->sweepPage < pageCount && work < budget) {
+        work += sweepPage(vm, arenaGetPage(&vm->arena, vm->sweepPage++)) + 1;
+    }
+
+    return vm->unsweptLarge == NULL && vm->sweepPage == pageCount;
+}
+
+// Frees the unreached objects of the nursery, and promotes the survivors to the old generation.
+// Survivors keep their mark bit, so that the ones promoted while the old generation is being
+// swept are not freed. Mark bits are cleared when a major collection starts
+static void sweepNursery(JStarVM* vm) {
+    for(size_t i = 0; i < vm->nurseryCount; i++) {
+        ArenaPage* page = vm->nurseryPages[i];
+        page->inNursery = false;
+        for(int j = 0; j < ARENA_BITMAP_SZ; j++) {
+            uint64_t young = page->young[j];
+            if(young == 0) continue;
+
+            page->young[j] = 0;
+            page->old[j] |= young & page->marks[j];
+            freePageObjects(vm, page, j, young & ~page->marks[j]);
+        }
+    }
+    vm->nurseryCount = 0;
+
+    LargeObj* l = vm->largeObjects;
+    while(l != NULL && l->young) {
+        LargeObj* next = l->next;
+        if(!l->marked) {
+            freeUnreached(vm, (Obj*)(l + 1));
         } else {
-            (*head)->reached = false;
-            head = &(*head)->next;
+            l->young = false;
         }
+        l = next;
+    }
+}
+
+// Clears the mark bits of all the objects
+static void clearMarks(JStarVM* vm) {
+    size_t pageCount = arenaPageCount(&vm->arena);
+    for(size_t i = 0; i < pageCount; i++) {
+        ArenaPage* page = arenaGetPage(&vm->arena, i);
+        memset(page->marks, 0, sizeof(page->marks));
+    }
+    for(LargeObj* l = vm->largeObjects; l != NULL; l = l->next) {
+        l->marked = false;
+    }
+}
+
+static void initReached(JStarVM* vm) {
+    vm->reachedStack = gcAllocInternal(vm, MEM_VM, NULL, 0, sizeof(Obj*) * REACHED_DEFAULT_SZ);
+    vm->reachedCapacity = REACHED_DEFAULT_SZ;
+}
+
+static void freeReached(JStarVM* vm) {
+    gcAllocInternal(vm, MEM_VM, vm->reachedStack, sizeof(Obj*) * vm->reachedCapacity, 0);
+    vm->reachedStack = NULL;
+    vm->reachedCapacity = 0;
+    vm->reachedCount = 0;
+}
+
+void freeObjects(JStarVM* vm) {
+    size_t pageCount = arenaPageCount(&vm->arena);
+    for(size_t i = 0; i < pageCount; i++) {
+        ArenaPage* page = arenaGetPage(&vm->arena, i);
+        for(int j = 0; j < ARENA_BITMAP_SZ; j++) {
+            uint64_t objects = page->old[j] | page->young[j];
+            page->old[j] = page->young[j] = 0;
+            freePageObjects(vm, page, j, objects);
+        }
+    }
+    while(vm->largeObjects != NULL) {
+        freeUnreached(vm, (Obj*)(vm->largeObjects + 1));
+    }
+
+    vm->unsweptLarge = NULL;
+    gcAllocInternal(vm, MEM_VM, vm->nurseryPages, sizeof(ArenaPage*) * vm->nurseryCapacity, 0);
+    vm->nurseryPages = NULL;
+    vm->nurseryCount = vm->nurseryCapacity = 0;
+    gcAllocInternal(vm, MEM_VM, vm->remembered, sizeof(Obj*) * vm->rememberedCapacity, 0);
+    vm->remembered = NULL;
+    vm->rememberedCount = vm->rememberedCapacity = 0;
+    freeReached(vm);
+}
+
+void gcForEachObject(JStarVM* vm, void (*fn)(JStarVM* vm, Obj* o)) {
+    size_t pageCount = arenaPageCount(&vm->arena);
+    for(size_t i = 0; i < pageCount; i++) {
+        ArenaPage* page = arenaGetPage(&vm->arena, i);
+        for(int j = 0; j < ARENA_BITMAP_SZ; j++) {
+            uint64_t objects = page->old[j] | page->young[j];
+            for(; objects != 0; objects &= objects - 1) {
+                size_t bit = (size_t)j * 64 + ctz64(objects);
+                fn(vm, (Obj*)((char*)page + bit * ARENA_GRANULE));
+            }
+        }
+    }
+    for(LargeObj* l = vm->largeObjects; l != NULL; l = l->next) {
+        fn(vm, (Obj*)(l + 1));
     }
 }
 
 static void growReached(JStarVM* vm) {
+    size_t oldCap = vm->reachedCapacity;
     vm->reachedCapacity *= REACHED_GROW_RATE;
-    vm->reachedStack = realloc(vm->reachedStack, sizeof(Obj*) * vm->reachedCapacity);
+    vm->reachedStack = gcAllocInternal(vm, MEM_VM, vm->reachedStack, sizeof(Obj*) * oldCap,
+                                       sizeof(Obj*) * vm->reachedCapacity);
 }
 
 static void addReachedObject(JStarVM* vm, Obj* o) {
@@ -162,8 +448,192 @@ static void addReachedObject(JStarVM* vm, Obj* o) {
     vm->reachedStack[vm->reachedCount++] = o;
 }
 
-void reachObject(JStarVM* vm, Obj* o) {
-    if(o == NULL || o->reached) return;
+static void growRemembered(JStarVM* vm) {
+    size_t oldCap = vm->rememberedCapacity;
+    vm->rememberedCapacity = oldCap ? oldCap * REMEMBERED_GROW_RATE : REMEMBERED_DEFAULT_SZ;
+    vm->remembered = gcAllocInternal(vm, MEM_VM, vm->remembered, sizeof(Obj*) * oldCap,
+                                     sizeof(Obj*) * vm->rememberedCapacity);
+}
+
+static void rememberObject(JStarVM* vm, Obj* o) {
+    if(vm->rememberedCount + 1 > vm->rememberedCapacity) {
+        growRemembered(vm);
+    }
+    o->remembered = true;
+    vm->remembered[vm->rememberedCount++] = o;
+}
+
+void gcRememberObject(JStarVM* vm, Obj* o) {
+    if(!o->remembered) {
+        rememberObject(vm, o);
+    }
+}
+
+// Takes the remembered set, that will be rebuilt during the collection. The returned array has
+// `capacity` slots, and must be freed with `freeRemembered`
+static Obj** takeRemembered(JStarVM* vm, size_t* count, size_t* capacity) {
+    Obj** remembered = vm->remembered;
+    *count = vm->rememberedCount;
+    *capacity = vm->rememberedCapacity;
+    vm->remembered = NULL;
+    vm->rememberedCount = vm->rememberedCapacity = 0;
+    for(size_t i = 0; i < *count; i++) {
+        remembered[i]->remembered = false;
+    }
+    return remembered;
+}
+
+static void freeRemembered(JStarVM* vm, Obj** remembered, size_t capacity) {
+    gcAllocInternal(vm, MEM_VM, remembered, sizeof(Obj*) * capacity, 0);
+}
+
+// A thread taking part in a parallel marking
+typedef struct GCWorker GCWorker;
+
+#ifdef JSTAR_THREADS
+// Circular buffer of a work-stealing deque
+typedef struct MarkBuffer {
+    struct MarkBuffer* prev;  // The buffer replaced by this one when the deque grew
+    int64_t capacity;
+    Obj* objs[];
+} MarkBuffer;
+
+// Work-stealing deque of reached objects still to be explored (Chase-Lev). Its owner pushes and
+// pops objects at the bottom, while the other workers steal them from the top
+typedef struct MarkDeque {
+    int64_t top, bottom;
+    MarkBuffer* buffer;
+} MarkDeque;
+
+struct GCWorker {
+    struct ParallelMark* pm;
+    MarkDeque deque;
+    uint32_t seed;  // State of the random generator used to pick the workers to steal from
+    bool started;   // Whether the thread of the worker has been started
+    Thread thread;
+};
+
+// State shared by the workers of a parallel marking
+typedef struct ParallelMark {
+    JStarVM* vm;
+    GCWorker* workers;
+    int workerCount;
+    int active;  // Workers that haven't run out of work. The marking ends when it reaches 0
+    Mutex lock;  // Serializes the allocations of the workers
+} ParallelMark;
+
+static size_t markBufferSize(int64_t capacity) {
+    return sizeof(MarkBuffer) + sizeof(Obj*) * capacity;
+}
+
+static MarkBuffer* newMarkBuffer(ParallelMark* pm, int64_t capacity) {
+    mutexLock(&pm->lock);
+    MarkBuffer* b = gcAllocInternal(pm->vm, MEM_VM, NULL, 0, markBufferSize(capacity));
+    mutexUnlock(&pm->lock);
+    b->prev = NULL;
+    b->capacity = capacity;
+    return b;
+}
+
+// Replaced buffers are only freed at the end of the marking, as thieves may still be reading them
+static void freeMarkBuffers(ParallelMark* pm, MarkBuffer* b) {
+    while(b != NULL) {
+        MarkBuffer* prev = b->prev;
+        gcAllocInternal(pm->vm, MEM_VM, b, markBufferSize(b->capacity), 0);
+        b = prev;
+    }
+}
+
+static void growMarkDeque(ParallelMark* pm, MarkDeque* d, int64_t top, int64_t bottom) {
+    MarkBuffer* old = d->buffer;
+    MarkBuffer* b = newMarkBuffer(pm, old->capacity * MARK_DEQUE_GROW_RATE);
+    for(int64_t i = top; i < bottom; i++) {
+        b->objs[i % b->capacity] = atomicLoad(&old->objs[i % old->capacity], ATOMIC_RELAXED);
+    }
+    b->prev = old;
+    atomicStore(&d->buffer, b, ATOMIC_RELEASE);
+}
+
+// Only called by the owner of the deque
+static void markDequePush(ParallelMark* pm, MarkDeque* d, Obj* o) {
+    int64_t bottom = atomicLoad(&d->bottom, ATOMIC_RELAXED);
+    int64_t top = atomicLoad(&d->top, ATOMIC_ACQUIRE);
+    MarkBuffer* b = atomicLoad(&d->buffer, ATOMIC_RELAXED);
+    if(bottom - top > b->capacity - 1) {
+        growMarkDeque(pm, d, top, bottom);
+        b = atomicLoad(&d->buffer, ATOMIC_RELAXED);
+    }
+    atomicStore(&b->objs[bottom % b->capacity], o, ATOMIC_RELAXED);
+    atomicFence(ATOMIC_RELEASE);
+    atomicStore(&d->bottom, bottom + 1, ATOMIC_RELAXED);
+}
+
+// Only called by the owner of the deque. Returns NULL if the deque is empty
+static Obj* markDequePop(MarkDeque* d) {
+    int64_t bottom = atomicLoad(&d->bottom, ATOMIC_RELAXED) - 1;
+    MarkBuffer* b = atomicLoad(&d->buffer, ATOMIC_RELAXED);
+    atomicStore(&d->bottom, bottom, ATOMIC_RELAXED);
+    atomicFence(ATOMIC_SEQ_CST);
+    int64_t top = atomicLoad(&d->top, ATOMIC_RELAXED);
+
+    if(top > bottom) {
+        atomicStore(&d->bottom, bottom + 1, ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    Obj* o = atomicLoad(&b->objs[bottom % b->capacity], ATOMIC_RELAXED);
+    if(top == bottom) {
+        // Last object of the deque, race against the thieves to take it
+        if(!atomicCas64(&d->top, top, top + 1)) o = NULL;
+        atomicStore(&d->bottom, bottom + 1, ATOMIC_RELAXED);
+    }
+    return o;
+}
+
+// Returns NULL if the deque is empty, or if another thief took the object first
+static Obj* markDequeSteal(MarkDeque* d) {
+    int64_t top = atomicLoad(&d->top, ATOMIC_ACQUIRE);
+    atomicFence(ATOMIC_SEQ_CST);
+    int64_t bottom = atomicLoad(&d->bottom, ATOMIC_ACQUIRE);
+    if(top >= bottom) return NULL;
+
+    MarkBuffer* b = atomicLoad(&d->buffer, ATOMIC_ACQUIRE);
+    Obj* o = atomicLoad(&b->objs[top % b->capacity], ATOMIC_RELAXED);
+    if(!atomicCas64(&d->top, top, top + 1)) return NULL;
+    return o;
+}
+
+static bool markDequeEmpty(MarkDeque* d) {
+    return atomicLoad(&d->top, ATOMIC_ACQUIRE) >= atomicLoad(&d->bottom, ATOMIC_ACQUIRE);
+}
+#endif
+
+// Marks an object as reached and adds it to the objects to explore. `w` is the worker marking
+// the object during a parallel marking, or NULL if the marking is carried out by the VM thread
+static void markObject(JStarVM* vm, GCWorker* w, Obj* o) {
+    if(o == NULL) return;
+
+#ifdef JSTAR_THREADS
+    // Workers race to set the mark bit of an object, the one that sets it explores the object
+    if(w != NULL) {
+        if(o->large) {
+            if(atomicExchangeBool(&LARGE_OBJ_HEADER(o)->marked, true)) return;
+        } else {
+            size_t bit = ARENA_BIT_OF(o);
+            uint64_t mask = (uint64_t)1 << (bit % 64);
+            if(atomicFetchOr64(&ARENA_PAGE_OF(o)->marks[bit / 64], mask) & mask) return;
+        }
+        markDequePush(w->pm, &w->deque, o);
+        return;
+    }
+#endif
+
+    if(vm->rememberRoots && !o->remembered) rememberObject(vm, o);
+    vm->gcWork++;
+
+    // A minor collection doesn't trace the old generation, whose objects are always
+    // considered reachable. References from old objects are found using the remembered set
+    if(gcIsMarked(o) || (vm->minorGC && gcIsOld(o))) return;
 
 #ifdef JSTAR_DBG_PRINT_GC
     printf("REACHED: Object %p type: %s repr: ", (void*)o, ObjTypeNames[o->type]);
@@ -171,131 +641,212 @@ void reachObject(JStarVM* vm, Obj* o) {
     printf("\n");
 #endif
 
-    o->reached = true;
+    if(o->large) {
+        LARGE_OBJ_HEADER(o)->marked = true;
+    } else {
+        arenaSetBit(ARENA_PAGE_OF(o)->marks, ARENA_BIT_OF(o));
+    }
     addReachedObject(vm, o);
 }
 
+static void markValue(JStarVM* vm, GCWorker* w, Value v) {
+    if(IS_OBJ(v)) markObject(vm, w, AS_OBJ(v));
+}
+
+void reachObject(JStarVM* vm, Obj* o) {
+    markObject(vm, NULL, o);
+}
+
 void reachValue(JStarVM* vm, Value v) {
-    if(IS_OBJ(v)) reachObject(vm, AS_OBJ(v));
+    markValue(vm, NULL, v);
 }
 
-static void reachValueArray(JStarVM* vm, ValueArray* a) {
+static void reachValueArray(JStarVM* vm, GCWorker* w, ValueArray* a) {
     for(int i = 0; i < a->size; i++) {
-        reachValue(vm, a->arr[i]);
+        markValue(vm, w, a->arr[i]);
+    }
+}
+
+static void reachHashTable(JStarVM* vm, GCWorker* w, HashTable* t) {
+    if(t->entries == NULL) return;
+    for(size_t i = 0; i <= t->sizeMask; i++) {
+        Entry* e = &t->entries[i];
+        markObject(vm, w, (Obj*)e->key);
+        markValue(vm, w, e->value);
+    }
+}
+
+// Inline caches keep their keys alive, so that a cached key can't be freed and its memory
+// reused by a different object, that would then wrongly hit the cache
+static void reachSymbolCaches(JStarVM* vm, GCWorker* w, Code* c) {
+    for(size_t i = 0; i < c->symbolCount; i++) {
+        Symbol* sym = &c->symbols[i];
+        markObject(vm, w, sym->cache.key);
+        if(sym->polyCache != NULL) {
+            for(int j = 0; j < POLY_CACHE_SIZE - 1; j++) {
+                markObject(vm, w, sym->polyCache[j].key);
+            }
+        }
     }
 }
 
-static void recursevelyReach(JStarVM* vm, Obj* o) {
+static void recursevelyReach(JStarVM* vm, GCWorker* w, Obj* o) {
 #ifdef JSTAR_DBG_PRINT_GC
     printf("Recursevely exploring object %p...\n", (void*)o);
 #endif
 
-    reachObject(vm, (Obj*)o->cls);
+    markObject(vm, w, (Obj*)o->cls);
 
     switch(o->type) {
     case OBJ_NATIVE: {
         ObjNative* n = (ObjNative*)o;
-        reachObject(vm, (Obj*)n->c.name);
-        reachObject(vm, (Obj*)n->c.module);
+        markObject(vm, w, (Obj*)n->c.name);
+        markObject(vm, w, (Obj*)n->c.module);
         for(uint8_t i = 0; i < n->c.defCount; i++) {
-            reachValue(vm, n->c.defaults[i]);
+            markValue(vm, w, n->c.defaults[i]);
         }
         break;
     }
     case OBJ_FUNCTION: {
         ObjFunction* func = (ObjFunction*)o;
-        reachObject(vm, (Obj*)func->c.name);
-        reachObject(vm, (Obj*)func->c.module);
-        reachValueArray(vm, &func->code.consts);
+        markObject(vm, w, (Obj*)func->c.name);
+        markObject(vm, w, (Obj*)func->c.module);
+        reachValueArray(vm, w, &func->code.consts);
+        reachSymbolCaches(vm, w, &func->code);
         for(uint8_t i = 0; i < func->c.defCount; i++) {
-            reachValue(vm, func->c.defaults[i]);
+            markValue(vm, w, func->c.defaults[i]);
         }
         break;
     }
     case OBJ_CLASS: {
         ObjClass* cls = (ObjClass*)o;
-        reachObject(vm, (Obj*)cls->name);
-        reachObject(vm, (Obj*)cls->superCls);
-        reachHashTable(vm, &cls->methods);
+        markObject(vm, w, (Obj*)cls->name);
+        markObject(vm, w, (Obj*)cls->superCls);
+        reachHashTable(vm, w, &cls->methods);
+        reachHashTable(vm, w, &cls->methodCache);
         break;
     }
     case OBJ_INST: {
         ObjInstance* i = (ObjInstance*)o;
-        reachHashTable(vm, &i->fields);
+        if(i->shape != NULL) {
+            markObject(vm, w, (Obj*)i->shape);
+            for(size_t j = 0; j < i->shape->fieldCount; j++) {
+                markValue(vm, w, i->fields[j]);
+            }
+        } else {
+            reachHashTable(vm, w, i->dict);
+        }
+        break;
+    }
+    case OBJ_SHAPE: {
+        ObjShape* s = (ObjShape*)o;
+        markObject(vm, w, (Obj*)s->parent);
+        markObject(vm, w, (Obj*)s->name);
+        reachHashTable(vm, w, &s->transitions);
         break;
     }
     case OBJ_MODULE: {
         ObjModule* m = (ObjModule*)o;
-        reachObject(vm, (Obj*)m->name);
-        reachHashTable(vm, &m->globals);
+        markObject(vm, w, (Obj*)m->name);
+        reachHashTable(vm, w, &m->globals);
         break;
     }
     case OBJ_LIST: {
         ObjList* l = (ObjList*)o;
         for(size_t i = 0; i < l->size; i++) {
-            reachValue(vm, l->arr[i]);
+            markValue(vm, w, l->arr[i]);
         }
         break;
     }
     case OBJ_TUPLE: {
         ObjTuple* t = (ObjTuple*)o;
         for(size_t i = 0; i < t->size; i++) {
-            reachValue(vm, t->arr[i]);
+            markValue(vm, w, t->arr[i]);
         }
         break;
     }
     case OBJ_TABLE: {
         ObjTable* t = (ObjTable*)o;
-        if(t->entries != NULL) {
-            for(size_t i = 0; i < t->capacityMask + 1; i++) {
-                reachValue(vm, t->entries[i].key);
-                reachValue(vm, t->entries[i].val);
-            }
+        for(size_t i = 0; i < t->numEntries; i++) {
+            markValue(vm, w, t->entries[i].key);
+            markValue(vm, w, t->entries[i].val);
         }
         break;
     }
     case OBJ_BOUND_METHOD: {
         ObjBoundMethod* b = (ObjBoundMethod*)o;
-        reachValue(vm, b->bound);
-        reachObject(vm, (Obj*)b->method);
+        markValue(vm, w, b->bound);
+        markObject(vm, w, (Obj*)b->method);
         break;
     }
     case OBJ_CLOSURE: {
         ObjClosure* closure = (ObjClosure*)o;
-        reachObject(vm, (Obj*)closure->fn);
+        markObject(vm, w, (Obj*)closure->fn);
         for(uint8_t i = 0; i < closure->upvalueCount; i++) {
-            reachObject(vm, (Obj*)closure->upvalues[i]);
+            markObject(vm, w, (Obj*)closure->upvalues[i]);
         }
         break;
     }
     case OBJ_UPVALUE: {
         ObjUpvalue* upvalue = (ObjUpvalue*)o;
-        reachValue(vm, *upvalue->addr);
+        markValue(vm, w, *upvalue->addr);
         break;
     }
     case OBJ_STACK_TRACE: {
         ObjStackTrace* stackTrace = (ObjStackTrace*)o;
         for(int i = 0; i < stackTrace->recordSize; i++) {
-            reachObject(vm, (Obj*)stackTrace->records[i].funcName);
-            reachObject(vm, (Obj*)stackTrace->records[i].moduleName);
+            markObject(vm, w, (Obj*)stackTrace->records[i].funcName);
+            markObject(vm, w, (Obj*)stackTrace->records[i].moduleName);
         }
         break;
     }
     case OBJ_USERDATA:
+    case OBJ_TYPED_ARRAY:
     case OBJ_STRING:
         break;
     }
 }
 
-void garbageCollect(JStarVM* vm) {
-#ifdef JSTAR_DBG_PRINT_GC
-    size_t prevAlloc = vm->allocated;
-    puts("*--- Starting GC ---*");
-#endif
+// Modules are always reachable, and their globals are written without a write barrier.
+// Thus, when `rescan` is true, the ones that have already been traced are traced again
+static void reachModules(JStarVM* vm, bool rescan) {
+    HashTable* modules = &vm->modules;
+    if(modules->entries == NULL) return;
 
-    // init reached object stack
-    vm->reachedStack = malloc(sizeof(Obj*) * REACHED_DEFAULT_SZ);
-    vm->reachedCapacity = REACHED_DEFAULT_SZ;
+    for(size_t i = 0; i <= modules->sizeMask; i++) {
+        Entry* e = &modules->entries[i];
+        if(e->key == NULL) continue;
+
+        Obj* module = AS_OBJ(e->value);
+        reachObject(vm, (Obj*)e->key);
+        if(rescan && (gcIsMarked(module) || (vm->minorGC && gcIsOld(module)))) {
+            recursevelyReach(vm, NULL, module);
+        } else {
+            reachObject(vm, module);
+        }
+    }
+}
+
+static void reachRoots(JStarVM* vm, bool rescanModules) {
+    // Objects referenced by the stack and by the compiler may be under construction, and thus
+    // be written without a write barrier. Remember them, so that the next collection will scan
+    // them again even if they get promoted or reached in the meantime
+    vm->rememberRoots = true;
+
+    // reach elements on the stack
+    for(Value* v = vm->stack; v < vm->sp; v++) {
+        reachValue(vm, *v);
+    }
+
+    // reach elements on the frame stack
+    for(int i = 0; i < vm->frameCount; i++) {
+        reachObject(vm, vm->frames[i].fn);
+    }
+
+    // reach the compiler objects
+    reachCompilerRoots(vm, vm->currCompiler);
+
+    vm->rememberRoots = false;
 
     // reach import paths list
     reachObject(vm, (Obj*)vm->importPaths);
@@ -315,6 +866,10 @@ void garbageCollect(JStarVM* vm) {
     reachObject(vm, (Obj*)vm->excClass);
     reachObject(vm, (Obj*)vm->tableClass);
     reachObject(vm, (Obj*)vm->udataClass);
+    reachObject(vm, (Obj*)vm->typedArrClass);
+    reachObject(vm, (Obj*)vm->f64ArrClass);
+    reachObject(vm, (Obj*)vm->i32ArrClass);
+    reachObject(vm, (Obj*)vm->byteArrClass);
 
     // reach script argument llist
     reachObject(vm, (Obj*)vm->argv);
@@ -326,43 +881,163 @@ void garbageCollect(JStarVM* vm) {
     // reach empty Tuple singleton
     reachObject(vm, (Obj*)vm->emptyTup);
 
+    // reach the root of the shape tree
+    reachObject(vm, (Obj*)vm->emptyShape);
+
     // reach loaded modules
-    reachHashTable(vm, &vm->modules);
+    reachModules(vm, rescanModules);
 
-    // reach elements on the stack
-    for(Value* v = vm->stack; v < vm->sp; v++) {
-        reachValue(vm, *v);
+    // reach open upvalues
+    for(ObjUpvalue* upvalue = vm->upvalues; upvalue != NULL; upvalue = upvalue->next) {
+        reachObject(vm, (Obj*)upvalue);
     }
+}
 
-    // reach elements on the frame stack
-    for(int i = 0; i < vm->frameCount; i++) {
-        reachObject(vm, vm->frames[i].fn);
+#ifdef JSTAR_THREADS
+// Tries to steal an object from the other workers, starting from a random one
+static Obj* stealWork(GCWorker* w) {
+    ParallelMark* pm = w->pm;
+    w->seed = w->seed * 1103515245 + 12345;
+    int first = (w->seed >> 16) % pm->workerCount;
+    for(int i = 0; i < pm->workerCount; i++) {
+        GCWorker* victim = &pm->workers[(first + i) % pm->workerCount];
+        if(victim == w) continue;
+        Obj* o = markDequeSteal(&victim->deque);
+        if(o != NULL) return o;
+    }
+    return NULL;
+}
+
+static bool hasWork(ParallelMark* pm) {
+    for(int i = 0; i < pm->workerCount; i++) {
+        if(!markDequeEmpty(&pm->workers[i].deque)) return true;
     }
+    return false;
+}
 
-    // reach open upvalues
-    for(ObjUpvalue* upvalue = vm->upvalues; upvalue != NULL; upvalue = upvalue->next) {
-        reachObject(vm, (Obj*)upvalue);
+static void runWorker(GCWorker* w) {
+    ParallelMark* pm = w->pm;
+    for(;;) {
+        Obj* o;
+        while((o = markDequePop(&w->deque)) != NULL) {
+            recursevelyReach(pm->vm, w, o);
+        }
+        if((o = stealWork(w)) != NULL) {
+            recursevelyReach(pm->vm, w, o);
+            continue;
+        }
+
+        // Only workers with work push new objects, so once all of them ran out of it (and
+        // thus their deques are empty) the marking is complete
+        atomicFetchAdd(&pm->active, -1);
+        while(!hasWork(pm)) {
+            if(atomicLoad(&pm->active, ATOMIC_SEQ_CST) == 0) return;
+            threadYield();
+        }
+        atomicFetchAdd(&pm->active, 1);
     }
+}
 
-    // reach the compiler objects
-    reachCompilerRoots(vm, vm->currCompiler);
+static THREAD_FUNC(workerThread, arg) {
+    runWorker(arg);
+    return 0;
+}
+
+// Explores all the reached objects using `vm->gcThreads` threads, the VM one included. The
+// reached stack is handed to the VM worker, and the other ones steal from it
+static void parallelMark(JStarVM* vm) {
+    ParallelMark pm;
+    pm.vm = vm;
+    pm.workerCount = vm->gcThreads;
+    pm.active = pm.workerCount;
+    pm.workers = gcAllocInternal(vm, MEM_VM, NULL, 0, sizeof(GCWorker) * pm.workerCount);
+    mutexInit(&pm.lock);
+
+    for(int i = 0; i < pm.workerCount; i++) {
+        GCWorker* w = &pm.workers[i];
+        w->pm = &pm;
+        w->seed = i + 1;
+        w->started = false;
+        w->deque.top = w->deque.bottom = 0;
+        w->deque.buffer = newMarkBuffer(&pm, MARK_DEQUE_DEFAULT_SZ);
+    }
 
-    // recursevely reach objects held by other reached objects
+    GCWorker* vmWorker = &pm.workers[0];
     while(vm->reachedCount != 0) {
-        recursevelyReach(vm, vm->reachedStack[--vm->reachedCount]);
+        markDequePush(&pm, &vmWorker->deque, vm->reachedStack[--vm->reachedCount]);
     }
 
-    // free unreached objects
-    sweepStrings(&vm->stringPool);
-    sweepObjects(vm);
+    // A worker whose thread can't be started has no work, so it simply doesn't take part
+    for(int i = 1; i < pm.workerCount; i++) {
+        GCWorker* w = &pm.workers[i];
+        w->started = threadStart(&w->thread, &workerThread, w);
+        if(!w->started) atomicFetchAdd(&pm.active, -1);
+    }
 
-    // free the reached objects stack
-    free(vm->reachedStack);
-    vm->reachedStack = NULL;
-    vm->reachedCapacity = 0;
-    vm->reachedCount = 0;
+    runWorker(vmWorker);
 
-    vm->nextGC = vm->allocated * vm->heapGrowRate;
+    for(int i = 0; i < pm.workerCount; i++) {
+        GCWorker* w = &pm.workers[i];
+        if(w->started) threadJoin(w->thread);
+        freeMarkBuffers(&pm, w->deque.buffer);
+    }
+
+    mutexFree(&pm.lock);
+    gcAllocInternal(vm, MEM_VM, pm.workers, sizeof(GCWorker) * pm.workerCount, 0);
+}
+#endif
+
+// Recursevely reaches objects held by reached objects, until `budget` units of work are
+// performed. Returns true if there are no more objects to explore
+static bool markStep(JStarVM* vm, size_t budget) {
+#ifdef JSTAR_THREADS
+    // Marking the old generation without a budget stops the world, so carry it out in parallel
+    if(budget == SIZE_MAX && !vm->minorGC && vm->gcThreads > 1 &&
+       vm->allocated >= PARALLEL_MARK_MIN_HEAP) {
+        parallelMark(vm);
+        return true;
+    }
+#endif
+
+    vm->gcWork = 0;
+    while(vm->reachedCount != 0 && vm->gcWork < budget) {
+        recursevelyReach(vm, NULL, vm->reachedStack[--vm->reachedCount]);
+    }
+    return vm->reachedCount == 0;
+}
+
+void minorCollect(JStarVM* vm) {
+#ifdef JSTAR_DBG_PRINT_GC
+    size_t prevAlloc = vm->allocated;
+    printf("*--- Starting minor GC ---*\n");
+#endif
+
+    vm->minorGC = true;
+    initReached(vm);
+
+    size_t rememberedCount, rememberedCapacity;
+    Obj** remembered = takeRemembered(vm, &rememberedCount, &rememberedCapacity);
+
+    reachRoots(vm, true);
+
+    // reach objects held by old objects that have been written to since the last collection
+    for(size_t i = 0; i < rememberedCount; i++) {
+        recursevelyReach(vm, NULL, remembered[i]);
+    }
+    freeRemembered(vm, remembered, rememberedCapacity);
+
+    markStep(vm, SIZE_MAX);
+
+    // free unreached objects
+    // Only Strings interned since the last collection can be found unreached
+    if(vm->youngInterned != 0) sweepStrings(&vm->stringPool, true);
+    vm->youngInterned = 0;
+    sweepNursery(vm);
+
+    freeReached(vm);
+    vm->nurseryAllocated = 0;
+    vm->gcStats.minorCollections++;
+    vm->gcStats.liveBytes = vm->allocated;
 
 #ifdef JSTAR_DBG_PRINT_GC
     size_t curr = prevAlloc - vm->allocated;
@@ -372,4 +1047,206 @@ void garbageCollect(JStarVM* vm) {
         prevAlloc, vm->allocated, curr, vm->nextGC);
     printf("*--- End  of  GC ---*\n");
 #endif
-}
\ No newline at end of file
+}
+
+// Starts an incremental major collection by reaching the roots
+static void startMajor(JStarVM* vm) {
+#ifdef JSTAR_DBG_PRINT_GC
+    printf("*--- Starting major GC ---*\n");
+#endif
+
+    vm->minorGC = false;
+    vm->gcPhase = GC_MARK;
+    clearMarks(vm);
+    initReached(vm);
+    reachRoots(vm, false);
+}
+
+// Completes the marking atomically, sweeps the nursery and starts the sweeping of the old
+// generation
+static void finishMarking(JStarVM* vm) {
+    size_t rememberedCount, rememberedCapacity;
+    Obj** remembered = takeRemembered(vm, &rememberedCount, &rememberedCapacity);
+
+    // The roots have been written to without a write barrier, so scan them again
+    reachRoots(vm, true);
+
+    // The objects referenced by the roots may have been written to after being explored, as
+    // may have been the remembered ones. Explore them again
+    for(size_t i = 0; i < vm->rememberedCount; i++) {
+        recursevelyReach(vm, NULL, vm->remembered[i]);
+    }
+    for(size_t i = 0; i < rememberedCount; i++) {
+        if(gcIsMarked(remembered[i])) recursevelyReach(vm, NULL, remembered[i]);
+    }
+    freeRemembered(vm, remembered, rememberedCapacity);
+
+    markStep(vm, SIZE_MAX);
+
+    // Unreached Strings must be removed from the pool before being freed
+    sweepStrings(&vm->stringPool, false);
+    vm->youngInterned = 0;
+
+    sweepNursery(vm);
+    vm->sweepPage = 0;
+    vm->unsweptLarge = vm->largeObjects;
+
+    freeReached(vm);
+    vm->nurseryAllocated = 0;
+    vm->gcPhase = GC_SWEEP;
+}
+
+static void finishSweeping(JStarVM* vm) {
+    vm->gcPhase = GC_IDLE;
+    vm->nextGC = vm->allocated * vm->heapGrowRate;
+    vm->gcStats.majorCollections++;
+    vm->gcStats.liveBytes = vm->allocated;
+
+#ifdef JSTAR_DBG_PRINT_GC
+    printf("*--- End of major GC, allocated: %lu, next GC: %lu ---*\n", vm->allocated,
+           vm->nextGC);
+#endif
+}
+
+// Performs `budget` units of work of the incremental major collection in progress
+static void majorStep(JStarVM* vm, size_t budget) {
+    vm->stepAllocated = 0;
+    switch(vm->gcPhase) {
+    case GC_MARK:
+        if(markStep(vm, budget)) finishMarking(vm);
+        break;
+    case GC_SWEEP:
+        if(sweepOldGeneration(vm, budget)) finishSweeping(vm);
+        break;
+    case GC_IDLE:
+        break;
+    }
+}
+
+// Returns a monotonic time in milliseconds. Pauses are measured in wall time, as the CPU time
+// returned by `clock` would add up the time spent by all the threads of a parallel marking
+static double gcTime(void) {
+#if defined(JSTAR_POSIX)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000 + (double)ts.tv_nsec / 1000000;
+#elif defined(JSTAR_WINDOWS)
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart * 1000 / (double)freq.QuadPart;
+#else
+    return (double)clock() * 1000 / CLOCKS_PER_SEC;
+#endif
+}
+
+static void recordPause(JStarVM* vm, GCPause pause, double start) {
+    double ms = gcTime() - start;
+    vm->gcStats.totalPause += ms;
+    if(ms > vm->gcStats.maxPause) vm->gcStats.maxPause = ms;
+
+#ifdef JSTAR_DBG_GC_PAUSES
+    double us = ms * 1000;
+    int bucket = 0;
+    while(bucket < GC_PAUSE_BUCKETS - 1 && us >= (double)(1 << bucket)) {
+        bucket++;
+    }
+    vm->gcPauses[pause][bucket]++;
+    if(us > vm->gcMaxPause[pause]) vm->gcMaxPause[pause] = us;
+#endif
+}
+
+void garbageCollect(JStarVM* vm) {
+    double start = gcTime();
+
+    // Complete the major collection in progress before starting a new one
+    while(vm->gcPhase != GC_IDLE) {
+        majorStep(vm, SIZE_MAX);
+    }
+
+    startMajor(vm);
+    while(vm->gcPhase != GC_IDLE) {
+        majorStep(vm, SIZE_MAX);
+    }
+
+    recordPause(vm, PAUSE_FULL, start);
+}
+
+// Returns the kind of collection work that is due after an allocation
+static GCPause dueCollection(JStarVM* vm) {
+#ifdef JSTAR_DBG_STRESS_GC
+    bool stress = true;
+#else
+    bool stress = false;
+#endif
+
+    if(vm->gcPhase == GC_IDLE && vm->allocated > vm->nextGC) {
+        return PAUSE_MARK;
+    }
+    if(vm->gcPhase != GC_IDLE && (stress || vm->stepAllocated > vm->gcStepSize)) {
+        return vm->gcPhase == GC_MARK ? PAUSE_MARK : PAUSE_SWEEP;
+    }
+    if(vm->gcPhase != GC_MARK && (stress || vm->nurseryAllocated > vm->nurserySize)) {
+        return PAUSE_MINOR;
+    }
+    return PAUSE_NONE;
+}
+
+static void collectGarbage(JStarVM* vm) {
+    GCPause pause = dueCollection(vm);
+    if(pause == PAUSE_NONE) return;
+
+    double start = gcTime();
+
+    if(pause == PAUSE_MINOR) {
+        minorCollect(vm);
+    } else if(vm->gcPhase == GC_IDLE) {
+        startMajor(vm);
+    } else {
+        majorStep(vm, vm->gcStepBudget);
+        // The last marking step also completes the marking atomically
+        if(pause == PAUSE_MARK && vm->gcPhase != GC_MARK) pause = PAUSE_REMARK;
+    }
+
+    recordPause(vm, pause, start);
+}
+
+#ifdef JSTAR_DBG_GC_PAUSES
+void printGCPauses(JStarVM* vm) {
+    static const char* pauseNames[PAUSE_END] = {NULL, "minor", "mark", "remark", "sweep", "full"};
+
+    printf("*--- GC pause times (us) ---*\n");
+    printf("%16s", "");
+    for(int p = PAUSE_MINOR; p < PAUSE_END; p++) {
+        printf("%10s", pauseNames[p]);
+    }
+    printf("\n");
+
+    for(int b = 0; b < GC_PAUSE_BUCKETS; b++) {
+        char range[32];
+        if(b == 0) {
+            snprintf(range, sizeof(range), "< 1");
+        } else if(b == GC_PAUSE_BUCKETS - 1) {
+            snprintf(range, sizeof(range), ">= %d", 1 << (b - 1));
+        } else {
+            snprintf(range, sizeof(range), "[%d, %d)", 1 << (b - 1), 1 << b);
+        }
+
+        printf("%16s", range);
+        for(int p = PAUSE_MINOR; p < PAUSE_END; p++) {
+            printf("%10zu", vm->gcPauses[p][b]);
+        }
+        printf("\n");
+    }
+
+    printf("%16s", "max");
+    for(int p = PAUSE_MINOR; p < PAUSE_END; p++) {
+        printf("%10.0f", vm->gcMaxPause[p]);
+    }
+    printf("\n");
+}
+#endif
+
+extern inline bool gcIsMarked(Obj* o);
+extern inline bool gcIsOld(Obj* o);
+extern inline void gcWriteBarrier(JStarVM* vm, Obj* o, Value val);
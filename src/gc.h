@@ -3,26 +3,99 @@
 
 #include <stdlib.h>
 
+#include "arena.h"
 #include "jstar.h"
+#include "object.h"
 #include "value.h"
+#include "vm.h"
 
 #define GC_ALLOC(vm, size)                  gcAlloc(vm, NULL, 0, size)
 #define GC_FREE(vm, t, obj)                 gcAlloc(vm, obj, sizeof(t), 0)
 #define GC_FREE_ARRAY(vm, t, obj, count)    gcAlloc(vm, obj, sizeof(t) * (count), 0)
 #define GC_FREE_VAR(vm, t, var, count, obj) gcAlloc(vm, obj, sizeof(t) + sizeof(var) * (count), 0)
 
+// Returns the header of an object too big to be allocated in an arena page
+#define LARGE_OBJ_HEADER(o) ((LargeObj*)(o) - 1)
+
 void* gcAlloc(JStarVM* vm, void* ptr, size_t oldsize, size_t size);
 
-// Launch a garbage collection. It scans all roots (VM stack, global Strings, etc...)
-// marking all the reachable objects (recursively, if needed) and then calls sweepObjects
-// to free all unreached ones.
+// Allocates memory used internally by the VM, accounting it under `category`. It counts towards
+// the GC heuristics and the heap limit like the memory of objects, but never starts a collection
+// itself: the callers can hold unreachable objects, so the collection and the heap limit check
+// are deferred to the next object allocation
+void* gcAllocInternal(JStarVM* vm, MemCategory category, void* ptr, size_t oldsize, size_t size);
+
+// Called once an exception has unwound the stack while the VM was out of memory. Drops the pending
+// OutOfMemoryException, starts enforcing the heap limit again, and sets aside a new memory reserve
+// if the previous one has been used up
+void gcResetOutOfMemory(JStarVM* vm);
+
+// Allocates the memory of a new object of `size` bytes and adds it to the nursery
+Obj* gcAllocObj(JStarVM* vm, size_t size);
+
+// The collector is generational. New objects are allocated in the nursery, and get promoted to
+// the old generation once they survive a collection. Minor collections only trace and sweep the
+// nursery, using the remembered set to find the young objects referenced by old ones.
+// Major collections trace and sweep the whole heap, and are incremental: the marking and the
+// sweeping of the old generation are interleaved with the execution, and a bounded amount of
+// work is performed every `gcStepSize` bytes allocated. Minor collections are suspended while
+// marking, and the nursery is swept at the end of it.
+// When a major collection marks the heap without a budget, stopping the world (a full collection,
+// or the completion of an incremental one), the marking can be split among `gcThreads` threads
+// that steal work from each other.
+// The collector doesn't store its state in the objects: the mark bits and the generation of the
+// objects are kept in the bitmaps of the arena pages they are allocated in, and the old
+// generation is swept by scanning these bitmaps a word at a time.
+
+// Launch a major garbage collection, completing the incremental one in progress (if any).
+// It scans all roots (VM stack, global Strings, etc...) marking all the reachable objects
+// (recursively, if needed) and then frees all unreached ones.
 void garbageCollect(JStarVM* vm);
 
+// Launch a minor garbage collection, that only frees unreached objects of the nursery
+void minorCollect(JStarVM* vm);
+
+// Adds an object to the remembered set
+void gcRememberObject(JStarVM* vm, Obj* o);
+
+// Returns whether an object has been reached by the garbage collector
+inline bool gcIsMarked(Obj* o) {
+    if(o->large) return LARGE_OBJ_HEADER(o)->marked;
+    return arenaTestBit(ARENA_PAGE_OF(o)->marks, ARENA_BIT_OF(o));
+}
+
+// Returns whether an object has been promoted to the old generation
+inline bool gcIsOld(Obj* o) {
+    if(o->large) return !LARGE_OBJ_HEADER(o)->young;
+    return !arenaTestBit(ARENA_PAGE_OF(o)->young, ARENA_BIT_OF(o));
+}
+
+// Write barrier. Must be called every time `val` is stored in the already existing object `o`,
+// so that a young object referenced only by an old one is still found during minor collections,
+// and that an object stored in an already reached one is still found during incremental marking
+inline void gcWriteBarrier(JStarVM* vm, Obj* o, Value val) {
+    if(IS_OBJ(val) && !o->remembered) {
+        Obj* v = AS_OBJ(val);
+        if((gcIsOld(o) && !gcIsOld(v)) ||
+           (vm->gcPhase == GC_MARK && gcIsMarked(o) && !gcIsMarked(v))) {
+            gcRememberObject(vm, o);
+        }
+    }
+}
+
 // Mark an Object/Value as reached
 void reachObject(JStarVM* vm, Obj* o);
 void reachValue(JStarVM* vm, Value v);
 
-// Free all unmarked objects
-void sweepObjects(JStarVM* vm);
+// Free all objects, reached or not. Used when freeing the VM
+void freeObjects(JStarVM* vm);
+
+// Calls `fn` on every object of the heap
+void gcForEachObject(JStarVM* vm, void (*fn)(JStarVM* vm, Obj* o));
+
+#ifdef JSTAR_DBG_GC_PAUSES
+// Print the histogram of the GC pause times
+void printGCPauses(JStarVM* vm);
+#endif
 
 #endif
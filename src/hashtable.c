@@ -5,142 +5,262 @@
 
 #include "gc.h"
 #include "object.h"
+#include "util.h"
 
-#define TOMB_MARKER      TRUE_VAL
-#define MAX_LOAD_FACTOR  0.75
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define GROUP_WIDTH 16
+#else
+    #define GROUP_WIDTH 8
+#endif
+
+#define MAX_LOAD_FACTOR  0.875
 #define GROW_FACTOR      2
-#define INITIAL_CAPACITY 8
+#define INITIAL_CAPACITY GROUP_WIDTH
+
+// Control bytes. Full slots store the low 7 bits of the hash of their key, so the high bit is
+// set only for empty and deleted ones
+#define CTRL_EMPTY   0x80
+#define CTRL_DELETED 0xfe
+#define IS_FULL(c)   (((c) & 0x80) == 0)
+
+#define H1(hash) ((size_t)((hash) >> 7))
+#define H2(hash) ((uint8_t)((hash) & 0x7f))
+
+#define NO_SLOT             SIZE_MAX
+#define HASHTABLE_SIZE(cap) ((cap) * (sizeof(Entry) + 1))
+
+// Group operations return a mask with a bit set for each slot of the group that matches.
+// The index of the slot is recovered from the position of the bit by `MASK_INDEX`
+#if GROUP_WIDTH == 16
+typedef uint32_t GroupMask;
+
+    #define MASK_INDEX(m) ctz64(m)
+
+// Matches the slots whose control byte is equal to `ctrl`
+static inline GroupMask groupMatch(const uint8_t* group, uint8_t ctrl) {
+    __m128i g = _mm_loadu_si128((const __m128i*)group);
+    return (GroupMask)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)ctrl)));
+}
+
+// Matches the empty and deleted slots
+static inline GroupMask groupMatchFree(const uint8_t* group) {
+    return (GroupMask)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+}
+#else
+typedef uint64_t GroupMask;
+
+    #define MASK_INDEX(m) (ctz64(m) >> 3)
+    #define LSBS          UINT64_C(0x0101010101010101)
+    #define MSBS          UINT64_C(0x8080808080808080)
+
+static inline uint64_t groupLoad(const uint8_t* group) {
+    uint64_t word = 0;
+    for(int i = 0; i < GROUP_WIDTH; i++) {
+        word |= (uint64_t)group[i] << (i * 8);
+    }
+    return word;
+}
+
+// Matches the slots whose control byte is equal to `ctrl`, using the SWAR test for zero bytes.
+// It can also match a byte above a real match, but only if the byte is `ctrl ^ 1`: for hashes
+// this is a full slot, rejected by the comparison of the keys, and it never happens for empty
+static inline GroupMask groupMatch(const uint8_t* group, uint8_t ctrl) {
+    uint64_t x = groupLoad(group) ^ (LSBS * ctrl);
+    return (x - LSBS) & ~x & MSBS;
+}
+
+// Matches the empty and deleted slots
+static inline GroupMask groupMatchFree(const uint8_t* group) {
+    return groupLoad(group) & MSBS;
+}
+#endif
+
+// Groups are probed in triangular order, that visits all of them since their number is a power
+// of two. The probe for a key stops at the first group that has an empty slot
+#define PROBE_START(t, hash) (H1(hash) & ((t)->sizeMask / GROUP_WIDTH))
+#define PROBE_NEXT(t, g, step) (((g) + (step)) & ((t)->sizeMask / GROUP_WIDTH))
 
 void initHashTable(HashTable* t) {
     *t = (HashTable){0};
 }
 
-void freeHashTable(HashTable* t) {
-    free(t->entries);
+void freeHashTable(JStarVM* vm, HashTable* t) {
+    if(t->entries == NULL) return;
+    gcAllocInternal(vm, MEM_TABLES, t->entries, HASHTABLE_SIZE(t->sizeMask + 1), 0);
+}
+
+// Matches `key` in the group starting at slot `start`
+static inline size_t groupFind(const HashTable* t, size_t start, ObjString* key, uint32_t hash) {
+    for(GroupMask m = groupMatch(t->ctrl + start, H2(hash)); m != 0; m &= m - 1) {
+        size_t i = start + MASK_INDEX(m);
+        ObjString* k = t->entries[i].key;
+        if(k == key || stringEquals(k, key)) return i;
+    }
+    return NO_SLOT;
 }
 
-static Entry* findEntry(Entry* entries, size_t sizeMask, ObjString* key) {
-    size_t i = stringGetHash(key) & sizeMask;
-    Entry* tomb = NULL;
+static size_t findSlot(const HashTable* t, ObjString* key, uint32_t hash) {
+    if(t->entries == NULL) return NO_SLOT;
 
-    for(;;) {
-        Entry* e = &entries[i];
-        if(!e->key) {
-            if(IS_NULL(e->value)) {
-                return tomb ? tomb : e;
-            } else if(!tomb) {
-                tomb = e;
-            }
-        } else if(stringEquals(e->key, key)) {
-            return e;
-        }
-        i = (i + 1) & sizeMask;
+    // Small tables, like those of most instances and classes, are a single group
+    if(t->sizeMask < GROUP_WIDTH) return groupFind(t, 0, key, hash);
+
+    size_t g = PROBE_START(t, hash);
+    for(size_t step = 1;; step++) {
+        size_t i = groupFind(t, g * GROUP_WIDTH, key, hash);
+        if(i != NO_SLOT) return i;
+
+        if(groupMatch(t->ctrl + g * GROUP_WIDTH, CTRL_EMPTY)) return NO_SLOT;
+        g = PROBE_NEXT(t, g, step);
+    }
+}
+
+// Returns the first empty or deleted slot where a key with the given hash can be inserted
+static size_t findFreeSlot(const HashTable* t, uint32_t hash) {
+    size_t g = PROBE_START(t, hash);
+    for(size_t step = 1;; step++) {
+        GroupMask m = groupMatchFree(t->ctrl + g * GROUP_WIDTH);
+        if(m != 0) return g * GROUP_WIDTH + MASK_INDEX(m);
+        g = PROBE_NEXT(t, g, step);
     }
 }
 
-static void growEntries(HashTable* t) {
-    size_t newSize = t->sizeMask ? (t->sizeMask + 1) * GROW_FACTOR : INITIAL_CAPACITY;
-    Entry* newEntries = malloc(sizeof(Entry) * newSize);
+static void insertAt(HashTable* t, size_t i, ObjString* key, uint32_t hash, Value val) {
+    if(t->ctrl[i] == CTRL_EMPTY) t->numEntries++;
+    t->ctrl[i] = H2(hash);
+    t->entries[i] = (Entry){key, val};
+}
 
-    for(size_t i = 0; i < newSize; i++) {
-        newEntries[i] = (Entry){NULL, NULL_VAL};
+static void eraseAt(HashTable* t, size_t i) {
+    // Slots become empty again only in groups that already have an empty slot. Thus, such a
+    // group has never been full, no probe sequence continues past it and no tombstone is needed
+    const uint8_t* group = t->ctrl + (i & ~(size_t)(GROUP_WIDTH - 1));
+    if(groupMatch(group, CTRL_EMPTY)) {
+        t->ctrl[i] = CTRL_EMPTY;
+        t->numEntries--;
+    } else {
+        t->ctrl[i] = CTRL_DELETED;
     }
+    t->entries[i] = (Entry){NULL, NULL_VAL};
+}
 
-    t->numEntries = 0;
-    if(t->sizeMask != 0) {
-        for(size_t i = 0; i <= t->sizeMask; i++) {
-            Entry* e = &t->entries[i];
-            if(!e->key) continue;
+// Rehashes the table dropping deleted slots. The capacity is grown only if live entries fill
+// more than half of the maximum load, otherwise the table is rehashed in place
+static void rehash(JStarVM* vm, HashTable* t) {
+    size_t oldSize = t->entries ? t->sizeMask + 1 : 0;
 
-            Entry* dest = findEntry(newEntries, newSize - 1, e->key);
-            *dest = (Entry){e->key, e->value};
-            t->numEntries++;
-        }
+    size_t live = 0;
+    for(size_t i = 0; i < oldSize; i++) {
+        if(IS_FULL(t->ctrl[i])) live++;
     }
 
-    free(t->entries);
-    t->entries = newEntries;
-    t->sizeMask = newSize - 1;
-}
+    size_t newSize = oldSize ? oldSize : INITIAL_CAPACITY;
+    if(live + 1 > newSize * MAX_LOAD_FACTOR / 2) {
+        newSize *= GROW_FACTOR;
+    }
 
-bool hashTablePut(HashTable* t, ObjString* key, Value val) {
-    if(t->numEntries + 1 > (t->sizeMask + 1) * MAX_LOAD_FACTOR) {
-        growEntries(t);
+    HashTable newTable;
+    newTable.sizeMask = newSize - 1;
+    newTable.numEntries = 0;
+    newTable.entries = gcAllocInternal(vm, MEM_TABLES, NULL, 0, HASHTABLE_SIZE(newSize));
+    newTable.ctrl = (uint8_t*)(newTable.entries + newSize);
+
+    memset(newTable.ctrl, CTRL_EMPTY, newSize);
+    for(size_t i = 0; i < newSize; i++) {
+        newTable.entries[i] = (Entry){NULL, NULL_VAL};
     }
 
-    Entry* e = findEntry(t->entries, t->sizeMask, key);
+    for(size_t i = 0; i < oldSize; i++) {
+        if(!IS_FULL(t->ctrl[i])) continue;
+        Entry* e = &t->entries[i];
+        uint32_t hash = stringGetHash(e->key);
+        insertAt(&newTable, findFreeSlot(&newTable, hash), e->key, hash, e->value);
+    }
 
-    // is it a true empty entry or a tombstone?
-    bool newEntry = !e->key;
-    if(newEntry && IS_NULL(e->value)) {
-        t->numEntries++;
+    freeHashTable(vm, t);
+    *t = newTable;
+}
+
+bool hashTablePut(JStarVM* vm, HashTable* t, ObjString* key, Value val) {
+    uint32_t hash = stringGetHash(key);
+    size_t i = findSlot(t, key, hash);
+    if(i != NO_SLOT) {
+        t->entries[i].value = val;
+        return false;
     }
 
-    *e = (Entry){key, val};
-    return newEntry;
+    if(t->numEntries + 1 > (t->sizeMask + 1) * MAX_LOAD_FACTOR) {
+        rehash(vm, t);
+    }
+
+    insertAt(t, findFreeSlot(t, hash), key, hash, val);
+    return true;
 }
 
 bool hashTableGet(HashTable* t, ObjString* key, Value* res) {
-    if(t->entries == NULL) return false;
-    Entry* e = findEntry(t->entries, t->sizeMask, key);
-    if(!e->key) return false;
-    *res = e->value;
+    size_t i = findSlot(t, key, stringGetHash(key));
+    if(i == NO_SLOT) return false;
+    *res = t->entries[i].value;
     return true;
 }
 
+Value* hashTableGetPtr(HashTable* t, ObjString* key) {
+    size_t i = findSlot(t, key, stringGetHash(key));
+    if(i == NO_SLOT) return NULL;
+    return &t->entries[i].value;
+}
+
 bool hashTableContainsKey(HashTable* t, ObjString* key) {
-    if(t->entries == NULL) return false;
-    return findEntry(t->entries, t->sizeMask, key)->key != NULL;
+    return findSlot(t, key, stringGetHash(key)) != NO_SLOT;
 }
 
 bool hashTableDel(HashTable* t, ObjString* key) {
     if(t->numEntries == 0) return false;
-    Entry* e = findEntry(t->entries, t->sizeMask, key);
-    if(!e->key) return false;
-    *e = (Entry){NULL, TOMB_MARKER};
+    size_t i = findSlot(t, key, stringGetHash(key));
+    if(i == NO_SLOT) return false;
+    eraseAt(t, i);
     return true;
 }
 
-void hashTableMerge(HashTable* t, HashTable* o) {
+void hashTableMerge(JStarVM* vm, HashTable* t, HashTable* o) {
     if(o->entries == NULL) return;
     for(size_t i = 0; i <= o->sizeMask; i++) {
         Entry* e = &o->entries[i];
         if(e->key != NULL) {
-            hashTablePut(t, e->key, e->value);
+            hashTablePut(vm, t, e->key, e->value);
         }
     }
 }
 
 ObjString* hashTableGetString(HashTable* t, const char* str, size_t length, uint32_t hash) {
     if(t->entries == NULL) return NULL;
-    size_t i = hash & t->sizeMask;
-    for(;;) {
-        Entry* e = &t->entries[i];
-        if(!e->key) {
-            if(IS_NULL(e->value)) return NULL;
-        } else if(stringGetHash(e->key) == hash && e->key->length == length &&
-                  memcmp(e->key->data, str, length) == 0) {
-            return e->key;
+
+    size_t g = PROBE_START(t, hash);
+    for(size_t step = 1;; step++) {
+        const uint8_t* group = t->ctrl + g * GROUP_WIDTH;
+
+        for(GroupMask m = groupMatch(group, H2(hash)); m != 0; m &= m - 1) {
+            ObjString* k = t->entries[g * GROUP_WIDTH + MASK_INDEX(m)].key;
+            if(stringGetHash(k) == hash && k->length == length &&
+               memcmp(stringData(k), str, length) == 0) {
+                return k;
+            }
         }
-        i = (i + 1) & t->sizeMask;
-    }
-}
 
-void reachHashTable(JStarVM* vm, HashTable* t) {
-    if(t->entries == NULL) return;
-    for(size_t i = 0; i <= t->sizeMask; i++) {
-        Entry* e = &t->entries[i];
-        reachObject(vm, (Obj*)e->key);
-        reachValue(vm, e->value);
+        if(groupMatch(group, CTRL_EMPTY)) return NULL;
+        g = PROBE_NEXT(t, g, step);
     }
 }
 
-void sweepStrings(HashTable* t) {
+void sweepStrings(HashTable* t, bool minor) {
     if(t->entries == NULL) return;
     for(size_t i = 0; i <= t->sizeMask; i++) {
         Entry* e = &t->entries[i];
-        if(e->key != NULL && !e->key->base.reached) {
-            hashTableDel(t, e->key);
+        if(e->key == NULL || (minor && gcIsOld(&e->key->base))) continue;
+        if(!gcIsMarked(&e->key->base)) {
+            // We are already at the entry, so there's no need to look it up again
+            eraseAt(t, i);
         }
     }
 }
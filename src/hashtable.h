@@ -13,29 +13,38 @@ typedef struct Entry {
     Value value;
 } Entry;
 
+// Open-addressing hashtable in the style of a swiss table. Besides the entries, a control byte
+// per slot stores the low 7 bits of the hash of its key, or marks it as empty or deleted, so that
+// a whole group of slots can be filtered at once before comparing any key.
+// Slots that aren't full always have a NULL key, so the entries can be iterated directly.
 typedef struct HashTable {
-    size_t sizeMask, numEntries;
-    Entry* entries;
+    size_t sizeMask;    // The number of slots minus one
+    size_t numEntries;  // The number of full and deleted slots
+    uint8_t* ctrl;      // The control bytes, allocated in the same block of the entries
+    Entry* entries;     // The entries array
 } HashTable;
 
 // Initialize the hashtable
 void initHashTable(HashTable* t);
 // Free all resources associated with the hashtables
-void freeHashTable(HashTable* t);
+void freeHashTable(JStarVM* vm, HashTable* t);
 // Puts a Value associated with "key" in the hashtable
-bool hashTablePut(HashTable* t, ObjString* key, Value val);
+bool hashTablePut(JStarVM* vm, HashTable* t, ObjString* key, Value val);
 // Gets the value associated with "key" from the hashtable
 bool hashTableGet(HashTable* t, ObjString* key, Value* res);
+// Gets a pointer to the value associated with "key" (NULL if absent). The pointer is only
+// valid until the next insertion of a new key, that can cause the hashtable to grow
+Value* hashTableGetPtr(HashTable* t, ObjString* key);
 // Returns true if the hashtable contains "key", false otherwise
 bool hashTableContainsKey(HashTable* t, ObjString* key);
 // Deletes the value associated with "key" from the hashtable
 bool hashTableDel(HashTable* t, ObjString* key);
 // Adds all key/value pairs in o to t
-void hashTableMerge(HashTable* t, HashTable* o);
+void hashTableMerge(JStarVM* vm, HashTable* t, HashTable* o);
 // Gets a ObjString* given a C string and its hash (used to implement a string pool)
 ObjString* hashTableGetString(HashTable* t, const char* str, size_t length, uint32_t hash);
 
-void reachHashTable(JStarVM* vm, HashTable* t);
-void sweepStrings(HashTable* t);
+// Removes unreached Strings from the hashtable. If minor is true only young Strings are removed
+void sweepStrings(HashTable* t, bool minor);
 
 #endif
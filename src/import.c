@@ -23,8 +23,8 @@ static ObjModule* getOrCreateModule(JStarVM* vm, ObjString* name) {
         setModule(vm, name, module);
         pop(vm);
 
-        hashTablePut(&module->globals, copyString(vm, "__name__", 8), OBJ_VAL(name));
-        hashTableMerge(&module->globals, &vm->core->globals);  // implicitly import core
+        moduleSetGlobal(vm, module, copyString(vm, "__name__", 8), OBJ_VAL(name));
+        hashTableMerge(vm, &module->globals, &vm->core->globals);  // implicitly import core
     }
     return module;
 }
@@ -52,18 +52,19 @@ ObjFunction* deserializeWithModule(JStarVM* vm, const char* path, ObjString* nam
 
 static void registerInParent(JStarVM* vm, ObjModule* mod) {
     ObjString* name = mod->name;
-    const char* lastDot = strrchr(name->data, '.');
+    const char* lastDot = strrchr(stringData(name), '.');
     if(lastDot == NULL) return;  // Not a submodule, nothing to do
 
     const char* simpleName = lastDot + 1;
-    ObjModule* parent = getModule(vm, copyString(vm, name->data, simpleName - name->data - 1));
+    const char* nameData = stringData(name);
+    ObjModule* parent = getModule(vm, copyString(vm, nameData, simpleName - nameData - 1));
     ASSERT(parent, "Submodule parent could not be found.");
     
-    hashTablePut(&parent->globals, copyString(vm, simpleName, strlen(simpleName)), OBJ_VAL(mod));
+    moduleSetGlobal(vm, parent, copyString(vm, simpleName, strlen(simpleName)), OBJ_VAL(mod));
 }
 
 void setModule(JStarVM* vm, ObjString* name, ObjModule* mod) {
-    hashTablePut(&vm->modules, name, OBJ_VAL(mod));
+    hashTablePut(vm, &vm->modules, name, OBJ_VAL(mod));
     registerInParent(vm, mod);
 }
 
@@ -77,8 +78,8 @@ ObjModule* getModule(JStarVM* vm, ObjString* name) {
 
 static void loadNativeExtension(JStarVM* vm, JStarBuffer* modulePath, ObjString* moduleName) {
     const char* moduleDir = strrchr(modulePath->data, '/');
-    const char* lastDot = strrchr(moduleName->data, '.');
-    const char* simpleName = lastDot ? lastDot + 1 : moduleName->data;
+    const char* lastDot = strrchr(stringData(moduleName), '.');
+    const char* simpleName = lastDot ? lastDot + 1 : stringData(moduleName);
 
     jsrBufferTrunc(modulePath, moduleDir - modulePath->data);
     jsrBufferAppendf(modulePath, "/" DL_PREFIX "%s" DL_SUFFIX, simpleName);
@@ -176,7 +177,8 @@ static ObjModule* importModuleOrPackage(JStarVM* vm, ObjString* name) {
     for(size_t i = 0; i < paths->size + 1; i++) {
         if(i < paths->size) {
             if(!IS_STRING(paths->arr[i])) continue;
-            jsrBufferAppendStr(&fullPath, AS_STRING(paths->arr[i])->data);
+            ObjString* path = AS_STRING(paths->arr[i]);
+            jsrBufferAppend(&fullPath, stringData(path), path->length);
             if(fullPath.size > 0 && fullPath.data[fullPath.size - 1] != '/') {
                 jsrBufferAppendChar(&fullPath, '/');
             }
@@ -184,7 +186,7 @@ static ObjModule* importModuleOrPackage(JStarVM* vm, ObjString* name) {
 
         size_t moduleStart = fullPath.size;
         size_t moduleEnd = moduleStart + name->length;
-        jsrBufferAppendStr(&fullPath, name->data);
+        jsrBufferAppendStr(&fullPath, stringData(name));
         jsrBufferReplaceChar(&fullPath, moduleStart, '.', '/');
 
         ImportRes res;
@@ -243,10 +245,10 @@ ObjModule* importModule(JStarVM* vm, ObjString* name) {
     }
 
     size_t len;
-    const char* builtinBytecode = readBuiltInModule(name->data, &len);
+    const char* builtinBytecode = readBuiltInModule(stringData(name), &len);
     if(builtinBytecode != NULL) {
         JStarBuffer code = jsrBufferWrap(vm, builtinBytecode, len);
-        return importBinary(vm, name->data, name, &code);
+        return importBinary(vm, stringData(name), name, &code);
     }
 
     return importModuleOrPackage(vm, name);
@@ -8,6 +8,7 @@
 #include "compiler.h"
 #include "const.h"
 #include "disassemble.h"
+#include "gc.h"
 #include "hashtable.h"
 #include "import.h"
 #include "object.h"
@@ -33,6 +34,14 @@ void jsrPrintErrorCB(JStarVM* vm, JStarResult err, const char* file, int line, c
     fprintf(stderr, "%s\n", error);
 }
 
+void* jsrDefaultReallocCB(void* ptr, size_t oldSize, size_t newSize, void* userData) {
+    if(newSize == 0) {
+        free(ptr);
+        return NULL;
+    }
+    return realloc(ptr, newSize);
+}
+
 static void parseError(const char* file, int line, const char* error, void* udata) {
     JStarVM* vm = udata;
     vm->errorCallback(vm, JSR_SYNTAX_ERR, file, line, error);
@@ -43,8 +52,16 @@ JStarConf jsrGetConf(void) {
     conf.stackSize = STACK_SZ;
     conf.initGC = INIT_GC;
     conf.heapGrowRate = HEAP_GROW_RATE;
+    conf.nurserySize = NURSERY_SZ;
+    conf.gcStepSize = GC_STEP_SZ;
+    conf.gcStepBudget = GC_STEP_BUDGET;
+    conf.gcThreads = GC_THREADS;
+    conf.heapLimit = 0;
+    conf.allocator = &jsrDefaultReallocCB;
+    conf.allocatorData = NULL;
     conf.errorCallback = &jsrPrintErrorCB;
     conf.customData = NULL;
+    conf.optimize = true;
     return conf;
 }
 
@@ -52,6 +69,44 @@ void* jsrGetCustomData(JStarVM* vm) {
     return vm->customData;
 }
 
+JStarMemStats jsrGetMemStats(JStarVM* vm) {
+    JStarMemStats stats;
+    stats.total = vm->allocated;
+    stats.objects = vm->allocatedByCategory[MEM_OBJECTS];
+    stats.tables = vm->allocatedByCategory[MEM_TABLES];
+    stats.code = vm->allocatedByCategory[MEM_CODE];
+    stats.vm = vm->allocatedByCategory[MEM_VM];
+    return stats;
+}
+
+JStarGCStats jsrGetGCStats(JStarVM* vm) {
+    GCStats* gc = &vm->gcStats;
+    JStarGCStats stats;
+    stats.minorCollections = gc->minorCollections;
+    stats.majorCollections = gc->majorCollections;
+    stats.totalPause = gc->totalPause;
+    stats.maxPause = gc->maxPause;
+    stats.bytesAllocated = gc->bytesAllocated;
+    stats.bytesFreed = gc->bytesFreed;
+    stats.liveBytes = gc->liveBytes;
+    stats.heapSize = vm->allocated;
+    stats.nextGC = vm->nextGC;
+    stats.heapGrowRate = vm->heapGrowRate;
+    stats.objectTypes = OBJ_TYPE_COUNT;
+    stats.typeNames = ObjTypeUserNames;
+    stats.objects = gc->objects;
+    return stats;
+}
+
+void jsrSetHeapGrowRate(JStarVM* vm, int heapGrowRate) {
+    ASSERT(heapGrowRate >= 1, "The heap grow rate must be at least 1");
+    vm->heapGrowRate = heapGrowRate;
+}
+
+void jsrSetNextGC(JStarVM* vm, size_t nextGC) {
+    vm->nextGC = nextGC;
+}
+
 JStarResult jsrEvalString(JStarVM* vm, const char* path, const char* src) {
     return jsrEvalModuleString(vm, path, JSR_MAIN_MODULE, src);
 }
@@ -224,7 +279,7 @@ void jsrRaiseException(JStarVM* vm, int slot) {
     ObjInstance* exception = (ObjInstance*)AS_OBJ(exc);
     ObjStackTrace* st = newStackTrace(vm);
     push(vm, OBJ_VAL(st));
-    hashTablePut(&exception->fields, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), OBJ_VAL(st));
+    instanceSetField(vm, exception, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), OBJ_VAL(st));
     pop(vm);
 
     // Place the exception on top of the stack if not already
@@ -242,7 +297,7 @@ void jsrRaise(JStarVM* vm, const char* cls, const char* err, ...) {
     push(vm, OBJ_VAL(exception));
     ObjStackTrace* st = newStackTrace(vm);
     push(vm, OBJ_VAL(st));
-    hashTablePut(&exception->fields, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), OBJ_VAL(st));
+    instanceSetField(vm, exception, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), OBJ_VAL(st));
     pop(vm);
 
     if(err != NULL) {
@@ -256,7 +311,7 @@ void jsrRaise(JStarVM* vm, const char* cls, const char* err, ...) {
 
         ObjString* errorField = copyString(vm, EXC_ERR, strlen(EXC_ERR));
         ObjString* errorString = jsrBufferToString(&error);
-        hashTablePut(&exception->fields, errorField, OBJ_VAL(errorString));
+        instanceSetField(vm, exception, errorField, OBJ_VAL(errorString));
     }
 }
 
@@ -264,13 +319,13 @@ void jsrInitCommandLineArgs(JStarVM* vm, int argc, const char** argv) {
     ObjList* argvList = vm->argv;
     argvList->size = 0;
     for(int i = 0; i < argc; i++) {
-        Value arg = OBJ_VAL(copyString(vm, argv[i], strlen(argv[i])));
+        Value arg = OBJ_VAL(newString(vm, argv[i], strlen(argv[i])));
         listAppend(vm, argvList, arg);
     }
 }
 
 void jsrAddImportPath(JStarVM* vm, const char* path) {
-    listAppend(vm, vm->importPaths, OBJ_VAL(copyString(vm, path, strlen(path))));
+    listAppend(vm, vm->importPaths, OBJ_VAL(newString(vm, path, strlen(path))));
 }
 
 void jsrEnsureStack(JStarVM* vm, size_t needed) {
@@ -349,7 +404,7 @@ bool jsrEquals(JStarVM* vm, int slot1, int slot2) {
 
     Value eqOverload;
     ObjClass* cls = getClass(vm, v1);
-    if(hashTableGet(&cls->methods, vm->methodSyms[SYM_EQ], &eqOverload)) {
+    if(classGetMethod(vm, cls, vm->methodSyms[SYM_EQ], &eqOverload)) {
         push(vm, v1);
         push(vm, v2);
         JStarResult res = jsrCallMethod(vm, "__eq__", 1);
@@ -382,7 +437,7 @@ void jsrPushBoolean(JStarVM* vm, bool boolean) {
 
 void jsrPushStringSz(JStarVM* vm, const char* string, size_t length) {
     validateStack(vm);
-    push(vm, OBJ_VAL(copyString(vm, string, length)));
+    push(vm, OBJ_VAL(newString(vm, string, length)));
 }
 
 void jsrPushString(JStarVM* vm, const char* string) {
@@ -430,6 +485,17 @@ void* jsrPushUserdata(JStarVM* vm, size_t size, void (*finalize)(void*)) {
     return (void*)udata->data;
 }
 
+void* jsrPushTypedArray(JStarVM* vm, JStarArrayType type, size_t length) {
+    validateStack(vm);
+    if(length > typedArrayMaxSize(type)) {
+        jsrRaise(vm, "InvalidArgException", "Typed array of %zu elements is too big", length);
+        return NULL;
+    }
+    ObjTypedArray* arr = newTypedArray(vm, type, length);
+    push(vm, OBJ_VAL(arr));
+    return (void*)arr->data;
+}
+
 void jsrPushNative(JStarVM* vm, const char* module, const char* name, JStarNative nat,
                    uint8_t argc) {
     validateStack(vm);
@@ -458,7 +524,7 @@ int jsrTop(JStarVM* vm) {
 void jsrSetGlobal(JStarVM* vm, const char* module, const char* name) {
     ObjModule* mod = module ? getModule(vm, copyString(vm, module, strlen(module))) : vm->module;
     ASSERT(mod, "Module doesn't exist");
-    hashTablePut(&mod->globals, copyString(vm, name, strlen(name)), peek(vm));
+    moduleSetGlobal(vm, mod, copyString(vm, name, strlen(name)), peek(vm));
 }
 
 bool jsrIter(JStarVM* vm, int iterable, int res, bool* err) {
@@ -590,7 +656,10 @@ void jsrBindNative(JStarVM* vm, int clsSlot, int natSlot) {
     Value nat = apiStackSlot(vm, natSlot);
     ASSERT(IS_CLASS(cls), "clsSlot is not a Class");
     ASSERT(IS_NATIVE(nat), "natSlot is not a Native Function");
-    hashTablePut(&AS_CLASS(cls)->methods, AS_NATIVE(nat)->c.name, nat);
+    hashTablePut(vm, &AS_CLASS(cls)->methods, AS_NATIVE(nat)->c.name, nat);
+    gcWriteBarrier(vm, AS_OBJ(cls), OBJ_VAL(AS_NATIVE(nat)->c.name));
+    gcWriteBarrier(vm, AS_OBJ(cls), nat);
+    vm->methodsVersion++;
 }
 
 void* jsrGetUserdata(JStarVM* vm, int slot) {
@@ -598,6 +667,18 @@ void* jsrGetUserdata(JStarVM* vm, int slot) {
     return (void*)AS_USERDATA(apiStackSlot(vm, slot))->data;
 }
 
+void* jsrGetTypedArrayData(JStarVM* vm, int slot, size_t* length) {
+    ASSERT(IS_TYPED_ARRAY(apiStackSlot(vm, slot)), "slot is not a typed array");
+    ObjTypedArray* arr = AS_TYPED_ARRAY(apiStackSlot(vm, slot));
+    if(length) *length = arr->size;
+    return (void*)arr->data;
+}
+
+JStarArrayType jsrGetTypedArrayType(JStarVM* vm, int slot) {
+    ASSERT(IS_TYPED_ARRAY(apiStackSlot(vm, slot)), "slot is not a typed array");
+    return AS_TYPED_ARRAY(apiStackSlot(vm, slot))->type;
+}
+
 double jsrGetNumber(JStarVM* vm, int slot) {
     ASSERT(IS_NUM(apiStackSlot(vm, slot)), "slot is not a Number");
     return AS_NUM(apiStackSlot(vm, slot));
@@ -605,7 +686,9 @@ double jsrGetNumber(JStarVM* vm, int slot) {
 
 const char* jsrGetString(JStarVM* vm, int slot) {
     ASSERT(IS_STRING(apiStackSlot(vm, slot)), "slot is not a String");
-    return AS_STRING(apiStackSlot(vm, slot))->data;
+    ObjString* str = AS_STRING(apiStackSlot(vm, slot));
+    stringTerminate(vm, str);
+    return stringData(str);
 }
 
 size_t jsrGetStringSz(JStarVM* vm, int slot) {
@@ -673,6 +756,10 @@ bool jsrIsUserdata(JStarVM* vm, int slot) {
     return IS_USERDATA(val);
 }
 
+bool jsrIsTypedArray(JStarVM* vm, int slot) {
+    return IS_TYPED_ARRAY(apiStackSlot(vm, slot));
+}
+
 bool jsrCheckNumber(JStarVM* vm, int slot, const char* name) {
     if(!jsrIsNumber(vm, slot)) JSR_RAISE(vm, "TypeException", "%s must be a number.", name);
     return true;
@@ -728,6 +815,13 @@ bool jsrCheckUserdata(JStarVM* vm, int slot, const char* name) {
     return true;
 }
 
+bool jsrCheckTypedArray(JStarVM* vm, int slot, const char* name) {
+    if(!jsrIsTypedArray(vm, slot)) {
+        JSR_RAISE(vm, "TypeException", "%s must be a typed array.", name);
+    }
+    return true;
+}
+
 size_t jsrCheckIndexNum(JStarVM* vm, double i, size_t max) {
     if(i >= 0 && i < max) return (size_t)i;
     jsrRaise(vm, "IndexOutOfBoundException", "%g.", i);
@@ -8,13 +8,15 @@
 #include "util.h"
 #include "vm.h"
 
+// Length from which the concatenation of two Strings is built in a StringBuffer
+#define STRING_BUFFER_MIN       64
+#define STRING_BUFFER_GROW_RATE 2
+
 static Obj* newObj(JStarVM* vm, size_t size, ObjClass* cls, ObjType type) {
-    Obj* o = GC_ALLOC(vm, size);
+    Obj* o = gcAllocObj(vm, size);
     o->cls = cls;
     o->type = type;
-    o->reached = false;
-    o->next = vm->objects;
-    vm->objects = o;
+    vm->gcStats.objects[type]++;
     return o;
 }
 
@@ -52,6 +54,8 @@ ObjFunction* newFunction(JStarVM* vm, ObjModule* module, uint8_t argc, uint8_t d
     ObjFunction* fun = (ObjFunction*)newObj(vm, sizeof(*fun), vm->funClass, OBJ_FUNCTION);
     initCommon(&fun->c, module, argc, defaults, defCount, varg);
     fun->upvalueCount = 0;
+    fun->handlerCount = 0;
+    fun->stackSize = 0;
     initCode(&fun->code);
     return fun;
 }
@@ -67,13 +71,22 @@ ObjClass* newClass(JStarVM* vm, ObjString* name, ObjClass* superCls) {
     ObjClass* cls = (ObjClass*)newObj(vm, sizeof(*cls), vm->clsClass, OBJ_CLASS);
     cls->name = name;
     cls->superCls = superCls;
+    cls->fieldsHint = 0;
+    cls->cacheVersion = vm->methodsVersion;
     initHashTable(&cls->methods);
+    initHashTable(&cls->methodCache);
     return cls;
 }
 
 ObjInstance* newInstance(JStarVM* vm, ObjClass* cls) {
-    ObjInstance* inst = (ObjInstance*)newObj(vm, sizeof(*inst), cls, OBJ_INST);
-    initHashTable(&inst->fields);
+    size_t inlineCap = cls->fieldsHint;
+    ObjInstance* inst = (ObjInstance*)newVarObj(vm, sizeof(*inst), sizeof(Value), inlineCap, cls,
+                                                OBJ_INST);
+    inst->shape = vm->emptyShape;
+    inst->dict = NULL;
+    inst->fields = inst->inlineFields;
+    inst->capacity = inlineCap;
+    inst->inlineCapacity = inlineCap;
     return inst;
 }
 
@@ -90,11 +103,21 @@ ObjModule* newModule(JStarVM* vm, ObjString* name) {
     ObjModule* module = (ObjModule*)newObj(vm, sizeof(*module), vm->modClass, OBJ_MODULE);
     module->name = name;
     initHashTable(&module->globals);
+    module->globalsVersion = 0;
     module->natives.dynlib = NULL;
     module->natives.registry = NULL;
     return module;
 }
 
+ObjShape* newShape(JStarVM* vm, ObjShape* parent, ObjString* name) {
+    ObjShape* shape = (ObjShape*)newObj(vm, sizeof(*shape), NULL, OBJ_SHAPE);
+    shape->parent = parent;
+    shape->name = name;
+    shape->fieldCount = parent ? parent->fieldCount + 1 : 0;
+    initHashTable(&shape->transitions);
+    return shape;
+}
+
 ObjUpvalue* newUpvalue(JStarVM* vm, Value* addr) {
     ObjUpvalue* upvalue = (ObjUpvalue*)newObj(vm, sizeof(*upvalue), NULL, OBJ_UPVALUE);
     upvalue->addr = addr;
@@ -127,6 +150,30 @@ ObjUserdata* newUserData(JStarVM* vm, size_t size, void (*finalize)(void*)) {
     return udata;
 }
 
+ObjTypedArray* newTypedArray(JStarVM* vm, JStarArrayType type, size_t size) {
+    ASSERT(size <= typedArrayMaxSize(type), "Typed array too big");
+    ObjClass* cls = NULL;
+    switch(type) {
+    case JSR_FLOAT64_ARRAY:
+        cls = vm->f64ArrClass;
+        break;
+    case JSR_INT32_ARRAY:
+        cls = vm->i32ArrClass;
+        break;
+    case JSR_BYTE_ARRAY:
+        cls = vm->byteArrClass;
+        break;
+    }
+
+    size_t elemSize = typedArrayElemSize(type);
+    ObjTypedArray* arr = (ObjTypedArray*)newVarObj(vm, sizeof(*arr), elemSize, size, cls,
+                                                   OBJ_TYPED_ARRAY);
+    arr->type = type;
+    arr->size = size;
+    memset(arr->data, 0, elemSize * size);
+    return arr;
+}
+
 ObjStackTrace* newStackTrace(JStarVM* vm) {
     ObjStackTrace* st = (ObjStackTrace*)newObj(vm, sizeof(*st), vm->stClass, OBJ_STACK_TRACE);
     st->lastTracedFrame = -1;
@@ -180,6 +227,9 @@ void stacktraceDump(JStarVM* vm, ObjStackTrace* st, Frame* f, int depth) {
     if(!record->funcName) {
         record->funcName = copyString(vm, "<main>", 6);
     }
+
+    gcWriteBarrier(vm, (Obj*)st, OBJ_VAL(record->funcName));
+    gcWriteBarrier(vm, (Obj*)st, OBJ_VAL(record->moduleName));
 }
 
 #define LIST_DEF_SZ    8
@@ -209,6 +259,7 @@ void listAppend(JStarVM* vm, ObjList* lst, Value val) {
         pop(vm);
     }
     lst->arr[lst->size++] = val;
+    gcWriteBarrier(vm, (Obj*)lst, val);
 }
 
 void listInsert(JStarVM* vm, ObjList* lst, size_t index, Value val) {
@@ -226,6 +277,7 @@ void listInsert(JStarVM* vm, ObjList* lst, size_t index, Value val) {
 
     arr[index] = val;
     lst->size++;
+    gcWriteBarrier(vm, (Obj*)lst, val);
 }
 
 void listRemove(JStarVM* vm, ObjList* lst, size_t index) {
@@ -236,6 +288,23 @@ void listRemove(JStarVM* vm, ObjList* lst, size_t index) {
     lst->size--;
 }
 
+size_t typedArrayElemSize(JStarArrayType type) {
+    switch(type) {
+    case JSR_FLOAT64_ARRAY:
+        return sizeof(double);
+    case JSR_INT32_ARRAY:
+        return sizeof(int32_t);
+    case JSR_BYTE_ARRAY:
+        return sizeof(uint8_t);
+    }
+    UNREACHABLE();
+    return 0;
+}
+
+size_t typedArrayMaxSize(JStarArrayType type) {
+    return (SIZE_MAX - sizeof(ObjTypedArray)) / typedArrayElemSize(type);
+}
+
 ObjTable* newTable(JStarVM* vm) {
     ObjTable* table = (ObjTable*)newObj(vm, sizeof(*table), vm->tableClass, OBJ_TABLE);
     table->capacityMask = 0;
@@ -245,26 +314,234 @@ ObjTable* newTable(JStarVM* vm) {
     return table;
 }
 
+bool classGetMethod(JStarVM* vm, ObjClass* cls, ObjString* name, Value* res) {
+    if(hashTableGet(&cls->methods, name, res)) {
+        return true;
+    }
+
+    // The cache is dropped as a whole when a method is added to an existing class, since the
+    // class could be one of our superclasses
+    if(cls->cacheVersion != vm->methodsVersion) {
+        freeHashTable(vm, &cls->methodCache);
+        initHashTable(&cls->methodCache);
+        cls->cacheVersion = vm->methodsVersion;
+    }
+
+    if(hashTableGet(&cls->methodCache, name, res)) {
+        return true;
+    }
+
+    for(ObjClass* sup = cls->superCls; sup != NULL; sup = sup->superCls) {
+        if(hashTableGet(&sup->methods, name, res)) {
+            hashTablePut(vm, &cls->methodCache, name, *res);
+            gcWriteBarrier(vm, (Obj*)cls, OBJ_VAL(name));
+            gcWriteBarrier(vm, (Obj*)cls, *res);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Max number of fields an instance can have before switching to dictionary mode
+#define MAX_SHAPE_FIELDS 32
+#define FIELDS_DEF_SZ    4
+#define FIELDS_GROW_RATE 2
+
+int shapeGetFieldIndex(ObjShape* shape, ObjString* name) {
+    for(ObjShape* s = shape; s->parent != NULL; s = s->parent) {
+        if(stringEquals(s->name, name)) {
+            return s->fieldCount - 1;
+        }
+    }
+    return -1;
+}
+
+bool instanceGetField(ObjInstance* inst, ObjString* name, Value* res) {
+    if(inst->shape == NULL) {
+        return hashTableGet(inst->dict, name, res);
+    }
+
+    int idx = shapeGetFieldIndex(inst->shape, name);
+    if(idx == -1) return false;
+
+    *res = inst->fields[idx];
+    return true;
+}
+
+static ObjShape* shapeTransition(JStarVM* vm, ObjShape* shape, ObjString* name) {
+    Value next;
+    if(hashTableGet(&shape->transitions, name, &next)) {
+        return AS_SHAPE(next);
+    }
+
+    ObjShape* newShp = newShape(vm, shape, name);
+    hashTablePut(vm, &shape->transitions, name, OBJ_VAL(newShp));
+    gcWriteBarrier(vm, (Obj*)shape, OBJ_VAL(newShp));
+    return newShp;
+}
+
+static void growFields(JStarVM* vm, ObjInstance* inst) {
+    size_t oldCap = inst->capacity;
+    size_t newCap = oldCap ? oldCap * FIELDS_GROW_RATE : FIELDS_DEF_SZ;
+
+    if(inst->fields == inst->inlineFields) {
+        Value* fields = GC_ALLOC(vm, sizeof(Value) * newCap);
+        memcpy(fields, inst->inlineFields, sizeof(Value) * inst->shape->fieldCount);
+        inst->fields = fields;
+    } else {
+        inst->fields = gcAlloc(vm, inst->fields, sizeof(Value) * oldCap, sizeof(Value) * newCap);
+    }
+
+    inst->capacity = newCap;
+}
+
+static void toDictionaryMode(JStarVM* vm, ObjInstance* inst) {
+    HashTable* dict = gcAllocInternal(vm, MEM_TABLES, NULL, 0, sizeof(HashTable));
+    initHashTable(dict);
+
+    for(ObjShape* s = inst->shape; s->parent != NULL; s = s->parent) {
+        hashTablePut(vm, dict, s->name, inst->fields[s->fieldCount - 1]);
+    }
+
+    if(inst->fields != inst->inlineFields) {
+        GC_FREE_ARRAY(vm, Value, inst->fields, inst->capacity);
+    }
+
+    inst->shape = NULL;
+    inst->dict = dict;
+    inst->fields = inst->inlineFields;
+    inst->capacity = inst->inlineCapacity;
+}
+
+void instanceSetField(JStarVM* vm, ObjInstance* inst, ObjString* name, Value val) {
+    if(inst->shape != NULL) {
+        int idx = shapeGetFieldIndex(inst->shape, name);
+        if(idx != -1) {
+            inst->fields[idx] = val;
+            gcWriteBarrier(vm, (Obj*)inst, val);
+            return;
+        }
+
+        if(inst->shape->fieldCount == MAX_SHAPE_FIELDS) {
+            toDictionaryMode(vm, inst);
+        }
+    }
+
+    if(inst->shape == NULL) {
+        hashTablePut(vm, inst->dict, name, val);
+        gcWriteBarrier(vm, (Obj*)inst, OBJ_VAL(name));
+        gcWriteBarrier(vm, (Obj*)inst, val);
+        return;
+    }
+
+    // Adding a field may trigger a GC, so push all objects as roots
+    push(vm, OBJ_VAL(inst));
+    push(vm, OBJ_VAL(name));
+    push(vm, val);
+
+    ObjShape* shape = shapeTransition(vm, inst->shape, name);
+    if(shape->fieldCount > inst->capacity) {
+        growFields(vm, inst);
+    }
+
+    // Write the value before switching shape, so the instance is always consistent for the GC
+    inst->fields[shape->fieldCount - 1] = val;
+    inst->shape = shape;
+    gcWriteBarrier(vm, (Obj*)inst, val);
+    gcWriteBarrier(vm, (Obj*)inst, OBJ_VAL(shape));
+
+    ObjClass* cls = inst->base.cls;
+    if(shape->fieldCount > cls->fieldsHint) {
+        cls->fieldsHint = shape->fieldCount;
+    }
+
+    pop(vm);
+    pop(vm);
+    pop(vm);
+}
+
+bool moduleSetGlobal(JStarVM* vm, ObjModule* mod, ObjString* name, Value val) {
+    bool isNew = hashTablePut(vm, &mod->globals, name, val);
+    // A new entry may have caused the HashTable to grow, moving the entries around
+    if(isNew) mod->globalsVersion++;
+    return isNew;
+}
+
 ObjString* allocateString(JStarVM* vm, size_t length) {
-    char* data = GC_ALLOC(vm, length + 1);
-    ObjString* str = (ObjString*)newObj(vm, sizeof(*str), vm->strClass, OBJ_STRING);
+    ObjString* str = (ObjString*)newVarObj(vm, sizeof(*str), sizeof(char), length + 1,
+                                           vm->strClass, OBJ_STRING);
     str->length = length;
     str->hash = 0;
     str->interned = false;
-    str->data = data;
-    str->data[str->length] = '\0';
+    str->buffered = false;
+    str->chars[str->length] = '\0';
     return str;
 }
 
+// Returns a String made up of the first `length` bytes of `buf`
+static ObjString* newBufferedString(JStarVM* vm, StringBuffer* buf, size_t length) {
+    ObjString* str = (ObjString*)newVarObj(vm, sizeof(*str), sizeof(StringBuffer*), 1,
+                                           vm->strClass, OBJ_STRING);
+    str->length = length;
+    str->hash = 0;
+    str->interned = false;
+    str->buffered = true;
+    STRING_BUFFER(str) = buf;
+    buf->refCount++;
+    return str;
+}
+
+ObjString* concatStrings(JStarVM* vm, ObjString* s1, ObjString* s2) {
+    size_t length = s1->length + s2->length;
+
+    if(length < STRING_BUFFER_MIN) {
+        ObjString* conc = allocateString(vm, length);
+        memcpy(conc->chars, stringData(s1), s1->length);
+        memcpy(conc->chars + s1->length, stringData(s2), s2->length);
+        return conc;
+    }
+
+    // `s1` is the longest String of its buffer, extend it in place
+    if(IS_BUFFERED_STRING(s1)) {
+        StringBuffer* buf = STRING_BUFFER(s1);
+        if(buf->length == s1->length && length <= buf->capacity) {
+            ObjString* conc = newBufferedString(vm, buf, length);
+            memcpy(buf->chars + s1->length, stringData(s2), s2->length);
+            buf->chars[length] = '\0';
+            buf->length = length;
+            return conc;
+        }
+    }
+
+    // Leave room for the next concatenations
+    size_t capacity = length * STRING_BUFFER_GROW_RATE;
+    StringBuffer* buf = GC_ALLOC(vm, STRING_BUFFER_SIZE(capacity));
+    buf->refCount = 0;
+    buf->length = length;
+    buf->capacity = capacity;
+    memcpy(buf->chars, stringData(s1), s1->length);
+    memcpy(buf->chars + s1->length, stringData(s2), s2->length);
+    buf->chars[length] = '\0';
+    return newBufferedString(vm, buf, length);
+}
+
+ObjString* newString(JStarVM* vm, const char* str, size_t length) {
+    ObjString* s = allocateString(vm, length);
+    memcpy(s->chars, str, length);
+    return s;
+}
+
 ObjString* copyString(JStarVM* vm, const char* str, size_t length) {
     uint32_t hash = hashBytes(str, length);
     ObjString* interned = hashTableGetString(&vm->stringPool, str, length, hash);
     if(interned == NULL) {
         interned = allocateString(vm, length);
-        memcpy(interned->data, str, length);
+        memcpy(interned->chars, str, length);
         interned->hash = hash;
         interned->interned = true;
-        hashTablePut(&vm->stringPool, interned, NULL_VAL);
+        hashTablePut(vm, &vm->stringPool, interned, NULL_VAL);
+        vm->youngInterned++;
     }
     return interned;
 }
@@ -272,16 +549,40 @@ ObjString* copyString(JStarVM* vm, const char* str, size_t length) {
 // Compute and cache an ObjString hash
 uint32_t stringGetHash(ObjString* str) {
     if(str->hash == 0) {
-        uint32_t hash = hashBytes(str->data, str->length);
+        uint32_t hash = hashBytes(stringData(str), str->length);
         str->hash = hash ? hash : hash + 1;  // Reserve hash value `0`
     }
     return str->hash;
 }
 
+void stringTerminate(JStarVM* vm, ObjString* str) {
+    if(!IS_BUFFERED_STRING(str)) return;
+
+    StringBuffer* buf = STRING_BUFFER(str);
+    if(buf->chars[str->length] == '\0') return;
+
+    // The String has been extended in place. If it is the last one pointing into the buffer
+    // it can be shrinked back, otherwise it gets a buffer of its own
+    if(buf->refCount == 1) {
+        buf->length = str->length;
+        buf->chars[str->length] = '\0';
+        return;
+    }
+
+    StringBuffer* own = gcAllocInternal(vm, MEM_OBJECTS, NULL, 0, STRING_BUFFER_SIZE(str->length));
+    own->refCount = 1;
+    own->length = own->capacity = str->length;
+    memcpy(own->chars, buf->chars, str->length);
+    own->chars[str->length] = '\0';
+    buf->refCount--;
+    STRING_BUFFER(str) = own;
+}
+
 // Compare two ObjStrings for equality, short-circuiting if both are interned
 bool stringEquals(ObjString* s1, ObjString* s2) {
     if(s1->interned && s2->interned) return s1 == s2;
-    return s1->length == s2->length ? memcmp(s1->data, s2->data, s1->length) == 0 : false;
+    return s1->length == s2->length ? memcmp(stringData(s1), stringData(s2), s1->length) == 0
+                                    : false;
 }
 
 // Get the value array of a List or a Tuple
@@ -313,14 +614,9 @@ JStarBuffer jsrBufferWrap(JStarVM* vm, const void* data, size_t len) {
 }
 
 ObjString* jsrBufferToString(JStarBuffer* b) {
-    char* data = gcAlloc(b->vm, b->data, b->capacity, b->size + 1);
-    ObjString* s = (ObjString*)newObj(b->vm, sizeof(*s), b->vm->strClass, OBJ_STRING);
-    s->interned = false;
-    s->length = b->size;
-    s->data = data;
-    s->hash = 0;
-    s->data[s->length] = '\0';
-    memset(b, 0, sizeof(JStarBuffer));
+    ObjString* s = allocateString(b->vm, b->size);
+    memcpy(s->chars, b->data, b->size);
+    jsrBufferFree(b);
     return s;
 }
 
@@ -453,13 +749,17 @@ void jsrBufferFree(JStarBuffer* b) {
 
 // Debug logging functions
 
-#ifdef JSTAR_DBG_PRINT_GC
 const char* ObjTypeNames[] = {
-    #define ENUM_STRING(elem) #elem,
+    #define ENUM_STRING(elem, name) #elem,
     OBJTYPE(ENUM_STRING)
     #undef ENUM_STRING
 };
-#endif
+
+const char* ObjTypeUserNames[] = {
+    #define NAME_STRING(elem, name) #name,
+    OBJTYPE(NAME_STRING)
+    #undef NAME_STRING
+};
 
 static void printEscaped(ObjString *s) {
     const char* escaped = "\0\a\b\f\n\r\t\v\\\"";
@@ -467,12 +767,12 @@ static void printEscaped(ObjString *s) {
     for(size_t i = 0; i < s->length; i++) {
         int j;
         for(j = 0; j < 10; j++) {
-            if(s->data[i] == escaped[j]) {
+            if(stringData(s)[i] == escaped[j]) {
                 printf("\\%c", unescaped[j]);
                 break;
             }
         }
-        if(j == 10) printf("%c", s->data[i]);
+        if(j == 10) printf("%c", stringData(s)[i]);
     }
 }
 
@@ -486,34 +786,37 @@ void printObj(Obj* o) {
     case OBJ_FUNCTION: {
         ObjFunction* f = (ObjFunction*)o;
         if(f->c.module->name->length != 0) {
-            printf("<func %s.%s:%d>", f->c.module->name->data, f->c.name->data, f->c.argsCount);
+            printf("<func %s.%s:%d>", stringData(f->c.module->name), stringData(f->c.name),
+                   f->c.argsCount);
         } else {
-            printf("<func %s:%d>", f->c.name->data, f->c.argsCount);
+            printf("<func %s:%d>", stringData(f->c.name), f->c.argsCount);
         }
         break;
     }
     case OBJ_NATIVE: {
         ObjNative* n = (ObjNative*)o;
         if(n->c.module->name->length != 0) {
-            printf("<native %s.%s:%d>", n->c.module->name->data, n->c.name->data, n->c.argsCount);
+            printf("<native %s.%s:%d>", stringData(n->c.module->name), stringData(n->c.name),
+                   n->c.argsCount);
         } else {
-            printf("<native %s:%d>", n->c.name->data, n->c.argsCount);
+            printf("<native %s:%d>", stringData(n->c.name), n->c.argsCount);
         }
         break;
     }
     case OBJ_CLASS: {
         ObjClass* cls = (ObjClass*)o;
-        printf("<class %s %s>", cls->name->data, cls->superCls ? cls->superCls->name->data : "");
+        printf("<class %s %s>", stringData(cls->name),
+               cls->superCls ? stringData(cls->superCls->name) : "");
         break;
     }
     case OBJ_INST: {
         ObjInstance* i = (ObjInstance*)o;
-        printf("<instance %s>", i->base.cls->name->data);
+        printf("<instance %s>", stringData(i->base.cls->name));
         break;
     }
     case OBJ_MODULE: {
         ObjModule* m = (ObjModule*)o;
-        printf("<module %s>", m->name->data);
+        printf("<module %s>", stringData(m->name));
         break;
     }
     case OBJ_LIST: {
@@ -539,14 +842,12 @@ void printObj(Obj* o) {
     case OBJ_TABLE: {
         ObjTable* t = (ObjTable*)o;
         printf("{");
-        if(t->entries != NULL) {
-            for(size_t i = 0; i < t->capacityMask + 1; i++) {
-                if(!IS_NULL(t->entries[i].key)) {
-                    printValue(t->entries[i].key);
-                    printf(" : ");
-                    printValue(t->entries[i].val);
-                    printf(",");
-                }
+        for(size_t i = 0; i < t->numEntries; i++) {
+            if(!IS_NULL(t->entries[i].key)) {
+                printValue(t->entries[i].key);
+                printf(" : ");
+                printValue(t->entries[i].val);
+                printf(",");
             }
         }
         printf("}");
@@ -557,9 +858,9 @@ void printObj(Obj* o) {
 
         char* name;
         if(b->method->type == OBJ_CLOSURE) {
-            name = ((ObjClosure*)b->method)->fn->c.name->data;
+            name = stringData(((ObjClosure*)b->method)->fn->c.name);
         } else {
-            name = ((ObjNative*)b->method)->c.name->data;
+            name = stringData(((ObjNative*)b->method)->c.name);
         }
 
         printf("<bound method ");
@@ -576,8 +877,25 @@ void printObj(Obj* o) {
     case OBJ_UPVALUE:
         printf("<upvalue %p>", (void*)o);
         break;
+    case OBJ_SHAPE:
+        printf("<shape %p>", (void*)o);
+        break;
     case OBJ_USERDATA:
         printf("<userdata %p", (void*)o);
         break;
+    case OBJ_TYPED_ARRAY: {
+        ObjTypedArray* arr = (ObjTypedArray*)o;
+        printf("%s([", stringData(arr->base.cls->name));
+        for(size_t i = 0; i < arr->size; i++) {
+            printValue(typedArrayGet(arr, i));
+            if(i != arr->size - 1) printf(", ");
+        }
+        printf("])");
+        break;
+    }
     }
 }
+
+extern inline char* stringData(ObjString* str);
+extern inline Value typedArrayGet(ObjTypedArray* arr, size_t i);
+extern inline bool typedArraySet(ObjTypedArray* arr, size_t i, double n);
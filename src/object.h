@@ -24,9 +24,8 @@ struct Frame;
  * should be tested before casting.
  */
 
-#ifdef JSTAR_DBG_PRINT_GC
 extern const char* ObjTypeNames[];
-#endif
+extern const char* ObjTypeUserNames[];
 
 // -----------------------------------------------------------------------------
 // OBJECT TESTNG AND CASTING MACROS
@@ -47,6 +46,8 @@ extern const char* ObjTypeNames[];
 #define IS_STACK_TRACE(o)  (IS_OBJ(o) && OBJ_TYPE(o) == OBJ_STACK_TRACE)
 #define IS_TABLE(o)        (IS_OBJ(o) && OBJ_TYPE(o) == OBJ_TABLE)
 #define IS_USERDATA(o)     (IS_OBJ(o) && OBJ_TYPE(o) == OBJ_USERDATA)
+#define IS_TYPED_ARRAY(o)  (IS_OBJ(o) && OBJ_TYPE(o) == OBJ_TYPED_ARRAY)
+#define IS_SHAPE(o)        (IS_OBJ(o) && OBJ_TYPE(o) == OBJ_SHAPE)
 
 #define AS_BOUND_METHOD(o) ((ObjBoundMethod*)AS_OBJ(o))
 #define AS_LIST(o)         ((ObjList*)AS_OBJ(o))
@@ -61,6 +62,8 @@ extern const char* ObjTypeNames[];
 #define AS_STACK_TRACE(o)  ((ObjStackTrace*)AS_OBJ(o))
 #define AS_TABLE(o)        ((ObjTable*)AS_OBJ(o))
 #define AS_USERDATA(o)     ((ObjUserdata*)AS_OBJ(o))
+#define AS_TYPED_ARRAY(o)  ((ObjTypedArray*)AS_OBJ(o))
+#define AS_SHAPE(o)        ((ObjShape*)AS_OBJ(o))
 
 // -----------------------------------------------------------------------------
 // OBJECT DEFINITONS
@@ -70,54 +73,91 @@ extern const char* ObjTypeNames[];
 // These types are used internally by the object system and are never
 // exposed to the user, to whom all values behave like class instances.
 // The enum is defined using X-macros in order to automatically generate
-// string names of enum constats (see ObjTypeNames array in object.c)
-#define OBJTYPE(X)      \
-    X(OBJ_STRING)       \
-    X(OBJ_NATIVE)       \
-    X(OBJ_FUNCTION)     \
-    X(OBJ_CLASS)        \
-    X(OBJ_INST)         \
-    X(OBJ_MODULE)       \
-    X(OBJ_LIST)         \
-    X(OBJ_BOUND_METHOD) \
-    X(OBJ_STACK_TRACE)  \
-    X(OBJ_CLOSURE)      \
-    X(OBJ_UPVALUE)      \
-    X(OBJ_TUPLE)        \
-    X(OBJ_TABLE)        \
-    X(OBJ_USERDATA)
+// string names of enum constats (see ObjTypeNames array in object.c), along with the names used
+// when the types are reported to the user (see ObjTypeUserNames)
+#define OBJTYPE(X)                   \
+    X(OBJ_STRING, String)            \
+    X(OBJ_NATIVE, Native)            \
+    X(OBJ_FUNCTION, Function)        \
+    X(OBJ_CLASS, Class)              \
+    X(OBJ_INST, Instance)            \
+    X(OBJ_MODULE, Module)            \
+    X(OBJ_LIST, List)                \
+    X(OBJ_BOUND_METHOD, BoundMethod) \
+    X(OBJ_STACK_TRACE, StackTrace)   \
+    X(OBJ_CLOSURE, Closure)          \
+    X(OBJ_UPVALUE, Upvalue)          \
+    X(OBJ_TUPLE, Tuple)              \
+    X(OBJ_TABLE, Table)              \
+    X(OBJ_USERDATA, Userdata)        \
+    X(OBJ_TYPED_ARRAY, TypedArray)   \
+    X(OBJ_SHAPE, Shape)
 
 typedef enum ObjType {
-#define ENUM_ELEM(elem) elem,
+#define ENUM_ELEM(elem, name) elem,
     OBJTYPE(ENUM_ELEM)
 #undef ENUM_ELEM
 } ObjType;
 
+// Number of object types
+#define COUNT_ELEM(elem, name) +1
+#define OBJ_TYPE_COUNT   (0 OBJTYPE(COUNT_ELEM))
+
 // Base class of all the Objects.
 // Defines shared properties of all objects, such as the type and the class
-// field, as well as fields used for garbage collection, such as the reached
-// flag (used to test when an object is reachable, and thus not collectable)
-// and the next pointer, that points to the next object in the global linked
-// list of all allocated objects (set up by the allocator in gc.c).
+// field, as well as fields used for garbage collection. The mark bits of the
+// objects are not stored in the objects themselves, but in the bitmaps of the
+// arena pages they are allocated in (see gc.c), so that a collection doesn't
+// write to the memory of the objects it finds reachable.
 struct Obj {
     ObjType type;          // The type of the object
-    bool reached;          // Flag used to signal that an object is reachable during a GC
+    bool large;            // Whether the object is too big to be allocated in an arena page
+    bool remembered;       // Whether the object is in the remembered set
     struct ObjClass* cls;  // The class of the Object
-    struct Obj* next;      // Next object in the linked list of all allocated objects
 };
 
+// Header of the objects too big to be allocated in an arena page, that are allocated right
+// after it. Links all such objects in a list, and holds their GC state.
+typedef struct LargeObj {
+    struct LargeObj *prev, *next;
+    bool marked;  // Whether the object has been reached by the garbage collector
+    bool young;   // Whether the object is in the nursery
+} LargeObj;
+
 // A J* String. In J* Strings are immutable and can contain arbitrary
 // bytes since we explicitly store the string's length instead of relying on
 // NUL termination. Nevertheless, a NUL byte is appended for ease of use in
 // the C api.
+// The bytes are stored inline, so that a String is a single block, except for long Strings
+// built by concatenation, that are stored in a StringBuffer (see below). The data of a String
+// should always be accessed with `stringData`.
 struct ObjString {
     Obj base;
     size_t length;  // Length of the string
-    uint32_t hash;  // The string's hash (gets calculated once at allocation)
+    uint32_t hash;  // The string's hash (computed on first use, 0 until then)
     bool interned;  // Whether the string is interned or not
-    char* data;     // The actual data of the string (NUL terminated)
+    bool buffered;  // Whether the data is stored in a StringBuffer instead of inline
+    char chars[];   // Inline data of the string (NUL terminated, flexible array)
 };
 
+// Storage shared by the Strings obtained by repeatedly appending to a long String, so
+// that `s += piece` doesn't copy `s` every time. Each of these Strings is a prefix of the
+// buffer, and the longest one can be extended in place if there is room left. As a result,
+// a String that has been extended is no longer NUL terminated; `stringTerminate` must be
+// called before handing its data to code expecting a C string.
+typedef struct StringBuffer {
+    size_t refCount;  // Number of Strings pointing into the buffer
+    size_t length;    // Length of the longest String of the buffer
+    size_t capacity;  // Bytes that can be stored, not counting the NUL terminator
+    char chars[];     // The data of the Strings (flexible array)
+} StringBuffer;
+
+// A buffered String stores the pointer to its StringBuffer in place of the inline data, right
+// after the (aligned) end of the ObjString header
+#define STRING_BUFFER_SIZE(capacity) (sizeof(StringBuffer) + (capacity) + 1)
+#define STRING_BUFFER(s)             (*(StringBuffer**)((s) + 1))
+#define IS_BUFFERED_STRING(s)        ((s)->buffered)
+
 // Native C extension. It contains the handle to the dynamic library and resolved
 // symbol to a native registry.
 typedef struct NativeExt {
@@ -127,9 +167,10 @@ typedef struct NativeExt {
 
 typedef struct ObjModule {
     Obj base;
-    ObjString* name;    // Name of the module
-    HashTable globals;  // HashTable containing the global variables of the module
-    NativeExt natives;  // Natives registered in this module
+    ObjString* name;        // Name of the module
+    HashTable globals;      // HashTable containing the global variables of the module
+    size_t globalsVersion;  // Incremented every time a new global is added to `globals`
+    NativeExt natives;      // Natives registered in this module
 } ObjModule;
 
 // Fields shared by all function objects (ObjFunction/ObjNative)
@@ -148,6 +189,8 @@ typedef struct ObjFunction {
     FnCommon c;
     Code code;             // The actual code chunk containing bytecodes
     uint8_t upvalueCount;  // The number of upvalues the function closes over
+    uint8_t handlerCount;  // Max number of exception handlers active at the same time
+    uint16_t stackSize;    // Max number of stack slots used on top of the arguments
 } ObjFunction;
 
 // A C function callable from J*
@@ -156,18 +199,46 @@ typedef struct ObjNative {
     JStarNative fn;  // The C function that gets called
 } ObjNative;
 
-// A user defined class
+// A user defined class. Only the methods defined by the class itself are stored in `methods`,
+// inherited ones are looked up in the superclasses and cached in `methodCache`
 typedef struct ObjClass {
     Obj base;
     ObjString* name;            // The name of the class
     struct ObjClass* superCls;  // Pointer to the parent class (or NULL)
     HashTable methods;          // HashTable containing methods (ObjFunction/ObjNative)
+    HashTable methodCache;      // Inherited methods resolved so far
+    size_t cacheVersion;        // Methods version of the VM the cache is valid for
+    size_t fieldsHint;          // Number of fields instances usually have (used to presize them)
 } ObjClass;
 
-// An instance of a user defined Class
+// A shape (or hidden class) describes the layout of the fields of an instance.
+// Shapes form a tree rooted in the empty shape: adding a field to an instance
+// transitions it to the child shape obtained by appending the field's name.
+// Instances that get the same fields in the same order thus share the same shape,
+// and their fields can be stored in a plain array of Values indexed by the shape.
+// Shapes are never exposed to the user and, since they are always reachable from
+// the root shape, live as long as the VM.
+typedef struct ObjShape {
+    Obj base;
+    struct ObjShape* parent;  // The shape this one transitioned from (NULL for the root)
+    ObjString* name;          // The name of the field added by this shape (NULL for the root)
+    size_t fieldCount;        // Number of fields described by the shape
+    HashTable transitions;    // Maps field names to the shapes obtained by adding them
+} ObjShape;
+
+// An instance of a user defined Class.
+// Fields are stored in the `fields` array, laid out as described by the instance's
+// shape. The array initially points to the inline storage, sized after the class's
+// fieldsHint, and is moved to the heap if it overflows. Instances with a large number
+// of fields switch to dictionary mode, where fields are stored in a HashTable instead.
 typedef struct ObjInstance {
     Obj base;
-    HashTable fields;  // HashTable containing the fields of the instance
+    ObjShape* shape;          // The shape of the instance (NULL when in dictionary mode)
+    HashTable* dict;          // The fields of the instance when in dictionary mode
+    Value* fields;            // Field values, indexed as described by `shape`
+    uint32_t capacity;        // Number of slots allocated in `fields`
+    uint32_t inlineCapacity;  // Number of slots of the inline storage
+    Value inlineFields[];     // Inline storage for the fields (flexible array)
 } ObjInstance;
 
 typedef struct ObjList {
@@ -184,18 +255,33 @@ typedef struct ObjTuple {
 } ObjTuple;
 
 typedef struct TableEntry {
-    Value key;  // The key of the entry
-    Value val;  // The actual value
+    Value key;      // The key of the entry
+    Value val;      // The actual value
+    uint32_t hash;  // Cached hash of the key, used when probing and when growing the table
 } TableEntry;
 
+// A J* Table. Entries are stored densely in insertion order, and are followed in the same
+// block by an open-addressed index whose slots hold the position of an entry plus one (0 marks
+// an empty slot). Slots are 1, 2, 4 or 8 bytes wide depending on the capacity of the index.
+// Deleted entries have a null key and are left in place until the Table is rebuilt.
 typedef struct ObjTable {
     Obj base;
-    size_t capacityMask;  // The size of the entries array
-    size_t numEntries;    // The number of entries in the Table (including tombstones)
-    size_t size;          // The number of actual entries in the Table (i.e. excluding tombstones)
-    TableEntry* entries;  // The actual array of entries
+    size_t capacityMask;  // The number of slots of the index minus one
+    size_t numEntries;    // The number of entries in the entries array (including deleted ones)
+    size_t size;          // The number of actual entries in the Table (i.e. excluding deleted)
+    TableEntry* entries;  // The entries array, followed by the index
 } ObjTable;
 
+#define TABLE_MAX_ENTRIES(capacity) ((capacity) / 4 * 3)
+#define TABLE_INDEX_WIDTH(capacity)                               \
+    (TABLE_MAX_ENTRIES(capacity) < UINT8_MAX    ? sizeof(uint8_t)  \
+     : TABLE_MAX_ENTRIES(capacity) < UINT16_MAX ? sizeof(uint16_t) \
+     : TABLE_MAX_ENTRIES(capacity) < UINT32_MAX ? sizeof(uint32_t) \
+                                                 : sizeof(uint64_t))
+#define TABLE_BLOCK_SIZE(capacity) \
+    (sizeof(TableEntry) * TABLE_MAX_ENTRIES(capacity) + TABLE_INDEX_WIDTH(capacity) * (capacity))
+#define TABLE_INDEX(t) ((void*)((t)->entries + TABLE_MAX_ENTRIES((t)->capacityMask + 1)))
+
 // A bound method. It contains a method with an associated target.
 typedef struct ObjBoundMethod {
     Obj base;
@@ -251,6 +337,15 @@ typedef struct ObjUserdata {
     uint8_t data[];           // The data
 } ObjUserdata;
 
+// Array of unboxed numbers of type `type`, stored contiguously in `data`.
+// `data` follows a size_t, so it is suitably aligned for all the element types
+typedef struct ObjTypedArray {
+    Obj base;
+    JStarArrayType type;  // The type of the elements
+    size_t size;          // The number of elements
+    uint8_t data[];       // The elements
+} ObjTypedArray;
+
 // -----------------------------------------------------------------------------
 // OBJECT ALLOCATION FUNCTIONS
 // -----------------------------------------------------------------------------
@@ -261,11 +356,13 @@ typedef struct ObjUserdata {
 ObjFunction* newFunction(JStarVM* vm, ObjModule* module, uint8_t argc, uint8_t defCount, bool varg);
 ObjNative* newNative(JStarVM* vm, ObjModule* module, uint8_t argc, uint8_t defCount, bool varg);
 ObjUserdata* newUserData(JStarVM* vm, size_t size, void (*finalize)(void*));
+ObjTypedArray* newTypedArray(JStarVM* vm, JStarArrayType type, size_t size);
 ObjClass* newClass(JStarVM* vm, ObjString* name, ObjClass* superCls);
 ObjBoundMethod* newBoundMethod(JStarVM* vm, Value b, Obj* method);
 ObjInstance* newInstance(JStarVM* vm, ObjClass* cls);
 ObjClosure* newClosure(JStarVM* vm, ObjFunction* fn);
 ObjModule* newModule(JStarVM* vm, ObjString* name);
+ObjShape* newShape(JStarVM* vm, ObjShape* parent, ObjString* name);
 ObjUpvalue* newUpvalue(JStarVM* vm, Value* addr);
 ObjList* newList(JStarVM* vm, size_t capacity);
 ObjTuple* newTuple(JStarVM* vm, size_t size);
@@ -273,7 +370,13 @@ ObjStackTrace* newStackTrace(JStarVM* vm);
 ObjTable* newTable(JStarVM* vm);
 
 ObjString* allocateString(JStarVM* vm, size_t length);
+// Returns a new String holding a copy of `str`. Its hash is computed lazily
+ObjString* newString(JStarVM* vm, const char* str, size_t length);
+// Returns the interned String equal to `str`, creating it if needed. Only used for the Strings
+// that are looked up by identity, like identifiers and constants
 ObjString* copyString(JStarVM* vm, const char* str, size_t length);
+// Returns the concatenation of `s1` and `s2`, that must be reachable by the garbage collector
+ObjString* concatStrings(JStarVM* vm, ObjString* s1, ObjString* s2);
 
 // -----------------------------------------------------------------------------
 // OBJECT FUNCTIONS
@@ -287,10 +390,80 @@ void listAppend(JStarVM* vm, ObjList* lst, Value v);
 void listInsert(JStarVM* vm, ObjList* lst, size_t index, Value val);
 void listRemove(JStarVM* vm, ObjList* lst, size_t index);
 
+// ObjTypedArray functions
+// Returns the size in bytes of an element of a typed array of type `type`
+size_t typedArrayElemSize(JStarArrayType type);
+
+// Returns the max number of elements of a typed array of type `type`, past which its size in
+// bytes overflows a size_t
+size_t typedArrayMaxSize(JStarArrayType type);
+
+inline Value typedArrayGet(ObjTypedArray* arr, size_t i) {
+    switch(arr->type) {
+    case JSR_FLOAT64_ARRAY:
+        return NUM_VAL(((double*)arr->data)[i]);
+    case JSR_INT32_ARRAY:
+        return NUM_VAL(((int32_t*)arr->data)[i]);
+    case JSR_BYTE_ARRAY:
+        return NUM_VAL(arr->data[i]);
+    }
+    return NULL_VAL;
+}
+
+// Stores `n` at index `i`. Returns false, leaving the array unchanged, if the element type can't
+// represent `n` exactly (i.e. it isn't an integer in the range of an integer element type)
+inline bool typedArraySet(ObjTypedArray* arr, size_t i, double n) {
+    switch(arr->type) {
+    case JSR_FLOAT64_ARRAY:
+        ((double*)arr->data)[i] = n;
+        return true;
+    case JSR_INT32_ARRAY:
+        // The range is checked first, as converting an out of range double is undefined
+        if(!(n >= INT32_MIN && n <= INT32_MAX) || (int32_t)n != n) return false;
+        ((int32_t*)arr->data)[i] = (int32_t)n;
+        return true;
+    case JSR_BYTE_ARRAY:
+        if(!(n >= 0 && n <= UINT8_MAX) || (uint8_t)n != n) return false;
+        arr->data[i] = (uint8_t)n;
+        return true;
+    }
+    return false;
+}
+
+// ObjClass functions
+// Gets the method `name` of the class, looking it up in the superclasses if the class doesn't
+// define it. Returns false if no class in the hierarchy defines the method
+bool classGetMethod(JStarVM* vm, ObjClass* cls, ObjString* name, Value* res);
+
+// ObjInstance functions
+// Gets the field `name` of the instance, returning false if it doesn't exist
+bool instanceGetField(ObjInstance* inst, ObjString* name, Value* res);
+// Sets the field `name` of the instance, transitioning it to a new shape if the field is
+// new. Both the instance and `val` must be reachable by the GC, as this function allocates
+void instanceSetField(JStarVM* vm, ObjInstance* inst, ObjString* name, Value val);
+
+// ObjShape functions
+// Returns the index of the field `name` in instances of this shape, or -1 if absent
+int shapeGetFieldIndex(ObjShape* shape, ObjString* name);
+
+// ObjModule functions
+// Sets a global variable in the module, returning true if the variable wasn't defined before.
+// Always use this function instead of directly modifying `globals`, as it takes care of
+// invalidating the inline caches that point into the HashTable
+bool moduleSetGlobal(JStarVM* vm, ObjModule* mod, ObjString* name, Value val);
+
 // ObjString functions
 uint32_t stringGetHash(ObjString* str);
 bool stringEquals(ObjString* s1, ObjString* s2);
 
+// Returns the data of `str` (see StringBuffer for when it is NUL terminated)
+inline char* stringData(ObjString* str) {
+    return IS_BUFFERED_STRING(str) ? STRING_BUFFER(str)->chars : str->chars;
+}
+
+// Makes sure that the data of `str` is NUL terminated (see StringBuffer)
+void stringTerminate(JStarVM* vm, ObjString* str);
+
 // Get the value array of a List or a Tuple
 Value* getValues(Obj* obj, size_t* size);
 
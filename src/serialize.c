@@ -61,7 +61,7 @@ static void serializeString(JStarBuffer* buf, ObjString* str) {
     } else {
         serializeUint64(buf, (uint64_t)str->length);
     }
-    write(buf, str->data, str->length);
+    write(buf, stringData(str), str->length);
 }
 
 static void serializeConstLiteral(JStarBuffer* buf, Value c) {
@@ -115,6 +115,13 @@ static void serializeConstants(JStarBuffer* buf, ValueArray* consts) {
     }
 }
 
+static void serializeSymbols(JStarBuffer* buf, Code* c) {
+    serializeShort(buf, c->symbolCount);
+    for(size_t i = 0; i < c->symbolCount; i++) {
+        serializeShort(buf, c->symbols[i].constant);
+    }
+}
+
 static void serializeCode(JStarBuffer* buf, Code* c) {
     // TODO: store (compressed) line information? maybe give option in application
 
@@ -125,11 +132,14 @@ static void serializeCode(JStarBuffer* buf, Code* c) {
     }
 
     serializeConstants(buf, &c->consts);
+    serializeSymbols(buf, c);
 }
 
 static void serializeFunction(JStarBuffer* buf, ObjFunction* f) {
     serializeCommon(buf, &f->c);
     serializeByte(buf, f->upvalueCount);
+    serializeByte(buf, f->handlerCount);
+    serializeShort(buf, f->stackSize);
     serializeCode(buf, &f->code);
 }
 
@@ -144,6 +154,7 @@ JStarBuffer serialize(JStarVM* vm, ObjFunction* fn) {
     serializeCString(&buf, SER_FILE_HEADER);
     serializeByte(&buf, JSTAR_VERSION_MAJOR);
     serializeByte(&buf, JSTAR_VERSION_MINOR);
+    serializeByte(&buf, SER_FORMAT_VERSION);
     serializeFunction(&buf, fn);
 
     jsrBufferShrinkToFit(&buf);
@@ -325,7 +336,7 @@ static bool deserializeConstants(Deserializer* d, ValueArray* consts) {
     uint16_t constsSize;
     if(!deserializeShort(d, &constsSize)) return false;
 
-    consts->arr = malloc(sizeof(Value) * constsSize);
+    consts->arr = gcAllocInternal(d->vm, MEM_CODE, NULL, 0, sizeof(Value) * constsSize);
     zeroValueArray(consts->arr, constsSize);
     consts->capacity = constsSize;
     consts->size = constsSize;
@@ -356,16 +367,35 @@ static bool deserializeConstants(Deserializer* d, ValueArray* consts) {
     return true;
 }
 
+static bool deserializeSymbols(Deserializer* d, Code* c) {
+    uint16_t symbolCount;
+    if(!deserializeShort(d, &symbolCount)) return false;
+
+    c->symbols = gcAllocInternal(d->vm, MEM_CODE, NULL, 0, sizeof(Symbol) * symbolCount);
+    c->symbolCapacity = symbolCount;
+
+    // Count the symbols as they are read, so that a partially read Code can be freed safely
+    for(int i = 0; i < symbolCount; i++) {
+        uint16_t constant;
+        if(!deserializeShort(d, &constant)) return false;
+        if(constant >= c->consts.size) return false;
+        c->symbols[c->symbolCount++] = (Symbol){constant, false, {NULL, 0, {NULL}}, NULL};
+    }
+
+    return true;
+}
+
 static bool deserializeCode(Deserializer* d, Code* c) {
     uint64_t codeSize;
     if(!deserializeUint64(d, &codeSize)) return false;
 
-    c->bytecode = malloc(codeSize);
+    c->bytecode = gcAllocInternal(d->vm, MEM_CODE, NULL, 0, codeSize);
     c->size = codeSize;
     c->capacity = codeSize;
 
     if(!read(d, c->bytecode, codeSize)) return false;
     if(!deserializeConstants(d, &c->consts)) return false;
+    if(!deserializeSymbols(d, c)) return false;
 
     return true;
 }
@@ -389,6 +419,16 @@ static bool deserializeFunction(Deserializer* d, ObjFunction** out) {
         return false;
     }
 
+    if(!deserializeByte(d, &fn->handlerCount)) {
+        pop(vm);
+        return false;
+    }
+
+    if(!deserializeShort(d, &fn->stackSize)) {
+        pop(vm);
+        return false;
+    }
+
     if(!deserializeCode(d, &fn->code)) {
         pop(vm);
         return false;
@@ -410,11 +450,13 @@ ObjFunction* deserialize(JStarVM* vm, ObjModule* mod, const JStarBuffer* buf, JS
     if(!read(&d, header, SER_HEADER_SIZE)) return NULL;
     ASSERT(memcmp(header, SER_FILE_HEADER, SER_HEADER_SIZE) == 0, "Header error");
 
-    uint8_t versionMajor, versionMinor;
+    uint8_t versionMajor, versionMinor, formatVersion;
     if(!deserializeByte(&d, &versionMajor)) return NULL;
     if(!deserializeByte(&d, &versionMinor)) return NULL;
+    if(!deserializeByte(&d, &formatVersion)) return NULL;
 
-    if(versionMajor != JSTAR_VERSION_MAJOR || versionMinor != JSTAR_VERSION_MINOR) {
+    if(versionMajor != JSTAR_VERSION_MAJOR || versionMinor != JSTAR_VERSION_MINOR ||
+       formatVersion != SER_FORMAT_VERSION) {
         *err = JSR_VERSION_ERR;
         return NULL;
     }
@@ -9,6 +9,11 @@
 #define SER_FILE_HEADER "\xb5JsrC"
 #define SER_HEADER_SIZE (sizeof(SER_FILE_HEADER) - 1)
 
+// Version of the compiled code format, written after the J* version. Bump it whenever the
+// opcodes or the layout of serialized functions change, even within the same J* version.
+// It starts at 1: older files have the arg count of the module function, always 0, in its place
+#define SER_FORMAT_VERSION 1
+
 JStarBuffer serialize(JStarVM* vm, ObjFunction* f);
 ObjFunction* deserialize(JStarVM* vm, ObjModule* mod, const JStarBuffer* buf, JStarResult* err);
 bool isCompiledCode(const JStarBuffer* buf);
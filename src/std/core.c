@@ -28,7 +28,7 @@ static ObjClass* createClass(JStarVM* vm, ObjModule* m, ObjClass* sup, const cha
     push(vm, OBJ_VAL(n));
     ObjClass* c = newClass(vm, n, sup);
     pop(vm);
-    hashTablePut(&m->globals, n, OBJ_VAL(c));
+    moduleSetGlobal(vm, m, n, OBJ_VAL(c));
     return c;
 }
 
@@ -38,6 +38,20 @@ static Value getDefinedName(JStarVM* vm, ObjModule* m, const char* name) {
     return v;
 }
 
+static void patchClass(JStarVM* vm, Obj* o) {
+    if(o->type == OBJ_STRING) {
+        o->cls = vm->strClass;
+    } else if(o->type == OBJ_LIST) {
+        o->cls = vm->lstClass;
+    } else if(o->type == OBJ_CLOSURE || o->type == OBJ_FUNCTION || o->type == OBJ_NATIVE) {
+        o->cls = vm->funClass;
+    }
+
+    // Ensure all allocated object do actually have a class reference!
+    // (shapes are internal to the VM, and thus are the only ones without)
+    ASSERT(o->cls || o->type == OBJ_SHAPE, "Object without class reference");
+}
+
 static void defMethod(JStarVM* vm, ObjModule* m, ObjClass* cls, JStarNative nat, const char* name,
                       uint8_t argc) {
     ObjString* strName = copyString(vm, name, strlen(name));
@@ -46,7 +60,10 @@ static void defMethod(JStarVM* vm, ObjModule* m, ObjClass* cls, JStarNative nat,
     native->c.name = strName;
     native->fn = nat;
     pop(vm);
-    hashTablePut(&cls->methods, strName, OBJ_VAL(native));
+    hashTablePut(vm, &cls->methods, strName, OBJ_VAL(native));
+    gcWriteBarrier(vm, (Obj*)cls, OBJ_VAL(strName));
+    gcWriteBarrier(vm, (Obj*)cls, OBJ_VAL(native));
+    vm->methodsVersion++;
 }
 
 static uint64_t hash64(uint64_t x) {
@@ -86,7 +103,7 @@ static JSR_NATIVE(jsr_Object_string) {
     Obj* o = AS_OBJ(vm->apiStack[0]);
     JStarBuffer str;
     jsrBufferInit(vm, &str);
-    jsrBufferAppendf(&str, "<%s@%p>", o->cls->name->data, (void*)o);
+    jsrBufferAppendf(&str, "<%s@%p>", stringData(o->cls->name), (void*)o);
     jsrBufferPush(&str);
     return true;
 }
@@ -113,7 +130,7 @@ static JSR_NATIVE(jsr_Class_string) {
     Obj* o = AS_OBJ(vm->apiStack[0]);
     JStarBuffer str;
     jsrBufferInit(vm, &str);
-    jsrBufferAppendf(&str, "<Class %s@%p>", ((ObjClass*)o)->name->data, (void*)o);
+    jsrBufferAppendf(&str, "<Class %s@%p>", stringData(((ObjClass*)o)->name), (void*)o);
     jsrBufferPush(&str);
     return true;
 }
@@ -141,7 +158,7 @@ void initCoreModule(JStarVM* vm) {
 
     // Patch up Class object information
     vm->clsClass->superCls = vm->objClass;
-    hashTableMerge(&vm->clsClass->methods, &vm->objClass->methods);
+    gcRememberObject(vm, (Obj*)vm->clsClass);
     defMethod(vm, core, vm->clsClass, &jsr_Class_getName, "getName", 0);
     defMethod(vm, core, vm->clsClass, &jsr_Class_string, "__string__", 0);
 
@@ -169,6 +186,10 @@ void initCoreModule(JStarVM* vm) {
     vm->excClass = AS_CLASS(getDefinedName(vm, core, "Exception"));
     vm->tableClass = AS_CLASS(getDefinedName(vm, core, "Table"));
     vm->udataClass = AS_CLASS(getDefinedName(vm, core, "Userdata"));
+    vm->typedArrClass = AS_CLASS(getDefinedName(vm, core, "TypedArray"));
+    vm->f64ArrClass = AS_CLASS(getDefinedName(vm, core, "Float64Array"));
+    vm->i32ArrClass = AS_CLASS(getDefinedName(vm, core, "Int32Array"));
+    vm->byteArrClass = AS_CLASS(getDefinedName(vm, core, "ByteArray"));
     core->base.cls = vm->modClass;
 
     // Cache core module global objects in vm
@@ -177,18 +198,7 @@ void initCoreModule(JStarVM* vm) {
 
     // Patch up the class field of any object that was allocated
     // before the creation of its corresponding class object
-    for(Obj* o = vm->objects; o != NULL; o = o->next) {
-        if(o->type == OBJ_STRING) {
-            o->cls = vm->strClass;
-        } else if(o->type == OBJ_LIST) {
-            o->cls = vm->lstClass;
-        } else if(o->type == OBJ_CLOSURE || o->type == OBJ_FUNCTION || o->type == OBJ_NATIVE) {
-            o->cls = vm->funClass;
-        }
-
-        // Ensure all allocated object do actually have a class reference!
-        ASSERT(o->cls, "Object without class reference");
-    }
+    gcForEachObject(vm, patchClass);
 }
 
 // -----------------------------------------------------------------------------
@@ -301,13 +311,13 @@ JSR_NATIVE(jsr_Function_string) {
     jsrBufferInit(vm, &str);
 
     void* objPtr = (void*)obj;
-    bool isCoreModule = strcmp(fn->module->name->data, JSR_CORE_MODULE) == 0;
+    bool isCoreModule = strcmp(stringData(fn->module->name), JSR_CORE_MODULE) == 0;
 
     if(isCoreModule) {
-        jsrBufferAppendf(&str, "<%s %s@%p>", fnType, fn->name->data, objPtr);
+        jsrBufferAppendf(&str, "<%s %s@%p>", fnType, stringData(fn->name), objPtr);
     } else {
-        jsrBufferAppendf(&str, "<%s %s.%s@%p>", fnType, fn->module->name->data, fn->name->data,
-                         objPtr);
+        jsrBufferAppendf(&str, "<%s %s.%s@%p>", fnType, stringData(fn->module->name),
+                         stringData(fn->name), objPtr);
     }
 
     jsrBufferPush(&str);
@@ -320,13 +330,130 @@ JSR_NATIVE(jsr_Module_string) {
     ObjModule* m = AS_MODULE(vm->apiStack[0]);
     JStarBuffer str;
     jsrBufferInit(vm, &str);
-    jsrBufferAppendf(&str, "<module %s@%p>", m->name->data, (void*)m);
+    jsrBufferAppendf(&str, "<module %s@%p>", stringData(m->name), (void*)m);
     jsrBufferPush(&str);
     return true;
 }
 // end
 
+// class Range
+static bool getRangeField(JStarVM* vm, ObjInstance* range, MethodSymbol sym, double* out) {
+    Value field;
+    if(!instanceGetField(range, vm->methodSyms[sym], &field) || !IS_NUM(field)) {
+        return false;
+    }
+    *out = AS_NUM(field);
+    return true;
+}
+
+bool getRangeBounds(JStarVM* vm, Value range, double* start, double* stop, double* step) {
+    if(!IS_INSTANCE(range)) return false;
+    ObjInstance* inst = AS_INSTANCE(range);
+    return getRangeField(vm, inst, SYM_RANGE_START, start) &&
+           getRangeField(vm, inst, SYM_RANGE_STOP, stop) &&
+           getRangeField(vm, inst, SYM_RANGE_STEP, step) && *step != 0;
+}
+
+static bool checkRangeBounds(JStarVM* vm, int slot, double* start, double* stop, double* step) {
+    if(!getRangeBounds(vm, apiStackSlot(vm, slot), start, stop, step)) {
+        JSR_RAISE(vm, "TypeException", "Range bounds must be numbers and step must not be 0");
+    }
+    return true;
+}
+
+static double rangeLength(double start, double stop, double step) {
+    double length = ceil((stop - start) / step);
+    return length > 0 ? length : 0;
+}
+
+// Returns true if `v` is a Range iterated with the builtin `__iter__` and `__next__`
+static bool isBuiltinRange(JStarVM* vm, Value v) {
+    if(!IS_INSTANCE(v)) return false;
+
+    Value iter, next;
+    ObjClass* cls = AS_OBJ(v)->cls;
+    if(!classGetMethod(vm, cls, vm->methodSyms[SYM_ITER], &iter) ||
+       !classGetMethod(vm, cls, vm->methodSyms[SYM_NEXT], &next)) {
+        return false;
+    }
+
+    return IS_NATIVE(iter) && AS_NATIVE(iter)->fn == &jsr_Range_iter && IS_NATIVE(next) &&
+           AS_NATIVE(next)->fn == &jsr_Range_next;
+}
+
+JSR_NATIVE(jsr_Range_new) {
+    JSR_CHECK(Number, 1, "start");
+    JSR_CHECK(Number, 3, "step");
+
+    // Range(stop) iterates from 0 to `stop`
+    bool stopOnly = jsrIsNull(vm, 2);
+    if(!stopOnly) {
+        JSR_CHECK(Number, 2, "stop");
+    }
+    if(jsrGetNumber(vm, 3) == 0) {
+        JSR_RAISE(vm, "InvalidArgException", "step cannot be 0");
+    }
+
+    if(stopOnly) {
+        jsrPushNumber(vm, 0);
+    } else {
+        jsrPushValue(vm, 1);
+    }
+    jsrSetField(vm, 0, M_RANGE_START);
+    jsrPop(vm);
+
+    jsrPushValue(vm, stopOnly ? 1 : 2);
+    jsrSetField(vm, 0, M_RANGE_STOP);
+    jsrPop(vm);
+
+    jsrPushValue(vm, 3);
+    jsrSetField(vm, 0, M_RANGE_STEP);
+    jsrPop(vm);
+
+    jsrPushValue(vm, 0);
+    return true;
+}
+
+JSR_NATIVE(jsr_Range_len) {
+    double start, stop, step;
+    if(!checkRangeBounds(vm, 0, &start, &stop, &step)) return false;
+    jsrPushNumber(vm, rangeLength(start, stop, step));
+    return true;
+}
+
+// The iterator of a Range is its current element.
+// Keep in sync with the counted loop fast path of OP_FOR_ITER in vm.c
+JSR_NATIVE(jsr_Range_iter) {
+    double start, stop, step;
+    if(!checkRangeBounds(vm, 0, &start, &stop, &step)) return false;
+
+    Value iter = vm->apiStack[1];
+    if(!IS_NULL(iter) && !IS_NUM(iter)) {
+        jsrPushBoolean(vm, false);
+        return true;
+    }
+
+    double i = IS_NULL(iter) ? start : AS_NUM(iter) + step;
+    if(step > 0 ? i < stop : i > stop) {
+        jsrPushNumber(vm, i);
+    } else {
+        jsrPushBoolean(vm, false);
+    }
+    return true;
+}
+
+JSR_NATIVE(jsr_Range_next) {
+    jsrPushValue(vm, 1);
+    return true;
+}
+// end
+
 // class List
+
+// Max number of elements a List of a known size is allocated with upfront. Longer Lists grow as
+// they are filled, so that the heap limit is enforced before all of the memory is taken
+#define LIST_PRESIZE_MAX (1 << 20)
+
 JSR_NATIVE(jsr_List_new) {
     if(jsrIsNull(vm, 1)) {
         jsrPushList(vm);
@@ -336,21 +463,38 @@ JSR_NATIVE(jsr_List_new) {
             JSR_RAISE(vm, "TypeException", "size must be >= 0");
         }
 
-        ObjList* lst = newList(vm, count);
+        ObjList* lst = newList(vm, count < LIST_PRESIZE_MAX ? count : LIST_PRESIZE_MAX);
         push(vm, OBJ_VAL(lst));
 
         if(IS_CLOSURE(vm->apiStack[2]) || IS_NATIVE(vm->apiStack[2])) {
-            for(size_t i = 0; i < count; i++) {
+            for(size_t i = 0; i < count && !vm->outOfMemory; i++) {
                 jsrPushValue(vm, 2);
                 jsrPushNumber(vm, i);
                 if(jsrCall(vm, 1) != JSR_SUCCESS) return false;
-                lst->arr[lst->size++] = pop(vm);
+                listAppend(vm, lst, peek(vm));
+                pop(vm);
             }
         } else {
-            for(size_t i = 0; i < count; i++) {
-                lst->arr[lst->size++] = vm->apiStack[2];
+            for(size_t i = 0; i < count && !vm->outOfMemory; i++) {
+                listAppend(vm, lst, vm->apiStack[2]);
             }
         }
+    } else if(isBuiltinRange(vm, vm->apiStack[1])) {
+        double start, stop, step;
+        if(!checkRangeBounds(vm, 1, &start, &stop, &step)) return false;
+
+        double length = rangeLength(start, stop, step);
+        if(!isfinite(length) || length > (double)(SIZE_MAX / sizeof(Value))) {
+            JSR_RAISE(vm, "InvalidArgException", "Range is too long to be converted to a List");
+        }
+
+        // The size of a Range is known in advance, so presize the List
+        ObjList* lst = newList(vm, length < LIST_PRESIZE_MAX ? length : LIST_PRESIZE_MAX);
+        push(vm, OBJ_VAL(lst));
+
+        for(double i = start; (step > 0 ? i < stop : i > stop) && !vm->outOfMemory; i += step) {
+            listAppend(vm, lst, NUM_VAL(i));
+        }
     } else {
         jsrPushList(vm);
         JSR_FOREACH(1, {
@@ -440,7 +584,7 @@ static bool lessEqCompare(JStarVM* vm, Value a, Value b, Value comparator, bool*
 
         if(!IS_NUM(peek(vm))) {
             JSR_RAISE(vm, "TypeException", "`comparator` didn't return a Number, got %s",
-                      getClass(vm, peek(vm))->name->data);
+                      stringData(getClass(vm, peek(vm))->name));
         }
 
         *out = AS_NUM(pop(vm)) <= 0;
@@ -661,6 +805,131 @@ JSR_NATIVE(jsr_Tuple_hash) {
 }
 // end
 
+// class TypedArray
+// Creates a typed array from the argument of the constructor, that is either the number of
+// elements, initialized to 0, or an iterable of Numbers to copy
+static bool newTypedArrayFrom(JStarVM* vm, JStarArrayType type) {
+    Value init = vm->apiStack[1];
+
+    if(IS_NUM(init)) {
+        if(!IS_INT(init) || AS_NUM(init) < 0) {
+            JSR_RAISE(vm, "TypeException", "size must be an integer >= 0");
+        }
+        // The max size may not be representable as a double, so sizes rounded up to it are
+        // rejected as well
+        if(AS_NUM(init) >= (double)typedArrayMaxSize(type)) {
+            JSR_RAISE(vm, "InvalidArgException", "size %g is too big", AS_NUM(init));
+        }
+        push(vm, OBJ_VAL(newTypedArray(vm, type, AS_NUM(init))));
+        return true;
+    }
+
+    if(IS_TYPED_ARRAY(init)) {
+        ObjTypedArray* src = AS_TYPED_ARRAY(init);
+        ObjTypedArray* arr = newTypedArray(vm, type, src->size);
+        push(vm, OBJ_VAL(arr));
+
+        if(src->type == type) {
+            memcpy(arr->data, src->data, src->size * typedArrayElemSize(type));
+            return true;
+        }
+
+        for(size_t i = 0; i < src->size; i++) {
+            if(!typedArrayStore(vm, arr, i, typedArrayGet(src, i))) return false;
+        }
+        return true;
+    }
+
+    // Generic iterables are first collected in a List, so that the size is known in advance
+    if(!IS_LIST(init) && !IS_TUPLE(init)) {
+        jsrPushList(vm);
+        JSR_FOREACH(1, {
+            jsrListAppend(vm, 2);
+            jsrPop(vm);
+        },)
+    }
+
+    size_t size;
+    Value* values = getValues(AS_OBJ(vm->sp[-1]), &size);
+
+    ObjTypedArray* arr = newTypedArray(vm, type, size);
+    push(vm, OBJ_VAL(arr));
+
+    for(size_t i = 0; i < size; i++) {
+        if(!typedArrayStore(vm, arr, i, values[i])) return false;
+    }
+    return true;
+}
+
+JSR_NATIVE(jsr_TypedArray_len) {
+    push(vm, NUM_VAL(AS_TYPED_ARRAY(vm->apiStack[0])->size));
+    return true;
+}
+
+JSR_NATIVE(jsr_TypedArray_iter) {
+    ObjTypedArray* arr = AS_TYPED_ARRAY(vm->apiStack[0]);
+
+    if(IS_NULL(vm->apiStack[1]) && arr->size != 0) {
+        push(vm, NUM_VAL(0));
+        return true;
+    }
+
+    if(IS_NUM(vm->apiStack[1])) {
+        size_t idx = (size_t)AS_NUM(vm->apiStack[1]);
+        if(idx < arr->size - 1) {
+            push(vm, NUM_VAL(idx + 1));
+            return true;
+        }
+    }
+
+    push(vm, BOOL_VAL(false));
+    return true;
+}
+
+JSR_NATIVE(jsr_TypedArray_next) {
+    ObjTypedArray* arr = AS_TYPED_ARRAY(vm->apiStack[0]);
+
+    if(IS_NUM(vm->apiStack[1])) {
+        size_t idx = (size_t)AS_NUM(vm->apiStack[1]);
+        if(idx < arr->size) {
+            push(vm, typedArrayGet(arr, idx));
+            return true;
+        }
+    }
+
+    push(vm, NULL_VAL);
+    return true;
+}
+
+JSR_NATIVE(jsr_TypedArray_toList) {
+    ObjTypedArray* arr = AS_TYPED_ARRAY(vm->apiStack[0]);
+    ObjList* lst = newList(vm, arr->size);
+    for(size_t i = 0; i < arr->size; i++) {
+        lst->arr[lst->size++] = typedArrayGet(arr, i);
+    }
+    push(vm, OBJ_VAL(lst));
+    return true;
+}
+// end
+
+// class Float64Array
+JSR_NATIVE(jsr_Float64Array_new) {
+    return newTypedArrayFrom(vm, JSR_FLOAT64_ARRAY);
+}
+// end
+
+// class Int32Array
+JSR_NATIVE(jsr_Int32Array_new) {
+    return newTypedArrayFrom(vm, JSR_INT32_ARRAY);
+}
+// end
+
+// class ByteArray
+JSR_NATIVE(jsr_ByteArray_new) {
+    return newTypedArrayFrom(vm, JSR_BYTE_ARRAY);
+}
+// end
+
 // class String
 JSR_NATIVE(jsr_String_new) {
     JStarBuffer string;
@@ -691,7 +960,7 @@ JSR_NATIVE(jsr_String_charAt) {
     size_t i = jsrCheckIndex(vm, 1, str->length, "idx");
     if(i == SIZE_MAX) return false;
 
-    int c = str->data[i];
+    int c = stringData(str)[i];
     jsrPushNumber(vm, (double)c);
     return true;
 }
@@ -880,7 +1149,7 @@ JSR_NATIVE(jsr_String_mod) {
                 if(!jsrIsString(vm, -1)) {
                     jsrBufferFree(&buf);
                     JSR_RAISE(vm, "TypeException", "%s.__string__() didn't return a String.",
-                              getClass(vm, fmtArg)->name->data);
+                              stringData(getClass(vm, fmtArg)->name));
                 }
 
                 jsrBufferAppendStr(&buf, jsrGetString(vm, -1));
@@ -950,7 +1219,7 @@ JSR_NATIVE(jsr_String_next) {
     if(IS_NUM(vm->apiStack[1])) {
         size_t idx = (size_t)AS_NUM(vm->apiStack[1]);
         if(idx < str->length) {
-            jsrPushStringSz(vm, str->data + idx, 1);
+            jsrPushStringSz(vm, stringData(str) + idx, 1);
             return true;
         }
     }
@@ -961,8 +1230,6 @@ JSR_NATIVE(jsr_String_next) {
 // end
 
 // class Table
-#define TOMB_MARKER      TRUE_VAL
-#define MAX_LOAD_FACTOR  0.75
 #define INITIAL_CAPACITY 8
 #define GROW_FACTOR      2
 
@@ -985,11 +1252,16 @@ static bool tableKeyHash(JStarVM* vm, Value key, uint32_t* hash) {
     JSR_CHECK(Number, -1, "__hash__() return value");
     *hash = (uint32_t)AS_NUM(pop(vm));
 
-    return hash;
+    return true;
 }
 
 static bool tableKeyEquals(JStarVM* vm, Value k1, Value k2, bool* eq) {
-    if(IS_STRING(k1) || IS_NUM(k1) || IS_BOOL(k1)) {
+    // Strings are not all interned, so they must be compared by content
+    if(IS_STRING(k1)) {
+        *eq = IS_STRING(k2) && stringEquals(AS_STRING(k1), AS_STRING(k2));
+        return true;
+    }
+    if(IS_NUM(k1) || IS_BOOL(k1)) {
         *eq = valueEquals(k1, k2);
         return true;
     }
@@ -1002,60 +1274,101 @@ static bool tableKeyEquals(JStarVM* vm, Value k1, Value k2, bool* eq) {
     return true;
 }
 
-static bool findEntry(JStarVM* vm, TableEntry* entries, size_t sizeMask, Value key,
-                      TableEntry** out) {
-    uint32_t hash;
-    if(!tableKeyHash(vm, key, &hash)) return false;
+static size_t indexGet(const void* index, size_t width, size_t i) {
+    switch(width) {
+    case sizeof(uint8_t):
+        return ((const uint8_t*)index)[i];
+    case sizeof(uint16_t):
+        return ((const uint16_t*)index)[i];
+    case sizeof(uint32_t):
+        return ((const uint32_t*)index)[i];
+    default:
+        return ((const uint64_t*)index)[i];
+    }
+}
 
-    size_t i = hash & sizeMask;
-    TableEntry* tomb = NULL;
+static void indexSet(void* index, size_t width, size_t i, size_t val) {
+    switch(width) {
+    case sizeof(uint8_t):
+        ((uint8_t*)index)[i] = (uint8_t)val;
+        break;
+    case sizeof(uint16_t):
+        ((uint16_t*)index)[i] = (uint16_t)val;
+        break;
+    case sizeof(uint32_t):
+        ((uint32_t*)index)[i] = (uint32_t)val;
+        break;
+    default:
+        ((uint64_t*)index)[i] = (uint64_t)val;
+        break;
+    }
+}
+
+// Finds the slot of the index referring to `key`, or the empty slot where it should be inserted.
+// Slots referring to deleted entries are skipped, and `__eq__` is called only when the stored
+// hash matches
+static bool findSlot(JStarVM* vm, ObjTable* t, Value key, uint32_t hash, size_t* out) {
+    size_t width = TABLE_INDEX_WIDTH(t->capacityMask + 1);
+    size_t i = hash & t->capacityMask;
 
     for(;;) {
-        TableEntry* e = &entries[i];
-        if(IS_NULL(e->key)) {
-            if(IS_NULL(e->val)) {
-                if(tomb)
-                    *out = tomb;
-                else
-                    *out = e;
-                return true;
-            } else if(!tomb) {
-                tomb = e;
-            }
-        } else {
+        size_t idx = indexGet(TABLE_INDEX(t), width, i);
+        if(idx == 0) {
+            *out = i;
+            return true;
+        }
+
+        TableEntry* e = &t->entries[idx - 1];
+        if(!IS_NULL(e->key) && e->hash == hash) {
             bool eq;
             if(!tableKeyEquals(vm, key, e->key, &eq)) return false;
             if(eq) {
-                *out = e;
+                *out = i;
                 return true;
             }
         }
-        i = (i + 1) & sizeMask;
+
+        i = (i + 1) & t->capacityMask;
     }
 }
 
-static void growEntries(JStarVM* vm, ObjTable* t) {
-    size_t newCap = t->capacityMask ? (t->capacityMask + 1) * GROW_FACTOR : INITIAL_CAPACITY;
-    TableEntry* newEntries = GC_ALLOC(vm, sizeof(TableEntry) * newCap);
-    for(size_t i = 0; i < newCap; i++) {
-        newEntries[i] = (TableEntry){NULL_VAL, NULL_VAL};
+// Rebuilds the Table dropping deleted entries. The capacity is grown only if live entries fill
+// more than half of the entries array, otherwise the Table is just compacted
+static void rebuildTable(JStarVM* vm, ObjTable* t) {
+    size_t oldCap = t->entries ? t->capacityMask + 1 : 0;
+    size_t newCap = oldCap ? oldCap : INITIAL_CAPACITY;
+    if(t->size + 1 > TABLE_MAX_ENTRIES(newCap) / 2) {
+        newCap *= GROW_FACTOR;
     }
 
-    t->numEntries = 0, t->size = 0;
-    if(t->capacityMask != 0) {
-        for(size_t i = 0; i <= t->capacityMask; i++) {
-            TableEntry* e = &t->entries[i];
-            if(IS_NULL(e->key)) continue;
+    TableEntry* newEntries = GC_ALLOC(vm, TABLE_BLOCK_SIZE(newCap));
+    void* newIndex = newEntries + TABLE_MAX_ENTRIES(newCap);
+    size_t width = TABLE_INDEX_WIDTH(newCap);
+    memset(newIndex, 0, width * newCap);
+
+    // Keys are already unique, so each entry goes in the first free slot from its stored hash
+    // and neither `__hash__` nor `__eq__` has to be called
+    size_t numEntries = 0;
+    for(size_t i = 0; i < t->numEntries; i++) {
+        TableEntry* e = &t->entries[i];
+        if(IS_NULL(e->key)) continue;
 
-            TableEntry* dest;
-            findEntry(vm, newEntries, newCap - 1, e->key, &dest);
-            *dest = (TableEntry){e->key, e->val};
-            t->numEntries++, t->size++;
+        size_t j = e->hash & (newCap - 1);
+        while(indexGet(newIndex, width, j) != 0) {
+            j = (j + 1) & (newCap - 1);
         }
-        GC_FREE_ARRAY(vm, TableEntry, t->entries, t->capacityMask + 1);
+
+        newEntries[numEntries++] = *e;
+        indexSet(newIndex, width, j, numEntries);
+    }
+
+    if(oldCap != 0) {
+        GC_FREE_ARRAY(vm, char, t->entries, TABLE_BLOCK_SIZE(oldCap));
     }
+
     t->entries = newEntries;
     t->capacityMask = newCap - 1;
+    t->numEntries = t->size = numEntries;
 }
 
 JSR_NATIVE(jsr_Table_new) {
@@ -1064,7 +1377,7 @@ JSR_NATIVE(jsr_Table_new) {
 
     if(IS_TABLE(vm->apiStack[1])) {
         ObjTable* other = AS_TABLE(vm->apiStack[1]);
-        for(size_t i = 0; i <= other->capacityMask; i++) {
+        for(size_t i = 0; i < other->numEntries; i++) {
             TableEntry* e = &other->entries[i];
             if(!IS_NULL(e->key)) {
                 push(vm, OBJ_VAL(table));
@@ -1078,7 +1391,7 @@ JSR_NATIVE(jsr_Table_new) {
         JSR_FOREACH(1, {
             if(!IS_LIST(peek(vm)) && !IS_TUPLE(peek(vm))) {
                 JSR_RAISE(vm, "TypeException", "Can only unpack List or Tuple, got %s", 
-                          getClass(vm, peek(vm))->name->data);
+                          stringData(getClass(vm, peek(vm))->name));
             }
             
             size_t size;
@@ -1111,13 +1424,17 @@ JSR_NATIVE(jsr_Table_get) {
         return true;
     }
 
-    TableEntry* e;
-    if(!findEntry(vm, t->entries, t->capacityMask, vm->apiStack[1], &e)) {
+    uint32_t hash;
+    if(!tableKeyHash(vm, vm->apiStack[1], &hash)) return false;
+
+    size_t slot;
+    if(!findSlot(vm, t, vm->apiStack[1], hash, &slot)) {
         return false;
     }
 
-    if(!IS_NULL(e->key)) {
-        push(vm, e->val);
+    size_t idx = indexGet(TABLE_INDEX(t), TABLE_INDEX_WIDTH(t->capacityMask + 1), slot);
+    if(idx != 0) {
+        push(vm, t->entries[idx - 1].val);
     } else {
         push(vm, NULL_VAL);
     }
@@ -1128,23 +1445,35 @@ JSR_NATIVE(jsr_Table_get) {
 JSR_NATIVE(jsr_Table_set) {
     if(jsrIsNull(vm, 1)) JSR_RAISE(vm, "TypeException", "Key of Table cannot be null.");
 
+    uint32_t hash;
+    if(!tableKeyHash(vm, vm->apiStack[1], &hash)) return false;
+
     ObjTable* t = AS_TABLE(vm->apiStack[0]);
-    if(t->numEntries + 1 > (t->capacityMask + 1) * MAX_LOAD_FACTOR) {
-        growEntries(vm, t);
+    if(t->numEntries + 1 > TABLE_MAX_ENTRIES(t->capacityMask + 1)) {
+        rebuildTable(vm, t);
     }
 
-    TableEntry* e;
-    if(!findEntry(vm, t->entries, t->capacityMask, vm->apiStack[1], &e)) {
+    size_t slot;
+    if(!findSlot(vm, t, vm->apiStack[1], hash, &slot)) {
         return false;
     }
 
-    bool newEntry = IS_NULL(e->key);
+    void* index = TABLE_INDEX(t);
+    size_t width = TABLE_INDEX_WIDTH(t->capacityMask + 1);
+    size_t idx = indexGet(index, width, slot);
+
+    // New keys are always appended, so that entries stay in insertion order
+    bool newEntry = idx == 0;
     if(newEntry) {
+        idx = ++t->numEntries;
+        indexSet(index, width, slot, idx);
         t->size++;
-        if(IS_NULL(e->val)) t->numEntries++;
     }
 
-    *e = (TableEntry){vm->apiStack[1], vm->apiStack[2]};
+    TableEntry* e = &t->entries[idx - 1];
+    *e = (TableEntry){vm->apiStack[1], vm->apiStack[2], hash};
+    gcWriteBarrier(vm, (Obj*)t, e->key);
+    gcWriteBarrier(vm, (Obj*)t, e->val);
     push(vm, BOOL_VAL(newEntry));
     return true;
 }
@@ -1158,17 +1487,22 @@ JSR_NATIVE(jsr_Table_delete) {
         return true;
     }
 
-    TableEntry* toDelete;
-    if(!findEntry(vm, t->entries, t->capacityMask, vm->apiStack[1], &toDelete)) {
+    uint32_t hash;
+    if(!tableKeyHash(vm, vm->apiStack[1], &hash)) return false;
+
+    size_t slot;
+    if(!findSlot(vm, t, vm->apiStack[1], hash, &slot)) {
         return false;
     }
 
-    if(IS_NULL(toDelete->key)) {
+    size_t idx = indexGet(TABLE_INDEX(t), TABLE_INDEX_WIDTH(t->capacityMask + 1), slot);
+    if(idx == 0) {
         jsrPushBoolean(vm, false);
         return true;
     }
 
-    *toDelete = (TableEntry){NULL_VAL, TOMB_MARKER};
+    // The slot keeps referring to the deleted entry, so that probing continues past it
+    t->entries[idx - 1] = (TableEntry){NULL_VAL, NULL_VAL, 0};
     t->size--;
 
     push(vm, BOOL_VAL(true));
@@ -1177,10 +1511,11 @@ JSR_NATIVE(jsr_Table_delete) {
 
 JSR_NATIVE(jsr_Table_clear) {
     ObjTable* t = AS_TABLE(vm->apiStack[0]);
-    t->numEntries = t->size = 0;
-    for(size_t i = 0; i < t->capacityMask + 1; i++) {
-        t->entries[i] = (TableEntry){NULL_VAL, NULL_VAL};
+    if(t->entries != NULL) {
+        size_t capacity = t->capacityMask + 1;
+        memset(TABLE_INDEX(t), 0, TABLE_INDEX_WIDTH(capacity) * capacity);
     }
+    t->numEntries = t->size = 0;
     push(vm, NULL_VAL);
     return true;
 }
@@ -1200,12 +1535,16 @@ JSR_NATIVE(jsr_Table_contains) {
         return true;
     }
 
-    TableEntry* e;
-    if(!findEntry(vm, t->entries, t->capacityMask, vm->apiStack[1], &e)) {
+    uint32_t hash;
+    if(!tableKeyHash(vm, vm->apiStack[1], &hash)) return false;
+
+    size_t slot;
+    if(!findSlot(vm, t, vm->apiStack[1], hash, &slot)) {
         return false;
     }
 
-    push(vm, BOOL_VAL(!IS_NULL(e->key)));
+    size_t idx = indexGet(TABLE_INDEX(t), TABLE_INDEX_WIDTH(t->capacityMask + 1), slot);
+    push(vm, BOOL_VAL(idx != 0));
     return true;
 }
 
@@ -1215,13 +1554,11 @@ JSR_NATIVE(jsr_Table_keys) {
 
     jsrPushList(vm);
 
-    if(entries != NULL) {
-        for(size_t i = 0; i < t->capacityMask + 1; i++) {
-            if(!IS_NULL(entries[i].key)) {
-                push(vm, entries[i].key);
-                jsrListAppend(vm, -2);
-                jsrPop(vm);
-            }
+    for(size_t i = 0; i < t->numEntries; i++) {
+        if(!IS_NULL(entries[i].key)) {
+            push(vm, entries[i].key);
+            jsrListAppend(vm, -2);
+            jsrPop(vm);
         }
     }
 
@@ -1234,13 +1571,11 @@ JSR_NATIVE(jsr_Table_values) {
 
     jsrPushList(vm);
 
-    if(entries != NULL) {
-        for(size_t i = 0; i < t->capacityMask + 1; i++) {
-            if(!IS_NULL(entries[i].key)) {
-                push(vm, entries[i].val);
-                jsrListAppend(vm, -2);
-                jsrPop(vm);
-            }
+    for(size_t i = 0; i < t->numEntries; i++) {
+        if(!IS_NULL(entries[i].key)) {
+            push(vm, entries[i].val);
+            jsrListAppend(vm, -2);
+            jsrPop(vm);
         }
     }
 
@@ -1250,22 +1585,12 @@ JSR_NATIVE(jsr_Table_values) {
 JSR_NATIVE(jsr_Table_iter) {
     ObjTable* t = AS_TABLE(vm->apiStack[0]);
 
-    if(IS_NULL(vm->apiStack[1]) && t->entries == NULL) {
-        push(vm, BOOL_VAL(false));
-        return true;
-    }
-
     size_t lastIdx = 0;
     if(IS_NUM(vm->apiStack[1])) {
-        size_t idx = (size_t)AS_NUM(vm->apiStack[1]);
-        if(idx >= t->capacityMask) {
-            push(vm, BOOL_VAL(false));
-            return true;
-        }
-        lastIdx = idx + 1;
+        lastIdx = (size_t)AS_NUM(vm->apiStack[1]) + 1;
     }
 
-    for(size_t i = lastIdx; i < t->capacityMask + 1; i++) {
+    for(size_t i = lastIdx; i < t->numEntries; i++) {
         if(!IS_NULL(t->entries[i].key)) {
             push(vm, NUM_VAL(i));
             return true;
@@ -1281,7 +1606,7 @@ JSR_NATIVE(jsr_Table_next) {
 
     if(IS_NUM(vm->apiStack[1])) {
         size_t idx = (size_t)AS_NUM(vm->apiStack[1]);
-        if(idx <= t->capacityMask) {
+        if(idx < t->numEntries) {
             push(vm, t->entries[idx].key);
             return true;
         }
@@ -1299,8 +1624,8 @@ JSR_NATIVE(jsr_Table_string) {
     jsrBufferAppendChar(&buf, '{');
 
     TableEntry* entries = t->entries;
-    if(entries != NULL) {
-        for(size_t i = 0; i < t->capacityMask + 1; i++) {
+    if(t->size > 0) {
+        for(size_t i = 0; i < t->numEntries; i++) {
             if(IS_NULL(entries[i].key)) continue;
 
             push(vm, entries[i].key);
@@ -1349,8 +1674,10 @@ static bool checkEnumElem(JStarVM* vm, int slot) {
             }
         }
 
-        ObjString* str = AS_STRING(apiStackSlot(vm, slot));
-        if(hashTableContainsKey(&inst->fields, str)) {
+        // Fields are looked up by identity, so the interned String is needed
+        ObjString* str = copyString(vm, enumElem, enumElemLen);
+        Value field;
+        if(instanceGetField(inst, str, &field)) {
             JSR_RAISE(vm, "InvalidArgException", "Duplicate Enum element `%s`", enumElem);
         }
 
@@ -1572,8 +1899,9 @@ JSR_NATIVE(jsr_type) {
 
 static bool recordEquals(FrameRecord* f1, FrameRecord* f2) {
     if(f1 && f2) {
-        return (strcmp(f1->moduleName->data, f2->moduleName->data) == 0) &&
-               (strcmp(f1->funcName->data, f2->funcName->data) == 0) && (f1->line == f2->line);
+        return (strcmp(stringData(f1->moduleName), stringData(f2->moduleName)) == 0) &&
+               (strcmp(stringData(f1->funcName), stringData(f2->funcName)) == 0) &&
+               (f1->line == f2->line);
     }
     return false;
 }
@@ -1581,7 +1909,7 @@ static bool recordEquals(FrameRecord* f1, FrameRecord* f2) {
 JSR_NATIVE(jsr_Exception_printStacktrace) {
     Value stval = NULL_VAL;
     ObjInstance* exc = AS_INSTANCE(vm->apiStack[0]);
-    hashTableGet(&exc->fields, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), &stval);
+    instanceGetField(exc, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), &stval);
 
     if(!IS_STACK_TRACE(stval)) {
         jsrPushNull(vm);
@@ -1589,7 +1917,7 @@ JSR_NATIVE(jsr_Exception_printStacktrace) {
     }
 
     Value cause = NULL_VAL;
-    hashTableGet(&exc->fields, copyString(vm, EXC_CAUSE, strlen(EXC_CAUSE)), &cause);
+    instanceGetField(exc, copyString(vm, EXC_CAUSE, strlen(EXC_CAUSE)), &cause);
     if(isInstance(vm, cause, vm->excClass)) {
         push(vm, cause);
         jsrCallMethod(vm, "printStacktrace", 0);
@@ -1625,19 +1953,21 @@ JSR_NATIVE(jsr_Exception_printStacktrace) {
             } else {
                 fprintf(stderr, "[line ?]");
             }
-            fprintf(stderr, " module %s in %s\n", record->moduleName->data, record->funcName->data);
+            fprintf(stderr, " module %s in %s\n", stringData(record->moduleName),
+                    stringData(record->funcName));
 
             lastRecord = record;
         }
     }
 
     Value err = NULL_VAL;
-    hashTableGet(&exc->fields, copyString(vm, EXC_ERR, strlen(EXC_ERR)), &err);
+    instanceGetField(exc, copyString(vm, EXC_ERR, strlen(EXC_ERR)), &err);
 
     if(IS_STRING(err) && AS_STRING(err)->length > 0) {
-        fprintf(stderr, "%s: %s\n", exc->base.cls->name->data, AS_STRING(err)->data);
+        fprintf(stderr, "%s: %.*s\n", stringData(exc->base.cls->name), (int)AS_STRING(err)->length,
+                stringData(AS_STRING(err)));
     } else {
-        fprintf(stderr, "%s\n", exc->base.cls->name->data);
+        fprintf(stderr, "%s\n", stringData(exc->base.cls->name));
     }
 
     jsrPushNull(vm);
@@ -1647,7 +1977,7 @@ JSR_NATIVE(jsr_Exception_printStacktrace) {
 JSR_NATIVE(jsr_Exception_getStacktrace) {
     Value stval = NULL_VAL;
     ObjInstance* exc = AS_INSTANCE(vm->apiStack[0]);
-    hashTableGet(&exc->fields, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), &stval);
+    instanceGetField(exc, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), &stval);
 
     if(!IS_STACK_TRACE(stval)) {
         jsrPushString(vm, "");
@@ -1658,13 +1988,14 @@ JSR_NATIVE(jsr_Exception_getStacktrace) {
     jsrBufferInitCapacity(vm, &string, 64);
 
     Value cause = NULL_VAL;
-    hashTableGet(&exc->fields, copyString(vm, EXC_CAUSE, strlen(EXC_CAUSE)), &cause);
+    instanceGetField(exc, copyString(vm, EXC_CAUSE, strlen(EXC_CAUSE)), &cause);
     if(isInstance(vm, cause, vm->excClass)) {
         push(vm, cause);
         jsrCallMethod(vm, "getStacktrace", 0);
         Value stackTrace = peek(vm);
         if(IS_STRING(stackTrace)) {
-            jsrBufferAppend(&string, AS_STRING(stackTrace)->data, AS_STRING(stackTrace)->length);
+            ObjString* stackTraceStr = AS_STRING(stackTrace);
+            jsrBufferAppend(&string, stringData(stackTraceStr), stackTraceStr->length);
             jsrBufferAppendStr(&string, "\n\nAbove Exception caused:\n");
         }
         pop(vm);
@@ -1700,20 +2031,21 @@ JSR_NATIVE(jsr_Exception_getStacktrace) {
                 jsrBufferAppendStr(&string, "[line ?]");
             }
 
-            jsrBufferAppendf(&string, " module %s in %s\n", record->moduleName->data,
-                             record->funcName->data);
+            jsrBufferAppendf(&string, " module %s in %s\n", stringData(record->moduleName),
+                             stringData(record->funcName));
 
             lastRecord = record;
         }
     }
 
     Value err = NULL_VAL;
-    hashTableGet(&exc->fields, copyString(vm, EXC_ERR, strlen(EXC_ERR)), &err);
+    instanceGetField(exc, copyString(vm, EXC_ERR, strlen(EXC_ERR)), &err);
 
     if(IS_STRING(err) && AS_STRING(err)->length > 0) {
-        jsrBufferAppendf(&string, "%s: %s", exc->base.cls->name->data, AS_STRING(err)->data);
+        jsrBufferAppendf(&string, "%s: %.*s", stringData(exc->base.cls->name),
+                         (int)AS_STRING(err)->length, stringData(AS_STRING(err)));
     } else {
-        jsrBufferAppendf(&string, "%s", exc->base.cls->name->data);
+        jsrBufferAppendf(&string, "%s", stringData(exc->base.cls->name));
     }
 
     jsrBufferPush(&string);
@@ -2,10 +2,20 @@
 #define CORE_H
 
 #include "jstar.h"
+#include "value.h"
 
 // J* core module bootstrap
 void initCoreModule(JStarVM* vm);
 
+// Names of the fields holding the bounds of a Range
+#define M_RANGE_START "_start"
+#define M_RANGE_STOP  "_stop"
+#define M_RANGE_STEP  "_step"
+
+// Reads the bounds of a Range instance. Returns false if `range` isn't an instance or if its
+// bounds are not valid (i.e. they are not numbers or the step is 0)
+bool getRangeBounds(JStarVM* vm, Value range, double* start, double* stop, double* step);
+
 // J* core module native functions and methods
 
 // class Number
@@ -33,6 +43,13 @@ JSR_NATIVE(jsr_Function_string);
 JSR_NATIVE(jsr_Module_string);
 // end
 
+// class Range
+JSR_NATIVE(jsr_Range_new);
+JSR_NATIVE(jsr_Range_len);
+JSR_NATIVE(jsr_Range_iter);
+JSR_NATIVE(jsr_Range_next);
+// end
+
 // class List
 JSR_NATIVE(jsr_List_new);
 JSR_NATIVE(jsr_List_add);
@@ -55,6 +72,25 @@ JSR_NATIVE(jsr_Tuple_next);
 JSR_NATIVE(jsr_Tuple_hash);
 // end
 
+// class TypedArray
+JSR_NATIVE(jsr_TypedArray_len);
+JSR_NATIVE(jsr_TypedArray_iter);
+JSR_NATIVE(jsr_TypedArray_next);
+JSR_NATIVE(jsr_TypedArray_toList);
+// end
+
+// class Float64Array
+JSR_NATIVE(jsr_Float64Array_new);
+// end
+
+// class Int32Array
+JSR_NATIVE(jsr_Int32Array_new);
+// end
+
+// class ByteArray
+JSR_NATIVE(jsr_ByteArray_new);
+// end
+
 // class String
 JSR_NATIVE(jsr_String_new);
 JSR_NATIVE(jsr_String_charAt);
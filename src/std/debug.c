@@ -1,5 +1,6 @@
 #include "debug.h"
 
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 
@@ -28,14 +29,14 @@ JSR_NATIVE(jsr_disassemble) {
     Value arg = vm->apiStack[1];
     if(!isDisassemblable(arg)) {
         JSR_RAISE(vm, "InvalidArgException", "Cannot disassemble a %s",
-                  getClass(vm, arg)->name->data);
+                  stringData(getClass(vm, arg)->name));
     }
 
     if(IS_BOUND_METHOD(arg)) {
         arg = OBJ_VAL(AS_BOUND_METHOD(arg)->method);
     } else if(IS_CLASS(arg)) {
         Value ctor;
-        if(!hashTableGet(&AS_CLASS(arg)->methods, vm->methodSyms[SYM_CTOR], &ctor)) {
+        if(!classGetMethod(vm, AS_CLASS(arg), vm->methodSyms[SYM_CTOR], &ctor)) {
             jsrPushNull(vm);
             return true;
         }
@@ -51,3 +52,72 @@ JSR_NATIVE(jsr_disassemble) {
     jsrPushNull(vm);
     return true;
 }
+
+static void setStat(JStarVM* vm, const char* name, double value) {
+    jsrPushString(vm, name);
+    jsrPushNumber(vm, value);
+    jsrSubscriptSet(vm, -3);
+    jsrPop(vm);
+}
+
+JSR_NATIVE(jsr_cacheStats) {
+    CacheStats* stats = &vm->methodCache;
+    jsrPushTable(vm);
+    setStat(vm, "hits", stats->hits);
+    setStat(vm, "misses", stats->misses);
+    setStat(vm, "megamorphic", stats->megamorphic);
+    return true;
+}
+
+JSR_NATIVE(jsr_resetCacheStats) {
+    vm->methodCache = (CacheStats){0};
+    jsrPushNull(vm);
+    return true;
+}
+
+JSR_NATIVE(jsr_gcStats) {
+    JStarGCStats stats = jsrGetGCStats(vm);
+    jsrPushTable(vm);
+    setStat(vm, "minorCollections", stats.minorCollections);
+    setStat(vm, "majorCollections", stats.majorCollections);
+    setStat(vm, "totalPause", stats.totalPause);
+    setStat(vm, "maxPause", stats.maxPause);
+    setStat(vm, "bytesAllocated", stats.bytesAllocated);
+    setStat(vm, "bytesFreed", stats.bytesFreed);
+    setStat(vm, "liveBytes", stats.liveBytes);
+    setStat(vm, "heapSize", stats.heapSize);
+    setStat(vm, "nextGC", stats.nextGC);
+    setStat(vm, "heapGrowRate", stats.heapGrowRate);
+
+    jsrPushString(vm, "objects");
+    jsrPushTable(vm);
+    for(int i = 0; i < stats.objectTypes; i++) {
+        setStat(vm, stats.typeNames[i], stats.objects[i]);
+    }
+    jsrSubscriptSet(vm, -3);
+    jsrPop(vm);
+
+    return true;
+}
+
+JSR_NATIVE(jsr_setHeapGrowRate) {
+    JSR_CHECK(Int, 1, "rate");
+    double rate = jsrGetNumber(vm, 1);
+    if(rate < 1 || rate > INT_MAX) {
+        JSR_RAISE(vm, "InvalidArgException", "rate must be between 1 and %d", INT_MAX);
+    }
+    jsrSetHeapGrowRate(vm, (int)rate);
+    jsrPushNull(vm);
+    return true;
+}
+
+JSR_NATIVE(jsr_setNextGC) {
+    JSR_CHECK(Int, 1, "bytes");
+    double bytes = jsrGetNumber(vm, 1);
+    if(bytes < 0) {
+        JSR_RAISE(vm, "InvalidArgException", "bytes must be non-negative");
+    }
+    jsrSetNextGC(vm, (size_t)bytes);
+    jsrPushNull(vm);
+    return true;
+}
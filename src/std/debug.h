@@ -5,5 +5,10 @@
 
 JSR_NATIVE(jsr_printStack);
 JSR_NATIVE(jsr_disassemble);
+JSR_NATIVE(jsr_cacheStats);
+JSR_NATIVE(jsr_resetCacheStats);
+JSR_NATIVE(jsr_gcStats);
+JSR_NATIVE(jsr_setHeapGrowRate);
+JSR_NATIVE(jsr_setNextGC);
 
 #endif
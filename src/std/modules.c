@@ -123,6 +123,21 @@ static Module builtInModules[] = {
             METHOD(__next__, jsr_Tuple_next)
             METHOD(__hash__, jsr_Tuple_hash)
         ENDCLASS
+        CLASS(TypedArray)
+            METHOD(__len__,  jsr_TypedArray_len)
+            METHOD(__iter__, jsr_TypedArray_iter)
+            METHOD(__next__, jsr_TypedArray_next)
+            METHOD(toList,   jsr_TypedArray_toList)
+        ENDCLASS
+        CLASS(Float64Array)
+            METHOD(new, jsr_Float64Array_new)
+        ENDCLASS
+        CLASS(Int32Array)
+            METHOD(new, jsr_Int32Array_new)
+        ENDCLASS
+        CLASS(ByteArray)
+            METHOD(new, jsr_ByteArray_new)
+        ENDCLASS
         CLASS(String)
             METHOD(new,        jsr_String_new)
             METHOD(charAt,     jsr_String_charAt)
@@ -154,6 +169,12 @@ static Module builtInModules[] = {
             METHOD(__next__,   jsr_Table_next)
             METHOD(__string__, jsr_Table_string)
         ENDCLASS
+        CLASS(Range)
+            METHOD(new,      jsr_Range_new)
+            METHOD(__len__,  jsr_Range_len)
+            METHOD(__iter__, jsr_Range_iter)
+            METHOD(__next__, jsr_Range_next)
+        ENDCLASS
         CLASS(Enum)
             METHOD(new,   jsr_Enum_new)
             METHOD(value, jsr_Enum_value)
@@ -240,8 +261,13 @@ static Module builtInModules[] = {
 #endif
 #ifdef JSTAR_DEBUG
     MODULE(debug)
-        FUNCTION(printStack,  jsr_printStack)
-        FUNCTION(disassemble, jsr_disassemble)
+        FUNCTION(printStack,      jsr_printStack)
+        FUNCTION(disassemble,     jsr_disassemble)
+        FUNCTION(cacheStats,      jsr_cacheStats)
+        FUNCTION(resetCacheStats, jsr_resetCacheStats)
+        FUNCTION(gcStats,         jsr_gcStats)
+        FUNCTION(setHeapGrowRate, jsr_setHeapGrowRate)
+        FUNCTION(setNextGC,       jsr_setNextGC)
     ENDMODULE
 #endif
     MODULES_END
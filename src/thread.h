@@ -0,0 +1,84 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+// Threads and atomic operations used by the parallel marker of the garbage collector.
+// JSTAR_THREADS is defined only when both are supported by the platform and the compiler,
+// otherwise the heap is always marked by the thread running the VM.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "jstarconf.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define JSTAR_ATOMICS
+
+    #define ATOMIC_RELAXED __ATOMIC_RELAXED
+    #define ATOMIC_ACQUIRE __ATOMIC_ACQUIRE
+    #define ATOMIC_RELEASE __ATOMIC_RELEASE
+    #define ATOMIC_SEQ_CST __ATOMIC_SEQ_CST
+
+    #define atomicLoad(ptr, order)       __atomic_load_n(ptr, order)
+    #define atomicStore(ptr, val, order) __atomic_store_n(ptr, val, order)
+    #define atomicFence(order)           __atomic_thread_fence(order)
+    #define atomicFetchAdd(ptr, val)     __atomic_fetch_add(ptr, val, __ATOMIC_SEQ_CST)
+    #define atomicFetchOr64(ptr, val)    __atomic_fetch_or(ptr, val, __ATOMIC_RELAXED)
+    #define atomicExchangeBool(ptr, val) __atomic_exchange_n(ptr, val, __ATOMIC_RELAXED)
+    #define atomicCas64(ptr, exp, val) \
+        __atomic_compare_exchange_n(ptr, &(exp), val, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)
+#elif defined(_MSC_VER) && defined(_M_X64)
+    #include <intrin.h>
+    #define JSTAR_ATOMICS
+
+    // On x64 aligned loads and stores already have acquire and release semantics, so only the
+    // compiler has to be prevented from reordering them
+    #define ATOMIC_RELAXED 0
+    #define ATOMIC_ACQUIRE 0
+    #define ATOMIC_RELEASE 0
+    #define ATOMIC_SEQ_CST 1
+
+    #define atomicLoad(ptr, order)       (_ReadWriteBarrier(), *(ptr))
+    #define atomicStore(ptr, val, order) (_ReadWriteBarrier(), *(ptr) = (val), _ReadWriteBarrier())
+    #define atomicFence(order)           ((order) ? __faststorefence() : _ReadWriteBarrier())
+    #define atomicFetchAdd(ptr, val)     _InterlockedExchangeAdd((volatile long*)(ptr), val)
+    #define atomicFetchOr64(ptr, val)    (uint64_t) _InterlockedOr64((volatile __int64*)(ptr), val)
+    #define atomicExchangeBool(ptr, val) (bool)_InterlockedExchange8((volatile char*)(ptr), val)
+    #define atomicCas64(ptr, exp, val) \
+        (_InterlockedCompareExchange64((volatile __int64*)(ptr), val, exp) == (exp))
+#endif
+
+#if defined(JSTAR_ATOMICS) && defined(JSTAR_POSIX)
+    #define JSTAR_THREADS
+    #include <pthread.h>
+    #include <sched.h>
+
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+
+    #define THREAD_FUNC(name, arg)       void* name(void* arg)
+    #define threadStart(thread, fn, arg) (pthread_create(thread, NULL, fn, arg) == 0)
+    #define threadJoin(thread)           pthread_join(thread, NULL)
+    #define threadYield()                sched_yield()
+    #define mutexInit(mutex)             pthread_mutex_init(mutex, NULL)
+    #define mutexFree(mutex)             pthread_mutex_destroy(mutex)
+    #define mutexLock(mutex)             pthread_mutex_lock(mutex)
+    #define mutexUnlock(mutex)           pthread_mutex_unlock(mutex)
+#elif defined(JSTAR_ATOMICS) && defined(JSTAR_WINDOWS)
+    #define JSTAR_THREADS
+    #include <Windows.h>
+
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+
+    #define THREAD_FUNC(name, arg) DWORD WINAPI name(LPVOID arg)
+    #define threadStart(thread, fn, arg) \
+        ((*(thread) = CreateThread(NULL, 0, fn, arg, 0, NULL)) != NULL)
+    #define threadJoin(thread)   (WaitForSingleObject(thread, INFINITE), CloseHandle(thread))
+    #define threadYield()        SwitchToThread()
+    #define mutexInit(mutex)     InitializeCriticalSection(mutex)
+    #define mutexFree(mutex)     DeleteCriticalSection(mutex)
+    #define mutexLock(mutex)     EnterCriticalSection(mutex)
+    #define mutexUnlock(mutex)   LeaveCriticalSection(mutex)
+#endif
+
+#endif
@@ -25,6 +25,29 @@ static inline uint32_t hashBytes(const void* data, size_t length) {
     return hash;
 }
 
+// Count the trailing zero bits and the set bits of a 64-bit word. `ctz64(0)` is undefined
+#ifdef _MSC_VER
+    #include <intrin.h>
+
+static inline int ctz64(uint64_t x) {
+    unsigned long idx;
+    _BitScanForward64(&idx, x);
+    return (int)idx;
+}
+
+static inline int popcount64(uint64_t x) {
+    return (int)__popcnt64(x);
+}
+#else
+static inline int ctz64(uint64_t x) {
+    return __builtin_ctzll(x);
+}
+
+static inline int popcount64(uint64_t x) {
+    return __builtin_popcountll(x);
+}
+#endif
+
 // Debug assertions
 #ifndef NDEBUG
     #include <stdio.h>
@@ -4,31 +4,34 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "gc.h"
 #include "object.h"
 
 void initValueArray(ValueArray* a) {
     *a = (ValueArray){0};
 }
 
-void freeValueArray(ValueArray* a) {
-    free(a->arr);
+void freeValueArray(JStarVM* vm, ValueArray* a) {
+    gcAllocInternal(vm, MEM_CODE, a->arr, a->capacity * sizeof(Value), 0);
 }
 
-static void grow(ValueArray* a) {
+static void grow(JStarVM* vm, ValueArray* a) {
+    size_t oldCap = a->capacity;
     a->capacity = a->capacity ? a->capacity * VAL_ARR_GROW_FAC : VAL_ARR_DEF_SZ;
-    a->arr = realloc(a->arr, a->capacity * sizeof(Value));
+    a->arr = gcAllocInternal(vm, MEM_CODE, a->arr, oldCap * sizeof(Value),
+                             a->capacity * sizeof(Value));
 }
 
 static bool shouldGrow(const ValueArray* a) {
     return a->size + 1 > a->capacity;
 }
 
-static void ensureCapacity(ValueArray* a) {
-    if(shouldGrow(a)) grow(a);
+static void ensureCapacity(JStarVM* vm, ValueArray* a) {
+    if(shouldGrow(a)) grow(vm, a);
 }
 
-int valueArrayAppend(ValueArray* a, Value v) {
-    ensureCapacity(a);
+int valueArrayAppend(JStarVM* vm, ValueArray* a, Value v) {
+    ensureCapacity(vm, a);
     a->arr[a->size] = v;
     return a->size++;
 }
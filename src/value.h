@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "jstar.h"
 #include "jstarconf.h"
 #include "util.h"
 
@@ -184,8 +185,8 @@ typedef struct ValueArray {
 } ValueArray;
 
 void initValueArray(ValueArray* a);
-void freeValueArray(ValueArray* a);
-int valueArrayAppend(ValueArray* a, Value v);
+void freeValueArray(JStarVM* vm, ValueArray* a);
+int valueArrayAppend(JStarVM* vm, ValueArray* a, Value v);
 
 void printValue(Value val);
 
@@ -24,6 +24,8 @@ static const char* const methodSyms[SYM_END] = {
     [SYM_LE] = "__le__",          [SYM_GT] = "__gt__",          [SYM_GE] = "__ge__",
     [SYM_NEG] = "__neg__",        [SYM_INV] = "__invert__",     [SYM_POW] = "__pow__",
     [SYM_RPOW] = "__rpow__",
+    [SYM_RANGE_START] = M_RANGE_START, [SYM_RANGE_STOP] = M_RANGE_STOP,
+    [SYM_RANGE_STEP] = M_RANGE_STEP,
 };
 
 // Enumeration encoding the cause of stack unwinding.
@@ -55,20 +57,35 @@ static size_t roundUp(size_t num, size_t multiple) {
 }
 
 JStarVM* jsrNewVM(const JStarConf* conf) {
-    JStarVM* vm = calloc(1, sizeof(*vm));
+    JStarVM* vm = conf->allocator(NULL, 0, sizeof(*vm), conf->allocatorData);
+    if(vm == NULL) return NULL;
+    memset(vm, 0, sizeof(*vm));
     vm->errorCallback = conf->errorCallback;
     vm->customData = conf->customData;
+    vm->optimize = conf->optimize;
+
+    initArena(&vm->arena, conf->allocator, conf->allocatorData);
+    vm->memReserve = conf->allocator(NULL, 0, MEM_RESERVE_SZ, conf->allocatorData);
 
     // VM program stack
     vm->stackSz = roundUp(conf->stackSize, MAX_LOCALS + 1);
     vm->frameSz = vm->stackSz / (MAX_LOCALS + 1);
-    vm->stack = malloc(sizeof(Value) * vm->stackSz);
-    vm->frames = malloc(sizeof(Frame) * vm->frameSz);
+    vm->stack = gcAllocInternal(vm, MEM_VM, NULL, 0, sizeof(Value) * vm->stackSz);
+    vm->frames = gcAllocInternal(vm, MEM_VM, NULL, 0, sizeof(Frame) * vm->frameSz);
     resetStack(vm);
 
+    // Exception handler stack
+    vm->handlerSz = HANDLER_SZ;
+    vm->handlers = gcAllocInternal(vm, MEM_VM, NULL, 0, sizeof(Handler) * vm->handlerSz);
+
     // GC Values
     vm->nextGC = conf->initGC;
     vm->heapGrowRate = conf->heapGrowRate;
+    vm->nurserySize = conf->nurserySize;
+    vm->gcStepSize = conf->gcStepSize;
+    vm->gcStepBudget = conf->gcStepBudget;
+    vm->gcThreads = conf->gcThreads;
+    vm->heapLimit = conf->heapLimit;
 
     // Module cache and interned string pool
     initHashTable(&vm->modules);
@@ -79,6 +96,9 @@ JStarVM* jsrNewVM(const JStarConf* conf) {
         vm->methodSyms[i] = copyString(vm, methodSyms[i], strlen(methodSyms[i]));
     }
 
+    // Create the root shape, needed before any instance gets created
+    vm->emptyShape = newShape(vm, NULL, NULL);
+
     // Core module bootstrap
     initCoreModule(vm);
 
@@ -94,31 +114,72 @@ JStarVM* jsrNewVM(const JStarConf* conf) {
 void jsrFreeVM(JStarVM* vm) {
     resetStack(vm);
 
-    free(vm->stack);
-    free(vm->frames);
-    freeHashTable(&vm->stringPool);
-    freeHashTable(&vm->modules);
-    sweepObjects(vm);
+    gcAllocInternal(vm, MEM_VM, vm->stack, sizeof(Value) * vm->stackSz, 0);
+    gcAllocInternal(vm, MEM_VM, vm->frames, sizeof(Frame) * vm->frameSz, 0);
+    gcAllocInternal(vm, MEM_VM, vm->handlers, sizeof(Handler) * vm->handlerSz, 0);
+    freeHashTable(vm, &vm->stringPool);
+    freeHashTable(vm, &vm->modules);
+    freeObjects(vm);
+    freeArena(&vm->arena);
+
+    if(vm->memReserve != NULL) {
+        vm->arena.allocator(vm->memReserve, MEM_RESERVE_SZ, 0, vm->arena.allocatorData);
+    }
 
 #ifdef JSTAR_DBG_PRINT_GC
     printf("Allocated at exit: %lu bytes.\n", vm->allocated);
 #endif
 
-    free(vm);
+#ifdef JSTAR_DBG_GC_PAUSES
+    printGCPauses(vm);
+#endif
+
+    vm->arena.allocator(vm, sizeof(*vm), 0, vm->arena.allocatorData);
 }
 
 // -----------------------------------------------------------------------------
 // VM IMPLEMENTATION
 // -----------------------------------------------------------------------------
 
+// Returns the first free slot of the handler stack
+static Handler* handlersTop(JStarVM* vm) {
+    if(vm->frameCount == 0) return vm->handlers;
+    Frame* last = &vm->frames[vm->frameCount - 1];
+    return last->handlers + last->handlerc;
+}
+
+static void reserveHandlers(JStarVM* vm, size_t needed) {
+    size_t top = handlersTop(vm) - vm->handlers;
+    if(top + needed <= vm->handlerSz) return;
+
+    Handler* oldHandlers = vm->handlers;
+    size_t oldSz = vm->handlerSz;
+    while(top + needed > vm->handlerSz) {
+        vm->handlerSz *= 2;
+    }
+    vm->handlers = gcAllocInternal(vm, MEM_VM, vm->handlers, sizeof(Handler) * oldSz,
+                                   sizeof(Handler) * vm->handlerSz);
+
+    if(vm->handlers != oldHandlers) {
+        for(int i = 0; i < vm->frameCount; i++) {
+            Frame* frame = &vm->frames[i];
+            frame->handlers = vm->handlers + (frame->handlers - oldHandlers);
+        }
+    }
+}
+
 static Frame* getFrame(JStarVM* vm, FnCommon* c) {
     if(vm->frameCount + 1 == vm->frameSz) {
+        int oldSz = vm->frameSz;
         vm->frameSz *= 2;
-        vm->frames = realloc(vm->frames, sizeof(Frame) * vm->frameSz);
+        vm->frames = gcAllocInternal(vm, MEM_VM, vm->frames, sizeof(Frame) * oldSz,
+                                     sizeof(Frame) * vm->frameSz);
     }
 
+    Handler* handlers = handlersTop(vm);
     Frame* callFrame = &vm->frames[vm->frameCount++];
     callFrame->stack = vm->sp - (c->argsCount + 1) - (int)c->vararg;
+    callFrame->handlers = handlers;
     callFrame->handlerc = 0;
     return callFrame;
 }
@@ -139,12 +200,14 @@ static Frame* appendNativeFrame(JStarVM* vm, ObjNative* native) {
 
 static bool isNonInstantiableBuiltin(JStarVM* vm, ObjClass* cls) {
     return cls == vm->nullClass || cls == vm->funClass || cls == vm->modClass ||
-           cls == vm->stClass || cls == vm->clsClass || cls == vm->udataClass;
+           cls == vm->stClass || cls == vm->clsClass || cls == vm->udataClass ||
+           cls == vm->typedArrClass;
 }
 
 static bool isInstatiableBuiltin(JStarVM* vm, ObjClass* cls) {
     return cls == vm->lstClass || cls == vm->tupClass || cls == vm->numClass ||
-           cls == vm->boolClass || cls == vm->strClass || cls == vm->tableClass;
+           cls == vm->boolClass || cls == vm->strClass || cls == vm->tableClass ||
+           cls == vm->f64ArrClass || cls == vm->i32ArrClass || cls == vm->byteArrClass;
 }
 
 static bool isBuiltinClass(JStarVM* vm, ObjClass* cls) {
@@ -157,7 +220,6 @@ static bool isInt(double n) {
 
 static void createClass(JStarVM* vm, ObjString* name, ObjClass* superCls) {
     ObjClass* cls = newClass(vm, name, superCls);
-    hashTableMerge(&cls->methods, &superCls->methods);
     push(vm, OBJ_VAL(cls));
 }
 
@@ -193,6 +255,7 @@ static void closeUpvalues(JStarVM* vm, Value* last) {
         ObjUpvalue* upvalue = vm->upvalues;
         upvalue->closed = *upvalue->addr;
         upvalue->addr = &upvalue->closed;
+        gcWriteBarrier(vm, (Obj*)upvalue, upvalue->closed);
         vm->upvalues = upvalue->next;
     }
 }
@@ -208,7 +271,7 @@ static void packVarargs(JStarVM* vm, uint8_t count) {
 static void argumentError(JStarVM* vm, FnCommon* c, int expected, int supplied,
                           const char* quantity) {
     jsrRaise(vm, "TypeException", "Function `%s.%s` takes %s %d arguments, %d supplied.",
-             c->module->name->data, c->name->data, quantity, expected, supplied);
+             stringData(c->module->name), stringData(c->name), quantity, expected, supplied);
 }
 
 static bool adjustArguments(JStarVM* vm, FnCommon* c, uint8_t argc) {
@@ -223,6 +286,7 @@ static bool adjustArguments(JStarVM* vm, FnCommon* c, uint8_t argc) {
     }
 
     // push remaining args taking the default value
+    reserveStack(vm, c->defCount);
     for(uint8_t i = argc - least; i < c->defCount; i++) {
         push(vm, c->defaults[i]);
     }
@@ -244,16 +308,27 @@ static bool callFunction(JStarVM* vm, ObjClosure* closure, uint8_t argc) {
         return false;
     }
 
-    // TODO: modify compiler to track actual usage of stack so
-    // we can allocate the right amount of memory rather than a
-    // worst case bound
-    reserveStack(vm, UINT8_MAX);
+    // Reserve the stack and handlers computed by the compiler, plus some
+    // space for temporaries pushed by the runtime while executing the frame
+    ObjFunction* fn = closure->fn;
+    reserveStack(vm, fn->stackSize + TEMP_STACK_SZ);
+    reserveHandlers(vm, fn->handlerCount);
     appendCallFrame(vm, closure);
-    vm->module = closure->fn->c.module;
+    vm->module = fn->c.module;
 
     return true;
 }
 
+// Raises an OutOfMemoryException. The heap limit is not enforced until the exception has unwound
+// the stack, so that the memory held by the unwound frames can be reclaimed
+static void raiseOutOfMemory(JStarVM* vm) {
+    if(vm->heapLimit != 0 && vm->allocated > vm->heapLimit) {
+        jsrRaise(vm, "OutOfMemoryException", "Heap limit of %zu bytes exceeded", vm->heapLimit);
+    } else {
+        jsrRaise(vm, "OutOfMemoryException", "Out of memory");
+    }
+}
+
 static bool callNative(JStarVM* vm, ObjNative* native, uint8_t argc) {
     if(vm->frameCount + 1 == RECURSION_LIMIT) {
         jsrRaise(vm, "StackOverflowException", NULL);
@@ -273,7 +348,17 @@ static bool callNative(JStarVM* vm, ObjNative* native, uint8_t argc) {
     vm->module = native->c.module;
     vm->apiStack = frame->stack;
 
-    if(!native->fn(vm)) {
+    bool ok = native->fn(vm);
+
+    // Raise the exception of a native that ran out of memory in the calling frame, where its
+    // handlers are still active, and not at the next safe point of the eval loop
+    if(vm->outOfMemory) {
+        vm->evalBreak = 0;
+        raiseOutOfMemory(vm);
+        ok = false;
+    }
+
+    if(!ok) {
         vm->module = oldModule;
         vm->apiStack = vm->stack + apiStackOffset;
         return false;
@@ -292,9 +377,9 @@ static bool callNative(JStarVM* vm, ObjNative* native, uint8_t argc) {
 
 static bool invokeMethod(JStarVM* vm, ObjClass* cls, ObjString* name, uint8_t argc) {
     Value method;
-    if(!hashTableGet(&cls->methods, name, &method)) {
-        jsrRaise(vm, "MethodException", "Method %s.%s() doesn't exists", cls->name->data,
-                 name->data);
+    if(!classGetMethod(vm, cls, name, &method)) {
+        jsrRaise(vm, "MethodException", "Method %s.%s() doesn't exists", stringData(cls->name),
+                 stringData(name));
         return false;
     }
     return callValue(vm, method, argc);
@@ -302,7 +387,7 @@ static bool invokeMethod(JStarVM* vm, ObjClass* cls, ObjString* name, uint8_t ar
 
 static bool bindMethod(JStarVM* vm, ObjClass* cls, ObjString* name) {
     Value v;
-    if(!hashTableGet(&cls->methods, name, &v)) {
+    if(!classGetMethod(vm, cls, name, &v)) {
         return false;
     }
 
@@ -408,7 +493,7 @@ static bool getStringSubscript(JStarVM* vm) {
     if(IS_INT(arg)) {
         size_t idx = jsrCheckIndexNum(vm, AS_NUM(arg), str->length);
         if(idx == SIZE_MAX) return false;
-        ObjString* ret = copyString(vm, str->data + idx, 1);
+        ObjString* ret = newString(vm, stringData(str) + idx, 1);
 
         pop(vm), pop(vm);
         push(vm, OBJ_VAL(ret));
@@ -417,7 +502,7 @@ static bool getStringSubscript(JStarVM* vm) {
     if(IS_TUPLE(arg)) {
         size_t low = 0, high = 0;
         if(!checkSliceIndex(vm, AS_TUPLE(arg), str->length, &low, &high)) return false;
-        ObjString* ret = copyString(vm, str->data + low, high - low);
+        ObjString* ret = newString(vm, stringData(str) + low, high - low);
 
         pop(vm), pop(vm);
         push(vm, OBJ_VAL(ret));
@@ -428,12 +513,52 @@ static bool getStringSubscript(JStarVM* vm) {
     return false;
 }
 
-static void concatStrings(JStarVM* vm) {
-    ObjString *s1 = AS_STRING(peek2(vm)), *s2 = AS_STRING(peek(vm));
-    size_t length = s1->length + s2->length;
-    ObjString* conc = allocateString(vm, length);
-    memcpy(conc->data, s1->data, s1->length);
-    memcpy(conc->data + s1->length, s2->data, s2->length);
+static bool getTypedArraySubscript(JStarVM* vm) {
+    ObjTypedArray* arr = AS_TYPED_ARRAY(peek2(vm));
+    Value arg = peek(vm);
+
+    if(IS_INT(arg)) {
+        size_t idx = jsrCheckIndexNum(vm, AS_NUM(arg), arr->size);
+        if(idx == SIZE_MAX) return false;
+
+        pop(vm), pop(vm);
+        push(vm, typedArrayGet(arr, idx));
+        return true;
+    }
+    if(IS_TUPLE(arg)) {
+        size_t low = 0, high = 0;
+        if(!checkSliceIndex(vm, AS_TUPLE(arg), arr->size, &low, &high)) return false;
+
+        size_t elemSize = typedArrayElemSize(arr->type);
+        ObjTypedArray* ret = newTypedArray(vm, arr->type, high - low);
+        memcpy(ret->data, arr->data + low * elemSize, (high - low) * elemSize);
+
+        pop(vm), pop(vm);
+        push(vm, OBJ_VAL(ret));
+        return true;
+    }
+
+    jsrRaise(vm, "TypeException", "Index of %s subscript must be an integer or a Tuple",
+             stringData(arr->base.cls->name));
+    return false;
+}
+
+bool typedArrayStore(JStarVM* vm, ObjTypedArray* arr, size_t i, Value val) {
+    if(!IS_NUM(val)) {
+        jsrRaise(vm, "TypeException", "Elements of %s must be Numbers, got %s.",
+                 stringData(arr->base.cls->name), stringData(getClass(vm, val)->name));
+        return false;
+    }
+    if(!typedArraySet(arr, i, AS_NUM(val))) {
+        jsrRaise(vm, "TypeException", "Number %g can't be stored in %s.", AS_NUM(val),
+                 stringData(arr->base.cls->name));
+        return false;
+    }
+    return true;
+}
+
+static void concatOperands(JStarVM* vm) {
+    ObjString* conc = concatStrings(vm, AS_STRING(peek2(vm)), AS_STRING(peek(vm)));
     pop(vm), pop(vm);
     push(vm, OBJ_VAL(conc));
 }
@@ -442,7 +567,7 @@ static bool binOverload(JStarVM* vm, const char* op, MethodSymbol overload, Meth
     Value method;
     ObjClass* cls1 = getClass(vm, peek2(vm));
 
-    if(hashTableGet(&cls1->methods, vm->methodSyms[overload], &method)) {
+    if(classGetMethod(vm, cls1, vm->methodSyms[overload], &method)) {
         return callValue(vm, method, 1);
     }
 
@@ -450,13 +575,13 @@ static bool binOverload(JStarVM* vm, const char* op, MethodSymbol overload, Meth
     if(reverse != SYM_END) {
         swapStackSlots(vm, -1, -2);
 
-        if(hashTableGet(&cls2->methods, vm->methodSyms[reverse], &method)) {
+        if(classGetMethod(vm, cls2, vm->methodSyms[reverse], &method)) {
             return callValue(vm, method, 1);
         }
     }
 
-    jsrRaise(vm, "TypeException", "Operator %s not defined for types %s, %s", op, cls1->name->data,
-             cls2->name->data);
+    jsrRaise(vm, "TypeException", "Operator %s not defined for types %s, %s", op,
+             stringData(cls1->name), stringData(cls2->name));
     return false;
 }
 
@@ -464,11 +589,12 @@ static bool unaryOverload(JStarVM* vm, const char* op, MethodSymbol overload) {
     Value method;
     ObjClass* cls = getClass(vm, peek(vm));
 
-    if(hashTableGet(&cls->methods, vm->methodSyms[overload], &method)) {
+    if(classGetMethod(vm, cls, vm->methodSyms[overload], &method)) {
         return callValue(vm, method, 0);
     }
 
-    jsrRaise(vm, "TypeException", "Unary operator %s not defined for type %s", op, cls->name->data);
+    jsrRaise(vm, "TypeException", "Unary operator %s not defined for type %s", op,
+             stringData(cls->name));
     return false;
 }
 
@@ -480,7 +606,7 @@ static bool unpackCall(JStarVM* vm, uint8_t argc, uint8_t* out) {
 
     if(!IS_LIST(peek(vm)) && !IS_TUPLE(peek(vm))) {
         jsrRaise(vm, "TypeException", "Can unpack only Tuple or List, got %s.",
-                 getClass(vm, peek(vm))->name->data);
+                 stringData(getClass(vm, peek(vm))->name));
         return false;
     }
 
@@ -521,7 +647,7 @@ static bool unpackObject(JStarVM* vm, Obj* o, uint8_t n) {
 
 static JStarNative resolveNative(ObjModule* m, const char* cls, const char* name) {
     JStarNative n;
-    if((n = resolveBuiltIn(m->name->data, cls, name)) != NULL) {
+    if((n = resolveBuiltIn(stringData(m->name), cls, name)) != NULL) {
         return n;
     }
 
@@ -559,11 +685,11 @@ bool getValueField(JStarVM* vm, ObjString* name) {
             ObjInstance* inst = AS_INSTANCE(val);
 
             // Try top find a field
-            if(!hashTableGet(&inst->fields, name, &field)) {
+            if(!instanceGetField(inst, name, &field)) {
                 // no field, try to bind method
                 if(!bindMethod(vm, inst->base.cls, name)) {
                     jsrRaise(vm, "FieldException", "Object %s doesn't have field `%s`.",
-                             inst->base.cls->name->data, name->data);
+                             stringData(inst->base.cls->name), stringData(name));
                     return false;
                 }
                 return true;
@@ -582,7 +708,7 @@ bool getValueField(JStarVM* vm, ObjString* name) {
                 // No global, try to bind method
                 if(!bindMethod(vm, mod->base.cls, name)) {
                     jsrRaise(vm, "NameException", "Name `%s` is not defined in module %s",
-                             name->data, mod->name->data);
+                             stringData(name), stringData(mod->name));
                     return false;
                 }
                 return true;
@@ -599,8 +725,8 @@ bool getValueField(JStarVM* vm, ObjString* name) {
 
     ObjClass* cls = getClass(vm, val);
     if(!bindMethod(vm, cls, name)) {
-        jsrRaise(vm, "FieldException", "Object %s doesn't have field `%s`.", cls->name->data,
-                 name->data);
+        jsrRaise(vm, "FieldException", "Object %s doesn't have field `%s`.", stringData(cls->name),
+                 stringData(name));
         return false;
     }
     return true;
@@ -612,12 +738,12 @@ bool setValueField(JStarVM* vm, ObjString* name) {
         switch(OBJ_TYPE(val)) {
         case OBJ_INST: {
             ObjInstance* inst = AS_INSTANCE(val);
-            hashTablePut(&inst->fields, name, peek(vm));
+            instanceSetField(vm, inst, name, peek(vm));
             return true;
         }
         case OBJ_MODULE: {
             ObjModule* mod = AS_MODULE(val);
-            hashTablePut(&mod->globals, name, peek(vm));
+            moduleSetGlobal(vm, mod, name, peek(vm));
             return true;
         }
         default:
@@ -626,8 +752,8 @@ bool setValueField(JStarVM* vm, ObjString* name) {
     }
 
     ObjClass* cls = getClass(vm, val);
-    jsrRaise(vm, "FieldException", "Object %s doesn't have field `%s`.", cls->name->data,
-             name->data);
+    jsrRaise(vm, "FieldException", "Object %s doesn't have field `%s`.", stringData(cls->name),
+             stringData(name));
     return false;
 }
 
@@ -641,6 +767,8 @@ bool getValueSubscript(JStarVM* vm) {
             return getTupleSubscript(vm);
         case OBJ_STRING:
             return getStringSubscript(vm);
+        case OBJ_TYPED_ARRAY:
+            return getTypedArraySubscript(vm);
         default:
             break;
         }
@@ -666,9 +794,27 @@ bool setValueSubscript(JStarVM* vm) {
         if(index == SIZE_MAX) return false;
 
         list->arr[index] = val;
+        gcWriteBarrier(vm, (Obj*)list, val);
         return true;
     }
 
+    if(IS_TYPED_ARRAY(peek(vm))) {
+        Value operand = pop(vm), arg = pop(vm), val = peek(vm);
+        ObjTypedArray* arr = AS_TYPED_ARRAY(operand);
+
+        if(!IS_NUM(arg) || !isInt(AS_NUM(arg))) {
+            jsrRaise(vm, "TypeException", "Index of %s subscript access must be an integer.",
+                     stringData(arr->base.cls->name));
+            return false;
+        }
+
+        size_t index = jsrCheckIndexNum(vm, AS_NUM(arg), arr->size);
+        if(index == SIZE_MAX) return false;
+
+        // Elements are unboxed numbers, so no write barrier is needed
+        return typedArrayStore(vm, arr, index, val);
+    }
+
     // swap operand and value to prepare function call
     swapStackSlots(vm, -1, -3);
     if(!invokeMethod(vm, getClass(vm, peekn(vm, 2)), vm->methodSyms[SYM_SET], 2)) {
@@ -698,7 +844,7 @@ bool callValue(JStarVM* vm, Value callee, uint8_t argc) {
 
             if(isNonInstantiableBuiltin(vm, cls)) {
                 jsrRaise(vm, "Exception", "class %s can't be directly instatiated",
-                         cls->name->data);
+                         stringData(cls->name));
                 return false;
             }
 
@@ -709,12 +855,12 @@ bool callValue(JStarVM* vm, Value callee, uint8_t argc) {
             }
 
             Value ctor;
-            if(hashTableGet(&cls->methods, vm->methodSyms[SYM_CTOR], &ctor)) {
+            if(classGetMethod(vm, cls, vm->methodSyms[SYM_CTOR], &ctor)) {
                 return callValue(vm, ctor, argc);
             } else if(argc != 0) {
                 jsrRaise(vm, "TypeException",
                          "Function %s.new() Expected 0 args, but instead `%d` supplied.",
-                         cls->name->data, argc);
+                         stringData(cls->name), argc);
                 return false;
             }
 
@@ -726,7 +872,7 @@ bool callValue(JStarVM* vm, Value callee, uint8_t argc) {
     }
 
     ObjClass* cls = getClass(vm, callee);
-    jsrRaise(vm, "TypeException", "Object %s is not a callable.", cls->name->data);
+    jsrRaise(vm, "TypeException", "Object %s is not a callable.", stringData(cls->name));
     return false;
 }
 
@@ -740,18 +886,18 @@ bool invokeValue(JStarVM* vm, ObjString* name, uint8_t argc) {
 
             // First try to find a method
             Value method;
-            if(hashTableGet(&cls->methods, name, &method)) {
+            if(classGetMethod(vm, cls, name, &method)) {
                 return callValue(vm, method, argc);
             }
 
             // If no method is found try a field
             Value field;
-            if(hashTableGet(&inst->fields, name, &field)) {
+            if(instanceGetField(inst, name, &field)) {
                 return callValue(vm, field, argc);
             }
 
-            jsrRaise(vm, "MethodException", "Method %s.%s() doesn't exists", cls->name->data,
-                     name->data);
+            jsrRaise(vm, "MethodException", "Method %s.%s() doesn't exists", stringData(cls->name),
+                     stringData(name));
             return false;
         }
         case OBJ_MODULE: {
@@ -759,7 +905,7 @@ bool invokeValue(JStarVM* vm, ObjString* name, uint8_t argc) {
             ObjModule* mod = AS_MODULE(val);
 
             // Check if method shadows a function in the module
-            if(hashTableGet(&vm->modClass->methods, name, &func)) {
+            if(classGetMethod(vm, vm->modClass, name, &func)) {
                 return callValue(vm, func, argc);
             }
 
@@ -768,8 +914,8 @@ bool invokeValue(JStarVM* vm, ObjString* name, uint8_t argc) {
                 return callValue(vm, func, argc);
             }
 
-            jsrRaise(vm, "NameException", "Name `%s` is not defined in module %s.", name->data,
-                     mod->name->data);
+            jsrRaise(vm, "NameException", "Name `%s` is not defined in module %s.",
+                     stringData(name), stringData(mod->name));
             return false;
         }
         default:
@@ -796,8 +942,10 @@ inline void reserveStack(JStarVM* vm, size_t needed) {
     if(vm->sp + needed < vm->stack + vm->stackSz) return;
 
     Value* oldStack = vm->stack;
+    size_t oldSz = vm->stackSz;
     vm->stackSz = powerOf2Ceil(vm->stackSz);
-    vm->stack = realloc(vm->stack, sizeof(Value) * vm->stackSz);
+    vm->stack = gcAllocInternal(vm, MEM_VM, vm->stack, sizeof(Value) * oldSz,
+                                sizeof(Value) * vm->stackSz);
 
     if(vm->stack != oldStack) {
         if(vm->apiStack >= oldStack && vm->apiStack <= vm->sp) {
@@ -833,6 +981,205 @@ inline void swapStackSlots(JStarVM* vm, int a, int b) {
 // EVAL LOOP
 // -----------------------------------------------------------------------------
 
+// Resolves a global variable using the symbol's inline cache, falling back to a
+// HashTable lookup on a miss. Returns NULL if the variable is not defined
+static inline Value* resolveGlobal(JStarVM* vm, ObjFunction* fn, Symbol* sym) {
+    ObjModule* mod = vm->module;
+    SymbolCache* cache = &sym->cache;
+    if(cache->key == (Obj*)mod && cache->version == mod->globalsVersion) {
+        return cache->as.value;
+    }
+
+    ObjString* name = AS_STRING(fn->code.consts.arr[sym->constant]);
+    Value* global = hashTableGetPtr(&mod->globals, name);
+    if(global != NULL) {
+        cache->key = (Obj*)mod;
+        cache->version = mod->globalsVersion;
+        cache->as.value = global;
+    }
+    return global;
+}
+
+// Looks up a field of an instance using the symbol's inline cache, keyed on the shape of
+// the instance. Returns NULL if the field is not defined
+static inline Value* resolveField(ObjInstance* inst, ObjFunction* fn, Symbol* sym) {
+    ObjShape* shape = inst->shape;
+    SymbolCache* cache = &sym->cache;
+    if(cache->key == (Obj*)shape && shape != NULL) {
+        return &inst->fields[cache->as.offset];
+    }
+
+    ObjString* name = AS_STRING(fn->code.consts.arr[sym->constant]);
+    if(shape == NULL) {
+        return hashTableGetPtr(inst->dict, name);
+    }
+
+    int idx = shapeGetFieldIndex(shape, name);
+    if(idx == -1) return NULL;
+
+    cache->key = (Obj*)shape;
+    cache->as.offset = idx;
+    return &inst->fields[idx];
+}
+
+static void addMethodCache(JStarVM* vm, Symbol* sym, ObjClass* cls, Obj* method) {
+    SymbolCache* entry = NULL;
+    if(sym->cache.key == NULL) {
+        entry = &sym->cache;
+    } else {
+        if(sym->polyCache == NULL) {
+            size_t size = (POLY_CACHE_SIZE - 1) * sizeof(SymbolCache);
+            sym->polyCache = gcAllocInternal(vm, MEM_CODE, NULL, 0, size);
+            memset(sym->polyCache, 0, size);
+        }
+        for(int i = 0; i < POLY_CACHE_SIZE - 1; i++) {
+            if(sym->polyCache[i].key == NULL) {
+                entry = &sym->polyCache[i];
+                break;
+            }
+        }
+    }
+
+    if(entry == NULL) {
+        sym->megamorphic = true;
+        return;
+    }
+
+    entry->key = (Obj*)cls;
+    entry->version = vm->methodsVersion;
+    entry->as.method = method;
+}
+
+static void clearMethodCache(Symbol* sym) {
+    sym->megamorphic = false;
+    sym->cache.key = NULL;
+    if(sym->polyCache != NULL) {
+        for(int i = 0; i < POLY_CACHE_SIZE - 1; i++) {
+            sym->polyCache[i].key = NULL;
+        }
+    }
+}
+
+// Resolves a method of `cls` using the symbol's polymorphic inline cache, falling back to
+// a lookup in the class's method table on a miss. Returns NULL if the method doesn't exist
+static inline Obj* resolveMethod(JStarVM* vm, ObjFunction* fn, ObjClass* cls, Symbol* sym) {
+    SymbolCache* cache = &sym->cache;
+    if(cache->key == (Obj*)cls && cache->version == vm->methodsVersion) {
+        vm->methodCache.hits++;
+        return cache->as.method;
+    }
+
+    if(sym->polyCache != NULL) {
+        for(int i = 0; i < POLY_CACHE_SIZE - 1; i++) {
+            SymbolCache* entry = &sym->polyCache[i];
+            if(entry->key == (Obj*)cls && entry->version == vm->methodsVersion) {
+                vm->methodCache.hits++;
+                return entry->as.method;
+            }
+        }
+    }
+
+    // The methods version is global, so if an entry is stale all of them are
+    if(cache->key != NULL && cache->version != vm->methodsVersion) {
+        clearMethodCache(sym);
+    }
+
+    vm->methodCache.misses++;
+    if(sym->megamorphic) {
+        vm->methodCache.megamorphic++;
+    }
+
+    Value method;
+    ObjString* name = AS_STRING(fn->code.consts.arr[sym->constant]);
+    if(!classGetMethod(vm, cls, name, &method)) {
+        return NULL;
+    }
+
+    if(!sym->megamorphic) {
+        addMethodCache(vm, sym, cls, AS_OBJ(method));
+        // The cache keeps its key alive, so it references it
+        gcWriteBarrier(vm, (Obj*)fn, OBJ_VAL(cls));
+    }
+    return AS_OBJ(method);
+}
+
+// Iterator of a sequence of `size` elements, where `iter` is the index of the current one
+static inline Value sequenceIter(Value iter, size_t size) {
+    if(IS_NULL(iter) && size != 0) {
+        return NUM_VAL(0);
+    }
+    if(IS_NUM(iter)) {
+        size_t idx = (size_t)AS_NUM(iter);
+        if(idx < size - 1) return NUM_VAL(idx + 1);
+    }
+    return BOOL_VAL(false);
+}
+
+static inline Value tableIter(ObjTable* t, Value iter) {
+    size_t lastIdx = 0;
+    if(IS_NUM(iter)) {
+        lastIdx = (size_t)AS_NUM(iter) + 1;
+    }
+
+    for(size_t i = lastIdx; i < t->numEntries; i++) {
+        if(!IS_NULL(t->entries[i].key)) return NUM_VAL(i);
+    }
+    return BOOL_VAL(false);
+}
+
+// Fast path of OP_FOR_ITER for the builtin List, Tuple, String, Table and typed arrays. If
+// `iterMeth` is the builtin `__iter__` of the iterable, computes the next iterator directly in the
+// eval loop instead of calling it. Must be kept in sync with the `__iter__` natives in std/core.c
+static inline bool builtinIter(Value iterMeth, Value iterable, Value iter, Value* res) {
+    if(!IS_NATIVE(iterMeth)) return false;
+    JStarNative native = AS_NATIVE(iterMeth)->fn;
+
+    if(native == &jsr_List_iter && IS_LIST(iterable)) {
+        *res = sequenceIter(iter, AS_LIST(iterable)->size);
+    } else if(native == &jsr_Tuple_iter && IS_TUPLE(iterable)) {
+        *res = sequenceIter(iter, AS_TUPLE(iterable)->size);
+    } else if(native == &jsr_String_iter && IS_STRING(iterable)) {
+        *res = sequenceIter(iter, AS_STRING(iterable)->length);
+    } else if(native == &jsr_Table_iter && IS_TABLE(iterable)) {
+        *res = tableIter(AS_TABLE(iterable), iter);
+    } else if(native == &jsr_TypedArray_iter && IS_TYPED_ARRAY(iterable)) {
+        *res = sequenceIter(iter, AS_TYPED_ARRAY(iterable)->size);
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+// Fast path of OP_FOR_NEXT, the counterpart of `builtinIter` for the `__next__` natives
+static inline bool builtinNext(JStarVM* vm, Value nextMeth, Value iterable, Value iter,
+                               Value* res) {
+    if(!IS_NATIVE(nextMeth)) return false;
+    JStarNative native = AS_NATIVE(nextMeth)->fn;
+    size_t idx = IS_NUM(iter) ? (size_t)AS_NUM(iter) : SIZE_MAX;
+
+    if(native == &jsr_List_next && IS_LIST(iterable)) {
+        ObjList* lst = AS_LIST(iterable);
+        *res = idx < lst->size ? lst->arr[idx] : NULL_VAL;
+    } else if(native == &jsr_Tuple_next && IS_TUPLE(iterable)) {
+        ObjTuple* tup = AS_TUPLE(iterable);
+        *res = idx < tup->size ? tup->arr[idx] : NULL_VAL;
+    } else if(native == &jsr_String_next && IS_STRING(iterable)) {
+        ObjString* str = AS_STRING(iterable);
+        *res = idx < str->length ? OBJ_VAL(newString(vm, stringData(str) + idx, 1)) : NULL_VAL;
+    } else if(native == &jsr_Table_next && IS_TABLE(iterable)) {
+        ObjTable* t = AS_TABLE(iterable);
+        *res = idx < t->numEntries ? t->entries[idx].key : NULL_VAL;
+    } else if(native == &jsr_TypedArray_next && IS_TYPED_ARRAY(iterable)) {
+        ObjTypedArray* arr = AS_TYPED_ARRAY(iterable);
+        *res = idx < arr->size ? typedArrayGet(arr, idx) : NULL_VAL;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
 bool runEval(JStarVM* vm, int evalDepth) {
     register Frame* frame;
     register Value* frameStack;
@@ -859,17 +1206,42 @@ bool runEval(JStarVM* vm, int evalDepth) {
 
 #define GET_CONST()  (fn->code.consts.arr[NEXT_SHORT()])
 #define GET_STRING() (AS_STRING(GET_CONST()))
+#define GET_SYMBOL() (&fn->code.symbols[NEXT_SHORT()])
+#define SYMBOL_NAME(sym) (AS_STRING(fn->code.consts.arr[(sym)->constant]))
+
+// Rewrites the current instruction with a version specialized on the types of its operands
+#define QUICKEN(opcode) (ip[-1] = (opcode))
+
+// Reverts a quickened instruction to its generic version and re-executes it
+#define DEOPTIMIZE(opcode) \
+    do {                   \
+        ip[-1] = (opcode); \
+        ip--;              \
+        DISPATCH();        \
+    } while(0)
 
-#define BINARY(type, op, overload, reverse)         \
-    do {                                            \
-        if(IS_NUM(peek(vm)) && IS_NUM(peek2(vm))) { \
-            double b = AS_NUM(pop(vm));             \
-            double a = AS_NUM(pop(vm));             \
-            push(vm, type(a op b));                 \
-        } else {                                    \
-            BINARY_OVERLOAD(op, overload, reverse); \
-        }                                           \
-        DISPATCH();                                 \
+#define BINARY(type, op, overload, reverse, quickened) \
+    do {                                               \
+        if(IS_NUM(peek(vm)) && IS_NUM(peek2(vm))) {    \
+            QUICKEN(quickened);                        \
+            double b = AS_NUM(pop(vm));                \
+            double a = AS_NUM(pop(vm));                \
+            push(vm, type(a op b));                    \
+        } else {                                       \
+            BINARY_OVERLOAD(op, overload, reverse);    \
+        }                                              \
+        DISPATCH();                                    \
+    } while(0)
+
+#define BINARY_NUM(type, op, generic)                  \
+    do {                                               \
+        if(!IS_NUM(peek(vm)) || !IS_NUM(peek2(vm))) {  \
+            DEOPTIMIZE(generic);                       \
+        }                                              \
+        double b = AS_NUM(pop(vm));                    \
+        double a = AS_NUM(pop(vm));                    \
+        push(vm, type(a op b));                        \
+        DISPATCH();                                    \
     } while(0)
 
 #define BINARY_OVERLOAD(op, overload, reverse)              \
@@ -930,13 +1302,17 @@ bool runEval(JStarVM* vm, int evalDepth) {
         DISPATCH();                       \
     } while(0)
 
-#define CHECK_EVAL_BREAK(vm)                        \
-    do {                                            \
-        if(vm->evalBreak) {                         \
-            vm->evalBreak = 0;                      \
-            jsrRaise(vm, "ProgramInterrupt", NULL); \
-            UNWIND_STACK(vm);                       \
-        }                                           \
+#define CHECK_EVAL_BREAK(vm)                            \
+    do {                                                \
+        if(vm->evalBreak) {                             \
+            vm->evalBreak = 0;                          \
+            if(vm->outOfMemory) {                       \
+                raiseOutOfMemory(vm);                   \
+            } else {                                    \
+                jsrRaise(vm, "ProgramInterrupt", NULL); \
+            }                                           \
+            UNWIND_STACK(vm);                           \
+        }                                               \
     } while(0)
 
 #ifdef JSTAR_DBG_PRINT_EXEC
@@ -986,11 +1362,13 @@ bool runEval(JStarVM* vm, int evalDepth) {
 
     TARGET(OP_ADD): {
         if(IS_NUM(peek(vm)) && IS_NUM(peek2(vm))) {
+            QUICKEN(OP_ADD_NUM);
             double b = AS_NUM(pop(vm));
             double a = AS_NUM(pop(vm));
             push(vm, NUM_VAL(a + b));
         } else if(IS_STRING(peek(vm)) && IS_STRING(peek2(vm))) {
-            concatStrings(vm);
+            QUICKEN(OP_ADD_STR);
+            concatOperands(vm);
         } else {
             BINARY_OVERLOAD(+, SYM_ADD, SYM_RADD);
         }
@@ -1042,13 +1420,13 @@ bool runEval(JStarVM* vm, int evalDepth) {
         DISPATCH();
     }
 
-    TARGET(OP_SUB):    BINARY(NUM_VAL, -, SYM_SUB, SYM_RSUB);
-    TARGET(OP_MUL):    BINARY(NUM_VAL, *, SYM_MUL, SYM_RMUL);
-    TARGET(OP_DIV):    BINARY(NUM_VAL, /, SYM_DIV, SYM_RDIV);
-    TARGET(OP_LT):     BINARY(BOOL_VAL, <, SYM_LT, SYM_END);
-    TARGET(OP_LE):     BINARY(BOOL_VAL, <=, SYM_LE, SYM_END);
-    TARGET(OP_GT):     BINARY(BOOL_VAL, >, SYM_GT, SYM_END);
-    TARGET(OP_GE):     BINARY(BOOL_VAL, >=, SYM_GE, SYM_END);
+    TARGET(OP_SUB):    BINARY(NUM_VAL, -, SYM_SUB, SYM_RSUB, OP_SUB_NUM);
+    TARGET(OP_MUL):    BINARY(NUM_VAL, *, SYM_MUL, SYM_RMUL, OP_MUL_NUM);
+    TARGET(OP_DIV):    BINARY(NUM_VAL, /, SYM_DIV, SYM_RDIV, OP_DIV_NUM);
+    TARGET(OP_LT):     BINARY(BOOL_VAL, <, SYM_LT, SYM_END, OP_LT_NUM);
+    TARGET(OP_LE):     BINARY(BOOL_VAL, <=, SYM_LE, SYM_END, OP_LE_NUM);
+    TARGET(OP_GT):     BINARY(BOOL_VAL, >, SYM_GT, SYM_END, OP_GT_NUM);
+    TARGET(OP_GE):     BINARY(BOOL_VAL, >=, SYM_GE, SYM_END, OP_GE_NUM);
     TARGET(OP_LSHIFT): BITWISE(<<, <<, SYM_LSHFT, SYM_RLSHFT);
     TARGET(OP_RSHIFT): BITWISE(>>, >>, SYM_RSHFT, SYM_RRSHFT);
     TARGET(OP_BAND):   BITWISE(&, &, SYM_BAND, SYM_RBAND);
@@ -1056,6 +1434,23 @@ bool runEval(JStarVM* vm, int evalDepth) {
     TARGET(OP_XOR):    BITWISE(~, ^, SYM_XOR, SYM_RXOR);
     TARGET(OP_NEG):    UNARY(NUM_VAL, -, SYM_NEG);
 
+    TARGET(OP_ADD_NUM): BINARY_NUM(NUM_VAL, +, OP_ADD);
+    TARGET(OP_SUB_NUM): BINARY_NUM(NUM_VAL, -, OP_SUB);
+    TARGET(OP_MUL_NUM): BINARY_NUM(NUM_VAL, *, OP_MUL);
+    TARGET(OP_DIV_NUM): BINARY_NUM(NUM_VAL, /, OP_DIV);
+    TARGET(OP_LT_NUM):  BINARY_NUM(BOOL_VAL, <, OP_LT);
+    TARGET(OP_LE_NUM):  BINARY_NUM(BOOL_VAL, <=, OP_LE);
+    TARGET(OP_GT_NUM):  BINARY_NUM(BOOL_VAL, >, OP_GT);
+    TARGET(OP_GE_NUM):  BINARY_NUM(BOOL_VAL, >=, OP_GE);
+
+    TARGET(OP_ADD_STR): {
+        if(!IS_STRING(peek(vm)) || !IS_STRING(peek2(vm))) {
+            DEOPTIMIZE(OP_ADD);
+        }
+        concatOperands(vm);
+        DISPATCH();
+    }
+
     TARGET(OP_IS): {
         if(!IS_CLASS(peek(vm))) {
             jsrRaise(vm, "TypeException", "Right operand of `is` must be a Class");
@@ -1068,6 +1463,9 @@ bool runEval(JStarVM* vm, int evalDepth) {
     }
 
     TARGET(OP_SUBSCR_GET): {
+        if(IS_LIST(peek2(vm))) {
+            QUICKEN(OP_SUBSCR_GET_LIST);
+        }
         SAVE_STATE();
         bool res = getValueSubscript(vm);
         LOAD_STATE();
@@ -1075,6 +1473,23 @@ bool runEval(JStarVM* vm, int evalDepth) {
         DISPATCH();
     }
 
+    TARGET(OP_SUBSCR_GET_LIST): {
+        if(!IS_LIST(peek2(vm))) {
+            DEOPTIMIZE(OP_SUBSCR_GET);
+        }
+        ObjList* lst = AS_LIST(peek2(vm));
+        Value arg = peek(vm);
+        if(IS_NUM(arg) && AS_NUM(arg) >= 0 && AS_NUM(arg) < lst->size && IS_INT(arg)) {
+            pop(vm);
+            vm->sp[-1] = lst->arr[(size_t)AS_NUM(arg)];
+            DISPATCH();
+        }
+        if(!getListSubscript(vm)) {
+            UNWIND_STACK(vm);
+        }
+        DISPATCH();
+    }
+
     TARGET(OP_SUBSCR_SET): {
         SAVE_STATE();
         bool res = setValueSubscript(vm);
@@ -1084,14 +1499,51 @@ bool runEval(JStarVM* vm, int evalDepth) {
     }
 
     TARGET(OP_GET_FIELD): {
-        if(!getValueField(vm, GET_STRING())) {
+        Symbol* sym = GET_SYMBOL();
+        if(IS_INSTANCE(peek(vm))) {
+            ObjInstance* inst = AS_INSTANCE(peek(vm));
+            Value* field = resolveField(inst, fn, sym);
+            if(field != NULL) {
+                vm->sp[-1] = *field;
+                DISPATCH();
+            }
+        }
+        if(!getValueField(vm, SYMBOL_NAME(sym))) {
+            UNWIND_STACK(vm);
+        }
+        DISPATCH();
+    }
+
+    TARGET(OP_GET_LOCAL_FIELD): {
+        Value local = frameStack[NEXT_CODE()];
+        Symbol* sym = GET_SYMBOL();
+        if(IS_INSTANCE(local)) {
+            Value* field = resolveField(AS_INSTANCE(local), fn, sym);
+            if(field != NULL) {
+                push(vm, *field);
+                DISPATCH();
+            }
+        }
+        push(vm, local);
+        if(!getValueField(vm, SYMBOL_NAME(sym))) {
             UNWIND_STACK(vm);
         }
         DISPATCH();
     }
 
     TARGET(OP_SET_FIELD): {
-        if(!setValueField(vm, GET_STRING())) {
+        Symbol* sym = GET_SYMBOL();
+        if(IS_INSTANCE(peek(vm))) {
+            ObjInstance* inst = AS_INSTANCE(peek(vm));
+            Value* field = resolveField(inst, fn, sym);
+            if(field != NULL) {
+                *field = peek2(vm);
+                gcWriteBarrier(vm, (Obj*)inst, *field);
+                pop(vm);
+                DISPATCH();
+            }
+        }
+        if(!setValueField(vm, SYMBOL_NAME(sym))) {
             UNWIND_STACK(vm);
         }
         DISPATCH();
@@ -1118,17 +1570,44 @@ bool runEval(JStarVM* vm, int evalDepth) {
 
     TARGET(OP_FOR_PREP): {
         ObjClass* cls = getClass(vm, vm->sp[-2]);
-        if(!hashTableGet(&cls->methods, vm->methodSyms[SYM_ITER], &vm->sp[0]) ||
-           !hashTableGet(&cls->methods, vm->methodSyms[SYM_NEXT], &vm->sp[1])) {
+        if(!classGetMethod(vm, cls, vm->methodSyms[SYM_ITER], &vm->sp[0]) ||
+           !classGetMethod(vm, cls, vm->methodSyms[SYM_NEXT], &vm->sp[1])) {
             jsrRaise(vm, "MethodException", "Class %s does not implement __iter__ and __next__",
-                     cls->name->data);
+                     stringData(cls->name));
             UNWIND_STACK(vm);
         }
+
+        // Iteration over a builtin Range is executed as a counted loop: the hidden locals of
+        // the loop are replaced with its start, iterator, stop and step, in this order
+        double start, stop, step;
+        if(IS_NATIVE(vm->sp[0]) && AS_NATIVE(vm->sp[0])->fn == &jsr_Range_iter &&
+           IS_NATIVE(vm->sp[1]) && AS_NATIVE(vm->sp[1])->fn == &jsr_Range_next &&
+           getRangeBounds(vm, vm->sp[-2], &start, &stop, &step)) {
+            vm->sp[-2] = NUM_VAL(start);
+            vm->sp[0] = NUM_VAL(stop);
+            vm->sp[1] = NUM_VAL(step);
+        }
+
         vm->sp += 2;
         DISPATCH();
     }
 
     TARGET(OP_FOR_ITER): {
+        // Counted loop over a Range (see OP_FOR_PREP)
+        if(IS_NUM(vm->sp[-2])) {
+            double stop = AS_NUM(vm->sp[-2]), step = AS_NUM(vm->sp[-1]);
+            Value iter = vm->sp[-3];
+            double i = IS_NULL(iter) ? AS_NUM(vm->sp[-4]) : AS_NUM(iter) + step;
+            push(vm, (step > 0 ? i < stop : i > stop) ? NUM_VAL(i) : BOOL_VAL(false));
+            DISPATCH();
+        }
+
+        // sp[-2] holds the cached __iter__ method, sp[-3] the iterator and sp[-4] the iterable
+        if(builtinIter(vm->sp[-2], vm->sp[-4], vm->sp[-3], vm->sp)) {
+            vm->sp++;
+            DISPATCH();
+        }
+
         vm->sp[0] = vm->sp[-4];
         vm->sp[1] = vm->sp[-3];
         vm->sp += 2;
@@ -1143,6 +1622,18 @@ bool runEval(JStarVM* vm, int evalDepth) {
         int16_t off = NEXT_SHORT();
         vm->sp[-4] = vm->sp[-1];
         if(valueToBool(pop(vm))) {
+            // The element of a counted loop is the iterator itself
+            if(IS_NUM(vm->sp[-1])) {
+                push(vm, vm->sp[-3]);
+                DISPATCH();
+            }
+
+            // sp[-1] holds the cached __next__ method
+            if(builtinNext(vm, vm->sp[-1], vm->sp[-4], vm->sp[-3], vm->sp)) {
+                vm->sp++;
+                DISPATCH();
+            }
+
             vm->sp[0] = vm->sp[-4];
             vm->sp[1] = vm->sp[-3];
             vm->sp += 2;
@@ -1224,10 +1715,23 @@ call:
         goto invoke;
 
 invoke:;
-        ObjString* name = GET_STRING();
+        Symbol* sym = GET_SYMBOL();
+        Value receiver = peekn(vm, argc);
+
+        Obj* method = NULL;
+        if(!IS_MODULE(receiver)) {
+            method = resolveMethod(vm, fn, getClass(vm, receiver), sym);
+        }
+
         SAVE_STATE();
-        bool res = invokeValue(vm, name, argc);
+        bool res;
+        if(method != NULL) {
+            res = callValue(vm, OBJ_VAL(method), argc);
+        } else {
+            res = invokeValue(vm, SYMBOL_NAME(sym), argc);
+        }
         LOAD_STATE();
+
         if(!res) UNWIND_STACK(vm);
         DISPATCH();
     }
@@ -1260,11 +1764,19 @@ invoke:;
         goto supinvoke;
 
 supinvoke:;
-        ObjString* name = GET_STRING();
+        Symbol* sym = GET_SYMBOL();
         ObjClass* superCls = AS_CLASS(fn->code.consts.arr[SUPER_SLOT]);
+        Obj* method = resolveMethod(vm, fn, superCls, sym);
+
         SAVE_STATE();
-        bool res = invokeMethod(vm, superCls, name, argc);
+        bool res;
+        if(method != NULL) {
+            res = callValue(vm, OBJ_VAL(method), argc);
+        } else {
+            res = invokeMethod(vm, superCls, SYMBOL_NAME(sym), argc);
+        }
         LOAD_STATE();
+
         if(!res) UNWIND_STACK(vm);
         DISPATCH();
     }
@@ -1273,8 +1785,8 @@ supinvoke:;
         ObjString* name = GET_STRING();
         ObjClass* superCls = AS_CLASS(fn->code.consts.arr[SUPER_SLOT]);
         if(!bindMethod(vm, superCls, name)) {
-            jsrRaise(vm, "MethodException", "Method %s.%s() doesn't exists", superCls->name->data,
-                     name->data);
+            jsrRaise(vm, "MethodException", "Method %s.%s() doesn't exists",
+                     stringData(superCls->name), stringData(name));
             UNWIND_STACK(vm);
         }
         DISPATCH();
@@ -1314,7 +1826,7 @@ op_return:
         ObjModule* module = importModule(vm, name);
 
         if(module == NULL) {
-            jsrRaise(vm, "ImportException", "Cannot load module `%s`.", name->data);
+            jsrRaise(vm, "ImportException", "Cannot load module `%s`.", stringData(name));
             UNWIND_STACK(vm);
         }
 
@@ -1338,7 +1850,7 @@ op_return:
         ObjString* name = GET_STRING();
         if(!hashTableGet(&module->globals, name, vm->sp)) {
             jsrRaise(vm, "NameException", "Name `%s` not defined in module `%s`.", 
-                        name->data, module->name->data);
+                        stringData(name), stringData(module->name));
             UNWIND_STACK(vm);
         }
         vm->sp++;
@@ -1398,7 +1910,8 @@ op_return:
         }
         ObjClass* cls = AS_CLASS(pop(vm));
         if(isBuiltinClass(vm, cls)) {
-            jsrRaise(vm, "TypeException", "Cannot subclass builtin class %s", cls->name->data);
+            jsrRaise(vm, "TypeException", "Cannot subclass builtin class %s",
+                     stringData(cls->name));
             UNWIND_STACK(vm);
         }
         createClass(vm, GET_STRING(), cls);
@@ -1408,7 +1921,7 @@ op_return:
     TARGET(OP_UNPACK): {
         if(!IS_LIST(peek(vm)) && !IS_TUPLE(peek(vm))) {
             jsrRaise(vm, "TypeException", "Can unpack only Tuple or List, got %s.",
-                     getClass(vm, peek(vm))->name->data);
+                     stringData(getClass(vm, peek(vm))->name));
             UNWIND_STACK(vm);
         }
         if(!unpackObject(vm, AS_OBJ(pop(vm)),  NEXT_CODE())) {
@@ -1421,8 +1934,12 @@ op_return:
         ObjClass* cls = AS_CLASS(peek2(vm));
         ObjString* methodName = GET_STRING();
         // Set the super-class as a const in the method
-        AS_CLOSURE(peek(vm))->fn->code.consts.arr[SUPER_SLOT] = OBJ_VAL(cls->superCls);
-        hashTablePut(&cls->methods, methodName, pop(vm));
+        ObjFunction* method = AS_CLOSURE(peek(vm))->fn;
+        method->code.consts.arr[SUPER_SLOT] = OBJ_VAL(cls->superCls);
+        gcWriteBarrier(vm, (Obj*)method, OBJ_VAL(cls->superCls));
+        hashTablePut(vm, &cls->methods, methodName, peek(vm));
+        gcWriteBarrier(vm, (Obj*)cls, OBJ_VAL(methodName));
+        gcWriteBarrier(vm, (Obj*)cls, pop(vm));
         DISPATCH();
     }
     
@@ -1430,22 +1947,25 @@ op_return:
         ObjClass* cls = AS_CLASS(peek(vm));
         ObjString* methodName = GET_STRING();
         ObjNative* native = AS_NATIVE(GET_CONST());
-        native->fn = resolveNative(vm->module, cls->name->data, methodName->data);
+        native->fn = resolveNative(vm->module, stringData(cls->name), stringData(methodName));
         if(native->fn == NULL) {
-            jsrRaise(vm, "Exception", "Cannot resolve native method %s().", native->c.name->data);
+            jsrRaise(vm, "Exception", "Cannot resolve native method %s().",
+                     stringData(native->c.name));
             UNWIND_STACK(vm);
         }
-        hashTablePut(&cls->methods, methodName, OBJ_VAL(native));
+        hashTablePut(vm, &cls->methods, methodName, OBJ_VAL(native));
+        gcWriteBarrier(vm, (Obj*)cls, OBJ_VAL(methodName));
+        gcWriteBarrier(vm, (Obj*)cls, OBJ_VAL(native));
         DISPATCH();
     }
 
     TARGET(OP_NATIVE): {
         ObjString* name = GET_STRING();
         ObjNative* nat  = AS_NATIVE(peek(vm));
-        nat->fn = resolveNative(vm->module, NULL, name->data);
+        nat->fn = resolveNative(vm->module, NULL, stringData(name));
         if(nat->fn == NULL) {
             jsrRaise(vm, "Exception", "Cannot resolve native function %s.%s.", 
-                     vm->module->name->data, nat->c.name->data);
+                     stringData(vm->module->name), stringData(nat->c.name));
             UNWIND_STACK(vm);
         }
         DISPATCH();
@@ -1457,32 +1977,38 @@ op_return:
     }
 
     TARGET(OP_DEFINE_GLOBAL): {
-        hashTablePut(&vm->module->globals, GET_STRING(), pop(vm));
+        moduleSetGlobal(vm, vm->module, GET_STRING(), pop(vm));
         DISPATCH();
     }
 
     TARGET(OP_GET_GLOBAL): {
-        ObjString* name = GET_STRING();
-        if(!hashTableGet(&vm->module->globals, name, vm->sp)) {
-            jsrRaise(vm, "NameException", "Name `%s` is not defined.", name->data);
+        Symbol* sym = GET_SYMBOL();
+        Value* global = resolveGlobal(vm, fn, sym);
+        if(global == NULL) {
+            jsrRaise(vm, "NameException", "Name `%s` is not defined.",
+                     stringData(SYMBOL_NAME(sym)));
             UNWIND_STACK(vm);
         }
-        vm->sp++;
+        push(vm, *global);
         DISPATCH();
     }
 
     TARGET(OP_SET_GLOBAL): {
-        ObjString* name = GET_STRING();
-        if(hashTablePut(&vm->module->globals, name, peek(vm))) {
-            jsrRaise(vm, "NameException", "Name `%s` is not defined.", name->data);
+        Symbol* sym = GET_SYMBOL();
+        Value* global = resolveGlobal(vm, fn, sym);
+        if(global == NULL) {
+            jsrRaise(vm, "NameException", "Name `%s` is not defined.",
+                     stringData(SYMBOL_NAME(sym)));
             UNWIND_STACK(vm);
         }
+        *global = peek(vm);
         DISPATCH();
     }
 
     TARGET(OP_SETUP_EXCEPT): 
     TARGET(OP_SETUP_ENSURE): {
         uint16_t offset = NEXT_SHORT();
+        ASSERT(frame->handlerc < fn->handlerCount, "Handler stack overflow");
         Handler* handler = &frame->handlers[frame->handlerc++];
         handler->type = op == OP_SETUP_ENSURE ? HANDLER_ENSURE : HANDLER_EXCEPT;
         handler->address = ip + offset;
@@ -1529,13 +2055,32 @@ op_return:
         DISPATCH();
     }
 
+    TARGET(OP_GET_LOCALS): {
+        push(vm, frameStack[NEXT_CODE()]);
+        push(vm, frameStack[NEXT_CODE()]);
+        DISPATCH();
+    }
+
+    TARGET(OP_GET_LOCAL_CONST): {
+        push(vm, frameStack[NEXT_CODE()]);
+        push(vm, GET_CONST());
+        DISPATCH();
+    }
+
+    TARGET(OP_SET_LOCAL_POP): {
+        frameStack[NEXT_CODE()] = pop(vm);
+        DISPATCH();
+    }
+
     TARGET(OP_GET_UPVALUE): {
         push(vm, *closure->upvalues[NEXT_CODE()]->addr);
         DISPATCH();
     }
 
     TARGET(OP_SET_UPVALUE): {
-        *closure->upvalues[NEXT_CODE()]->addr = peek(vm);
+        ObjUpvalue* upvalue = closure->upvalues[NEXT_CODE()];
+        *upvalue->addr = peek(vm);
+        gcWriteBarrier(vm, (Obj*)upvalue, *upvalue->addr);
         DISPATCH();
     }
 
@@ -1582,7 +2127,7 @@ bool unwindStack(JStarVM* vm, int depth) {
     ObjInstance* exception = AS_INSTANCE(peek(vm));
 
     Value stacktraceVal = NULL_VAL;
-    hashTableGet(&exception->fields, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), &stacktraceVal);
+    instanceGetField(exception, copyString(vm, EXC_TRACE, strlen(EXC_TRACE)), &stacktraceVal);
     ASSERT(IS_STACK_TRACE(stacktraceVal), "Exception doesn't have a stacktrace object");
     ObjStackTrace* stacktrace = AS_STACK_TRACE(stacktraceVal);
 
@@ -1612,6 +2157,7 @@ bool unwindStack(JStarVM* vm, int depth) {
             Value exc = pop(vm);
             Handler* h = &frame->handlers[--frame->handlerc];
             RESTORE_HANDLER(h, frame, CAUSE_EXCEPT, exc);
+            if(vm->outOfMemory) gcResetOutOfMemory(vm);
             return true;
         }
 
@@ -1620,6 +2166,7 @@ bool unwindStack(JStarVM* vm, int depth) {
 
     // we have reached the end of the stack or a native/function boundary,
     // return from evaluation leaving the exception on top of the stack
+    if(vm->outOfMemory) gcResetOutOfMemory(vm);
     return false;
 }
 
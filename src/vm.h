@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "arena.h"
 #include "compiler.h"
 #include "const.h"
 #include "hashtable.h"
@@ -14,7 +15,7 @@
 #include "util.h"
 #include "value.h"
 
-// Enum encoding special method names needed at runtime
+// Enum encoding special method and field names needed at runtime
 // See methodSyms array in vm.c
 typedef enum MethodSymbol {
     // Constructor method
@@ -67,6 +68,11 @@ typedef enum MethodSymbol {
     SYM_POW,
     SYM_RPOW,
 
+    // Fields of the builtin Range class
+    SYM_RANGE_START,
+    SYM_RANGE_STOP,
+    SYM_RANGE_STEP,
+
     // Sentinel
     SYM_END
 } MethodSymbol;
@@ -86,13 +92,61 @@ typedef struct Handler {
 // Stackframe of a function executing in
 // the virtual machine
 typedef struct Frame {
-    uint8_t* ip;                    // Instruction pointer
-    Value* stack;                   // Base of stack for current frame
-    Obj* fn;                        // Function associated with the frame (ObjClosure or ObjNative)
-    Handler handlers[HANDLER_MAX];  // Exception handlers
-    uint8_t handlerc;               // Exception handlers count
+    uint8_t* ip;        // Instruction pointer
+    Value* stack;       // Base of stack for current frame
+    Obj* fn;            // Function associated with the frame (ObjClosure or ObjNative)
+    Handler* handlers;  // Exception handlers (allocated on the VM handler stack)
+    uint8_t handlerc;   // Exception handlers count
 } Frame;
 
+// Counters of the method inline caches, exposed in the `debug` module
+typedef struct CacheStats {
+    size_t hits;         // Invocations resolved by the inline cache
+    size_t misses;       // Invocations that required a method lookup
+    size_t megamorphic;  // Misses that happened on megamorphic call sites
+} CacheStats;
+
+// Statistics of the garbage collector, exposed by `jsrGetGCStats` and in the `debug` module
+typedef struct GCStats {
+    size_t minorCollections;         // Minor collections performed
+    size_t majorCollections;         // Major collections completed
+    double totalPause;               // Time spent in GC pauses, in milliseconds
+    double maxPause;                 // Longest GC pause, in milliseconds
+    size_t bytesAllocated;           // Bytes allocated since the creation of the VM
+    size_t bytesFreed;               // Bytes freed since the creation of the VM
+    size_t liveBytes;                // Bytes allocated at the end of the last collection
+    size_t objects[OBJ_TYPE_COUNT];  // Objects currently allocated, by type
+} GCStats;
+
+// Phase of the incremental major collection
+typedef enum GCPhase {
+    GC_IDLE,   // No major collection in progress
+    GC_MARK,   // Incrementally marking the reachable objects
+    GC_SWEEP,  // Incrementally freeing the unreached objects of the old generation
+} GCPhase;
+
+// Kinds of GC pauses, tracked by the GC pause time histogram
+typedef enum GCPause {
+    PAUSE_NONE,    // No collection work performed
+    PAUSE_MINOR,   // Minor collection
+    PAUSE_MARK,    // Start of a major collection or incremental marking step
+    PAUSE_REMARK,  // Last marking step of a major collection
+    PAUSE_SWEEP,   // Incremental sweeping step
+    PAUSE_FULL,    // Non-incremental major collection
+    PAUSE_END
+} GCPause;
+
+#define GC_PAUSE_BUCKETS 20
+
+// Categories of the memory allocated by the VM, tracked separately for `jsrGetMemStats`
+typedef enum MemCategory {
+    MEM_OBJECTS,  // Objects and the memory directly owned by them
+    MEM_TABLES,   // Entries of the internal HashTables (globals, methods, fields, ...)
+    MEM_CODE,     // Bytecode, line info, constants and symbols of functions
+    MEM_VM,       // VM stacks and GC bookkeeping
+    MEM_END
+} MemCategory;
+
 // The J* VM. This struct stores all the
 // state needed to execute J* code.
 struct JStarVM {
@@ -114,6 +168,10 @@ struct JStarVM {
     ObjClass* excClass;
     ObjClass* tableClass;
     ObjClass* udataClass;
+    ObjClass* typedArrClass;
+    ObjClass* f64ArrClass;
+    ObjClass* i32ArrClass;
+    ObjClass* byteArrClass;
 
     // Script arguments
     ObjList* argv;
@@ -121,12 +179,22 @@ struct JStarVM {
     // The empty tuple (singleton)
     ObjTuple* emptyTup;
 
+    // Root of the shape tree, i.e. the shape of instances without fields
+    ObjShape* emptyShape;
+
     // Current VM compiler (if any)
     Compiler* currCompiler;
 
-    // Cached method names needed at runtime
+    // Cached method and field names needed at runtime
     ObjString* methodSyms[SYM_END];
 
+    // Incremented every time a method is added to an already existing class.
+    // Method inline caches are valid only as long as this doesn't change
+    size_t methodsVersion;
+
+    // Method inline cache statistics
+    CacheStats methodCache;
+
     // Loaded modules
     HashTable modules;
 
@@ -141,11 +209,17 @@ struct JStarVM {
     Frame* frames;
     int frameSz, frameCount;
 
+    // Exception handler stack, shared by all frames
+    Handler* handlers;
+    size_t handlerSz;
+
     // Stack used during native function calls
     Value* apiStack;
 
-    // Constant string pool, for interned strings
+    // Pool of the interned strings. It holds its strings weakly: the unreached ones are
+    // removed from it before being freed by the garbage collector
     HashTable stringPool;
+    size_t youngInterned;  // Strings interned since the last collection
 
     // Linked list of all open upvalues
     ObjUpvalue* upvalues;
@@ -157,22 +231,78 @@ struct JStarVM {
     // Can be set asynchronously by a signal handler
     volatile sig_atomic_t evalBreak;
 
+    // Set when the heap limit has been exceeded, or when the allocation callback has failed. An
+    // OutOfMemoryException will be raised when the current native returns, or at the next
+    // `evalBreak` check
+    bool outOfMemory;
+
     // Custom data associated with the VM
     void* customData;
 
+    // Whether the compiler should optimize the generated bytecode
+    bool optimize;
+
     // ---- Memory management ----
 
-    // Linked list of all allocated objects (used in
-    // the sweep phase of GC to free unreached objects)
-    Obj* objects;
+    // Allocator of the small blocks of memory of the VM
+    Arena arena;
+
+    // Arena pages holding objects allocated since the last collection (used by minor GCs to
+    // free unreached objects). The old generation is swept by walking the bitmaps of all pages
+    ArenaPage** nurseryPages;
+    size_t nurseryCapacity, nurseryCount;
 
-    size_t allocated;  // Bytes currently allocated
-    size_t nextGC;     // Bytes at which the next GC will be triggered
-    int heapGrowRate;  // Rate at which the heap will grow after a GC
+    // Linked list of the objects too big to be allocated in an arena page. The young ones are
+    // always at its front
+    LargeObj* largeObjects;
+
+    size_t allocated;         // Bytes currently allocated
+    size_t nextGC;            // Bytes at which the next major GC will be triggered
+    int heapGrowRate;         // Rate at which the heap will grow after a major GC
+    size_t nurseryAllocated;  // Bytes allocated since the last GC
+    size_t nurserySize;       // Bytes at which the next minor GC will be triggered
+
+    // Bytes currently allocated, by category
+    size_t allocatedByCategory[MEM_END];
+
+    // Bytes after which an OutOfMemoryException is raised (0 if there is no limit)
+    size_t heapLimit;
+
+    // Memory given back to the allocation callback when it fails, so that the VM can keep running
+    // until the OutOfMemoryException is raised (NULL if it has been used up)
+    void* memReserve;
+
+    // Old objects that may reference objects in the nursery, or objects that have been
+    // written to after being reached during an incremental major collection
+    Obj** remembered;
+    size_t rememberedCapacity, rememberedCount;
 
     // Stack used to recursevely reach all the fields of reached objects
     Obj** reachedStack;
     size_t reachedCapacity, reachedCount;
+
+    // State of the GC in progress
+    bool minorGC;        // Whether the GC is a minor one
+    bool rememberRoots;  // Whether reached objects should be added to the remembered set
+    size_t gcWork;       // Units of work performed by the current GC step
+
+    // Garbage collector statistics
+    GCStats gcStats;
+
+    // State of the incremental major collection
+    GCPhase gcPhase;
+    size_t sweepPage;        // Index of the next arena page to sweep
+    LargeObj* unsweptLarge;  // Large objects of the old generation still to be swept
+    size_t stepAllocated;    // Bytes allocated since the last incremental step
+    size_t gcStepSize;       // Bytes allocated between two incremental steps
+    size_t gcStepBudget;     // Units of work performed by an incremental step
+    int gcThreads;           // Threads marking the heap when the marking can't be incremental
+
+#ifdef JSTAR_DBG_GC_PAUSES
+    // Histogram of the GC pause times, in power of two buckets of microseconds
+    size_t gcPauses[PAUSE_END][GC_PAUSE_BUCKETS];
+    double gcMaxPause[PAUSE_END];
+#endif
 };
 
 bool getValueField(JStarVM* vm, ObjString* name);
@@ -181,6 +311,10 @@ bool setValueField(JStarVM* vm, ObjString* name);
 bool getValueSubscript(JStarVM* vm);
 bool setValueSubscript(JStarVM* vm);
 
+// Stores `val` at index `i` of the typed array, raising a TypeException if `val` isn't a Number
+// that can be represented by the element type
+bool typedArrayStore(JStarVM* vm, ObjTypedArray* arr, size_t i, Value val);
+
 bool callValue(JStarVM* vm, Value callee, uint8_t argc);
 bool invokeValue(JStarVM* vm, ObjString* name, uint8_t argc);
 
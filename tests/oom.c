@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jstar/jstar.h"
+
+#define HEAP_LIMIT   (8 * 1024 * 1024)
+#define ALLOC_BUDGET (32 * 1024 * 1024)
+
+// Allocates past the heap limit, catches the OutOfMemoryException and checks that the VM is
+// still usable once the objects held by the unwound frames are reclaimed
+static const char* script =
+    "var err, after\n"
+    "try\n"
+    "    var l = []\n"
+    "    while true\n"
+    "        l.add([1, 2, 3])\n"
+    "    end\n"
+    "except OutOfMemoryException e\n"
+    "    err = e.err()\n"
+    "end\n"
+    "var keep = []\n"
+    "for var i = 0; i < 1000; i += 1\n"
+    "    keep.add([i])\n"
+    "end\n"
+    "after = #keep\n";
+
+// Exceeds the heap limit inside of a single native call, whose exception must be raised in the
+// calling frame while its handler is still active
+static const char* nativeScript =
+    "var err\n"
+    "var allocated = false\n"
+    "try\n"
+    "    var l = List(20000000, 0)\n"
+    "    allocated = true\n"
+    "except OutOfMemoryException e\n"
+    "    err = e.err()\n"
+    "end\n";
+
+// Exhausts the memory given out by the allocation callback, without any heap limit
+static const char* allocatorScript =
+    "var err\n"
+    "try\n"
+    "    var head = null\n"
+    "    while true\n"
+    "        head = [head, 1, 2, 3]\n"
+    "    end\n"
+    "except OutOfMemoryException e\n"
+    "    err = e.err()\n"
+    "end\n"
+    "var keep = []\n"
+    "for var i = 0; i < 1000; i += 1\n"
+    "    keep.add([i])\n"
+    "end\n";
+
+typedef struct Budget {
+    size_t allocated, max;
+} Budget;
+
+// Allocation callback that fails once `Budget.max` bytes are in use
+static void* budgetRealloc(void* ptr, size_t oldSize, size_t newSize, void* data) {
+    Budget* b = data;
+    if(newSize > oldSize && b->allocated + (newSize - oldSize) > b->max) {
+        return NULL;
+    }
+    void* mem = jsrDefaultReallocCB(ptr, oldSize, newSize, NULL);
+    if(mem != NULL || newSize == 0) b->allocated += newSize - oldSize;
+    return mem;
+}
+
+static void errorCallback(JStarVM* vm, JStarResult res, const char* file, int line,
+                          const char* err) {
+    fprintf(stderr, "%s:%d: %s\n", file, line, err);
+}
+
+static bool check(bool cond, const char* msg) {
+    if(!cond) fprintf(stderr, "FAILED: %s\n", msg);
+    return cond;
+}
+
+static bool checkErr(JStarVM* vm, const char* expected) {
+    if(!check(jsrGetGlobal(vm, JSR_MAIN_MODULE, "err") && jsrIsString(vm, -1),
+              "err() didn't return a String")) {
+        return false;
+    }
+    bool ok = check(strcmp(jsrGetString(vm, -1), expected) == 0, "wrong err() message");
+    jsrPop(vm);
+    return ok;
+}
+
+static bool testHeapLimit(void) {
+    JStarConf conf = jsrGetConf();
+    conf.heapLimit = HEAP_LIMIT;
+    conf.errorCallback = &errorCallback;
+
+    JStarVM* vm = jsrNewVM(&conf);
+    bool ok = check(jsrEvalString(vm, "<oom>", script) == JSR_SUCCESS, "script raised");
+
+    char expected[64];
+    snprintf(expected, sizeof(expected), "Heap limit of %d bytes exceeded", HEAP_LIMIT);
+
+    if(ok) {
+        ok = checkErr(vm, expected);
+    }
+    if(ok) {
+        ok = check(jsrGetGlobal(vm, JSR_MAIN_MODULE, "after") && jsrIsNumber(vm, -1) &&
+                       jsrGetNumber(vm, -1) == 1000,
+                   "VM not usable after the OutOfMemoryException");
+        jsrPop(vm);
+    }
+    if(ok) {
+        ok = check(jsrEvalString(vm, "<oom>", nativeScript) == JSR_SUCCESS, "native script raised");
+    }
+    if(ok) {
+        ok = checkErr(vm, expected);
+    }
+    if(ok) {
+        ok = check(jsrGetGlobal(vm, JSR_MAIN_MODULE, "allocated") && !jsrGetBoolean(vm, -1),
+                   "native ran past the heap limit");
+        jsrPop(vm);
+    }
+
+    jsrFreeVM(vm);
+    return ok;
+}
+
+static bool testAllocatorFailure(void) {
+    Budget budget = {0, ALLOC_BUDGET};
+
+    JStarConf conf = jsrGetConf();
+    conf.allocator = &budgetRealloc;
+    conf.allocatorData = &budget;
+    conf.errorCallback = &errorCallback;
+
+    JStarVM* vm = jsrNewVM(&conf);
+    bool ok = check(jsrEvalString(vm, "<oom>", allocatorScript) == JSR_SUCCESS,
+                    "allocator script raised");
+    if(ok) {
+        ok = checkErr(vm, "Out of memory");
+    }
+
+    jsrFreeVM(vm);
+    return check(budget.allocated == 0, "memory not returned to the allocator") && ok;
+}
+
+int main(void) {
+    bool ok = testHeapLimit();
+    ok = testAllocatorFailure() && ok;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
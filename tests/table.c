@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "jstar/jstar.h"
+
+// Checks that a Table iterates in insertion order after overwrites, deletes and reinserts
+static const char* orderScript =
+    "var t = {'a' : 1, 'b' : 2, 'c' : 3, 'd' : 4}\n"
+    "t.delete('b')\n"
+    "t['b'] = 5\n"
+    "t['a'] = 6\n"
+    "assert(t.keys() == ['a', 'c', 'd', 'b'], 'wrong keys() order')\n"
+    "assert(t.values() == [6, 3, 4, 5], 'wrong values() order')\n"
+    "var keys = []\n"
+    "for var k in t\n"
+    "    keys.add(k)\n"
+    "end\n"
+    "assert(keys == ['a', 'c', 'd', 'b'], 'wrong iteration order')\n"
+    "assert(t.__string__() == '{a : 6, c : 3, d : 4, b : 5}', 'wrong __string__()')\n"
+    "t.delete('c')\n"
+    "t.delete('b')\n"
+    "keys = []\n"
+    "for var k in t\n"
+    "    keys.add(k)\n"
+    "end\n"
+    "assert(keys == ['a', 'd'], 'deleted entries iterated')\n"
+    "assert(#t == 2 and !t.contains('c') and t['c'] == null, 'deleted entry still found')\n";
+
+// Inserts and deletes keys so that deleted entries fill up the entries array over and over,
+// compacting it in place, and checks that the live entries and their order survive each cycle
+static const char* compactionScript =
+    "class Key\n"
+    "    fun new(n)\n"
+    "        this.n = n\n"
+    "    end\n"
+    "    fun __hash__()\n"
+    "        return this.n % 4\n"
+    "    end\n"
+    "    fun __eq__(o)\n"
+    "        return o is Key and o.n == this.n\n"
+    "    end\n"
+    "end\n"
+    "var window = 8\n"
+    "var t = {}\n"
+    "var c = {}\n"
+    "for var i = 0; i < 10000; i += 1\n"
+    "    t[i] = i * 2\n"
+    "    c[Key(i)] = i\n"
+    "    if i >= window\n"
+    "        assert(t.delete(i - window), 'delete() failed')\n"
+    "        assert(c.delete(Key(i - window)), 'delete() failed with a custom key')\n"
+    "    end\n"
+    "    assert(#t == (i + 1 if i < window else window), 'wrong size')\n"
+    "end\n"
+    "var expected = List(range(10000 - window, 10000))\n"
+    "assert(t.keys() == expected, 'wrong keys after compaction')\n"
+    "assert(t.values() == List(range(2 * (10000 - window), 20000, 2)), 'wrong values')\n"
+    "var keys = []\n"
+    "for var k in c\n"
+    "    keys.add(k.n)\n"
+    "end\n"
+    "assert(keys == expected, 'wrong custom keys after compaction')\n"
+    "assert(c[Key(9999)] == 9999 and c[Key(0)] == null, 'wrong lookup with a custom key')\n"
+    "for var i = 10000 - window; i < 10000; i += 1\n"
+    "    t.delete(i)\n"
+    "end\n"
+    "assert(#t == 0 and t.keys() == [], 'Table not empty')\n"
+    "t['x'] = 1\n"
+    "assert(t.keys() == ['x'], 'wrong keys after emptying the Table')\n"
+    "t.clear()\n"
+    "t['y'] = 2\n"
+    "assert(t.keys() == ['y'] and t['x'] == null, 'wrong keys after clear()')\n";
+
+// Checks the construction of a Table from an empty Table, another Table and an Iterable
+static const char* constructorScript =
+    "var empty = Table({})\n"
+    "assert(#empty == 0 and empty.keys() == [], 'Table({}) not empty')\n"
+    "empty['a'] = 1\n"
+    "assert(empty['a'] == 1, 'Table({}) not usable')\n"
+    "assert(#Table(Table()) == 0, 'Table(Table()) not empty')\n"
+    "var t = {'c' : 1, 'a' : 2, 'b' : 3}\n"
+    "t.delete('a')\n"
+    "var copy = Table(t)\n"
+    "assert(copy.keys() == ['c', 'b'] and copy.values() == [1, 3], 'wrong copy')\n"
+    "copy['d'] = 4\n"
+    "assert(#t == 2, 'copy shares the entries of the original')\n"
+    "var pairs = Table([['z', 1], ('y', 2), ['z', 3]])\n"
+    "assert(pairs.keys() == ['z', 'y'] and pairs.values() == [3, 2], 'wrong Table from pairs')\n";
+
+static void errorCallback(JStarVM* vm, JStarResult res, const char* file, int line,
+                          const char* err) {
+    fprintf(stderr, "%s:%d: %s\n", file, line, err);
+}
+
+static bool run(JStarVM* vm, const char* name, const char* script) {
+    if(jsrEvalString(vm, name, script) != JSR_SUCCESS) {
+        fprintf(stderr, "FAILED: %s\n", name);
+        return false;
+    }
+    return true;
+}
+
+int main(void) {
+    JStarConf conf = jsrGetConf();
+    conf.errorCallback = &errorCallback;
+
+    JStarVM* vm = jsrNewVM(&conf);
+    bool ok = run(vm, "<order>", orderScript);
+    ok = run(vm, "<compaction>", compactionScript) && ok;
+    ok = run(vm, "<constructor>", constructorScript) && ok;
+    jsrFreeVM(vm);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "jstar/jstar.h"
+
+#define LENGTH 16
+
+// Reads and writes a typed array pushed from C
+static const char* accessScript =
+    "assert(arr is Int32Array and #arr == 16, 'wrong typed array')\n"
+    "for var i = 0; i < #arr; i += 1\n"
+    "    assert(arr[i] == i * 3, 'wrong element')\n"
+    "    arr[i] = -i\n"
+    "end\n";
+
+// Typed arrays whose size in bytes overflows a size_t must be rejected, not wrapped around
+static const char* overflowScript =
+    "var overflowing = [\n"
+    "    (Float64Array, 2305843009213693952), (Float64Array, 4611686018427387904),\n"
+    "    (Int32Array, 4611686018427387904)\n"
+    "]\n"
+    "for var cls, size in overflowing\n"
+    "    try\n"
+    "        cls(size)\n"
+    "        assert(false, 'typed array of {0} elements created' % size)\n"
+    "    except InvalidArgException e\n"
+    "    end\n"
+    "end\n"
+    "var f = Float64Array(8)\n"
+    "f[7] = 1\n"
+    "assert(#f == 8 and f[7] == 1, 'wrong small typed array')\n";
+
+static void errorCallback(JStarVM* vm, JStarResult res, const char* file, int line,
+                          const char* err) {
+    fprintf(stderr, "%s:%d: %s\n", file, line, err);
+}
+
+static bool check(bool cond, const char* msg) {
+    if(!cond) fprintf(stderr, "FAILED: %s\n", msg);
+    return cond;
+}
+
+static bool testAccess(JStarVM* vm) {
+    int32_t* data = jsrPushTypedArray(vm, JSR_INT32_ARRAY, LENGTH);
+    if(!check(data != NULL, "jsrPushTypedArray() failed")) return false;
+    for(int i = 0; i < LENGTH; i++) {
+        data[i] = i * 3;
+    }
+    jsrSetGlobal(vm, JSR_MAIN_MODULE, "arr");
+    jsrPop(vm);
+
+    if(!check(jsrEvalString(vm, "<access>", accessScript) == JSR_SUCCESS, "access script raised")) {
+        return false;
+    }
+
+    bool ok = check(jsrGetGlobal(vm, JSR_MAIN_MODULE, "arr") && jsrIsTypedArray(vm, -1),
+                    "arr is not a typed array");
+    if(ok) {
+        size_t length;
+        data = jsrGetTypedArrayData(vm, -1, &length);
+        ok = check(jsrGetTypedArrayType(vm, -1) == JSR_INT32_ARRAY && length == LENGTH,
+                   "wrong type or length");
+        for(int i = 0; ok && i < LENGTH; i++) {
+            ok = check(data[i] == -i, "element not written by the script");
+        }
+        jsrPop(vm);
+    }
+    return ok;
+}
+
+static bool testOverflow(JStarVM* vm) {
+    bool ok = check(jsrEvalString(vm, "<overflow>", overflowScript) == JSR_SUCCESS,
+                    "overflow script raised");
+
+    JStarArrayType types[] = {JSR_FLOAT64_ARRAY, JSR_INT32_ARRAY, JSR_BYTE_ARRAY};
+    for(size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if(!check(jsrPushTypedArray(vm, types[i], SIZE_MAX) == NULL,
+                  "jsrPushTypedArray() accepted an overflowing length")) {
+            return false;
+        }
+
+        jsrGetGlobal(vm, JSR_CORE_MODULE, "InvalidArgException");
+        ok = check(jsrIs(vm, -2, -1), "jsrPushTypedArray() didn't raise InvalidArgException") && ok;
+        jsrPop(vm);
+        jsrPop(vm);
+    }
+    return ok;
+}
+
+int main(void) {
+    JStarConf conf = jsrGetConf();
+    conf.errorCallback = &errorCallback;
+
+    JStarVM* vm = jsrNewVM(&conf);
+    bool ok = testAccess(vm);
+    ok = testOverflow(vm) && ok;
+    jsrFreeVM(vm);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}